@@ -3,9 +3,11 @@
 #include <stdio.h>
 #include <inttypes.h> /* PRIu32 */
 #include "bmp180/bmp180.h"
+#include "bmp180/sampler.h"
 
 #define I2C_BUS "/dev/i2c-0"
 #define DEVICE_I2C_ADDRESS 0 /* let the library figure it out */
+#define SAMPLE_PERIOD 500000 /* microseconds */
 
 #define ERR(...) fprintf(stderr, __VA_ARGS__)
 #define MSG(...) fprintf(stderr, __VA_ARGS__)
@@ -13,31 +15,45 @@
 int main(int argc, char *argv[])
 {
    i2c_lowlevel_config config;
-   config.device = I2C_BUS;
+   config.device = (argc > 1) ? argv[1] : I2C_BUS;
    bmp180_t *ctx = bmp180_init(&config, DEVICE_I2C_ADDRESS, BMP180_MODE_HIGH_RESOLUTION);
    if(NULL == ctx)
    {
-      ERR("Initialization failed");
+      ERR("Initialization failed\n");
    }
    else
    {
-      float temperature;
-      uint32_t pressure; 
-
-      for(int i = 0; i < 100; ++i)
+      /* Sample on a fixed cadence; see sampler.h for CPU affinity and real-time priority */
+      bmp180_sampler_config_t sampler_config = { SAMPLE_PERIOD, -1, 0, false, 16 };
+      bmp180_sampler_t sampler = bmp180_sampler_start(ctx, &sampler_config);
+      if(NULL == sampler)
       {
-         if(!bmp180_measure(ctx, &temperature, &pressure))
-         {
-            ERR("Query failed");
-         }
-         else
+         ERR("Failed to start sampler\n");
+      }
+      else
+      {
+         bmp180_sampler_stats_t stats;
+         bmp180_sample_t sample;
+
+         for(int i = 0; i < 100; ++i)
          {
-            MSG("Temperature: %.2f, Pressure: %" PRIu32, temperature, pressure);
+            if(bmp180_sampler_read(sampler, &sample, 1, 2 * SAMPLE_PERIOD) == 0)
+            {
+               ERR("Query failed\n");
+            }
+            else
+            {
+               MSG("Temperature: %.2f, Pressure: %" PRIi32 "\n", (float)sample.temperature/10.0,
+                  sample.pressure);
+            }
          }
-         usleep(500000); 
+         bmp180_sampler_get_stats(sampler, &stats);
+         MSG("Jitter (us): p50 %" PRIu32 ", p99 %" PRIu32 ", max %" PRIu32 "; missed %" PRIu64 "\n",
+            stats.jitter.p50, stats.jitter.p99, stats.jitter.max, stats.missed);
+         bmp180_sampler_stop(sampler);
       }
       bmp180_free(ctx);
    }
 
-   MSG("Test application finished");
+   MSG("Test application finished\n");
 }
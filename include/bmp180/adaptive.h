@@ -0,0 +1,58 @@
+/**
+ * @file adaptive.h
+ * @defgroup bmp180_adaptive bmp180_adaptive
+ * @{
+ *
+ * Adaptive oversampling-mode controller for bmp180
+ *
+ * Copyright (c) 2024 Zorxx Software
+ *
+ * MIT Licensed as described in the file LICENSE
+ */
+#ifndef __BMP180_ADAPTIVE_H__
+#define __BMP180_ADAPTIVE_H__
+
+#include "bmp180/bmp180.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Adaptive controller configuration.
+ *
+ * After every sample the controller picks a mode within [min_mode, max_mode]:
+ * - the lowest mode whose expected noise, extrapolated from the observed noise, is at or
+ *   below `target_noise`;
+ * - but no higher than the highest mode in which pressure moves less than that mode's
+ *   datasheet noise during one conversion, at the observed rate of change;
+ * - and no higher than the highest mode that fits the bus-time and current budgets
+ *   at the observed sample rate.
+ * A new decision must persist for `hold` consecutive samples before the mode changes.
+ */
+typedef struct
+{
+   bmp180_mode_t min_mode;
+   bmp180_mode_t max_mode;
+   uint32_t target_noise;    //!< desired pressure noise (Pa RMS), 0 to prefer max_mode
+   uint32_t hold;            //!< samples a decision must persist before switching
+   uint16_t bus_budget;      //!< max share of wall time spent converting (permille), 0 for unlimited
+   uint32_t current_budget;  //!< max average sensor supply current (uA), 0 for unlimited
+} bmp180_adaptive_config_t;
+
+/**
+ * @brief Enable or disable the adaptive mode controller
+ * Decisions and per-mode time are reported through bmp180_get_stats().
+ * @param bmp obtained from a successful bmp180_init() call
+ * @param config controller configuration, or NULL to disable (the current mode is kept)
+ * @return true on success, false if the configuration is invalid
+ */
+bool bmp180_set_adaptive(bmp180_t bmp, const bmp180_adaptive_config_t *config);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**@}*/
+
+#endif /* __BMP180_ADAPTIVE_H__ */
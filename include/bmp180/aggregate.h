@@ -0,0 +1,100 @@
+/**
+ * @file aggregate.h
+ * @defgroup bmp180_aggregate bmp180_aggregate
+ * @{
+ *
+ * Streaming window aggregation of bmp180 samples
+ *
+ * Copyright (c) 2024 Zorxx Software
+ *
+ * MIT Licensed as described in the file LICENSE
+ */
+#ifndef __BMP180_AGGREGATE_H__
+#define __BMP180_AGGREGATE_H__
+
+#include "bmp180/bmp180.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Window type.
+ */
+typedef enum
+{
+   BMP180_WINDOW_TUMBLING = 0, //!< consecutive, non-overlapping windows
+   BMP180_WINDOW_SLIDING       //!< the most recent `length` samples, reported every `hop` samples
+} bmp180_window_type_t;
+
+typedef struct
+{
+   bmp180_window_type_t type;
+   uint32_t length;  //!< samples per window
+   uint32_t hop;     //!< samples between sliding window reports (ignored for tumbling windows)
+} bmp180_aggregate_config_t;
+
+/**
+ * Statistics for one channel over a window.
+ */
+typedef struct
+{
+   int32_t min;
+   int32_t max;
+   float mean;
+   float stddev;     //!< sample standard deviation, 0 for single-sample windows
+} bmp180_channel_summary_t;
+
+/**
+ * Summary of one window.
+ */
+typedef struct
+{
+   uint64_t start;   //!< timestamp of the oldest sample in the window
+   uint64_t end;     //!< timestamp of the newest sample in the window
+   uint32_t count;   //!< number of samples in the window
+   bmp180_channel_summary_t temperature; //!< in 0.1 degrees Celsius
+   bmp180_channel_summary_t pressure;    //!< in Pa
+} bmp180_summary_t;
+
+typedef void *bmp180_aggregate_t;
+
+/**
+ * @brief Create an aggregator
+ * Memory is allocated once, here: nothing for tumbling windows, and a ring of `length`
+ * samples plus the min/max deques for sliding windows.
+ * @param config window configuration
+ * @return bmp180_aggregate_t on success, NULL on failure
+ */
+bmp180_aggregate_t bmp180_aggregate_init(const bmp180_aggregate_config_t *config);
+
+/**
+ * @brief Free an aggregator
+ * @param agg obtained from a successful bmp180_aggregate_init() call
+ * @return true on success
+ */
+bool bmp180_aggregate_free(bmp180_aggregate_t agg);
+
+/**
+ * @brief Fold a sample into the current window
+ * @param agg obtained from a successful bmp180_aggregate_init() call
+ * @param sample sample to add, e.g. from bmp180_sample()
+ * @param[out] summary filled in when a window is complete
+ * @return true if `summary` was filled in
+ */
+bool bmp180_aggregate_push(bmp180_aggregate_t agg, const bmp180_sample_t *sample,
+                           bmp180_summary_t *summary);
+
+/**
+ * @brief Discard all samples, starting a new window
+ * @param agg obtained from a successful bmp180_aggregate_init() call
+ */
+void bmp180_aggregate_reset(bmp180_aggregate_t agg);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**@}*/
+
+#endif /* __BMP180_AGGREGATE_H__ */
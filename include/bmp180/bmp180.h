@@ -16,6 +16,7 @@
 #ifndef __BMP180_H__
 #define __BMP180_H__
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 
@@ -45,8 +46,142 @@ typedef enum
     BMP180_MODE_ULTRA_HIGH_RESOLUTION //!< 8 samples, 25.5 ms
 } bmp180_mode_t;
 
+#define BMP180_MODE_COUNT 4 //!< number of bmp180_mode_t values
+
+/**
+ * Factory calibration coefficients, as read from the device EEPROM.
+ */
+typedef struct
+{
+   int16_t AC1;
+   int16_t AC2;
+   int16_t AC3;
+   uint16_t AC4;
+   uint16_t AC5;
+   uint16_t AC6;
+   int16_t B1;
+   int16_t B2;
+   int16_t MB;
+   int16_t MC;
+   int16_t MD;
+} bmp180_calibration_t;
+
 typedef void *bmp180_t;
 
+/**
+ * Per-descriptor statistics, see bmp180_get_stats().
+ */
+typedef struct
+{
+   bmp180_mode_t mode;                     //!< current mode
+   uint32_t samples[BMP180_MODE_COUNT];    //!< successful samples, per mode
+   uint64_t mode_time[BMP180_MODE_COUNT];  //!< wall time between samples spent in each mode (microseconds)
+   uint32_t mode_changes;                  //!< mode switches made by the adaptive controller
+   int32_t rate;                           //!< adaptive controller's pressure rate-of-change estimate (Pa/s)
+   uint32_t noise;                         //!< adaptive controller's pressure noise estimate (Pa RMS * 16)
+   uint32_t failures;                      //!< failed measurement attempts
+   uint32_t retries;                       //!< measurement attempts repeated by the recovery policy
+   uint32_t soft_resets;                   //!< soft resets issued by the recovery policy
+   uint32_t reopens;                       //!< bus handles reopened by the recovery policy
+   uint32_t recoveries;                    //!< measurements that succeeded after a failure
+   uint64_t recovery_time;                 //!< total time from first failure to success (microseconds)
+   uint32_t max_recovery_time;             //!< longest time from first failure to success (microseconds)
+   uint32_t timeouts;                      //!< measurements abandoned at their deadline
+   uint32_t cancellations;                 //!< measurements abandoned by bmp180_cancel()
+   /* Cost accounting (i2c driver only): bus traffic at the configured bus speed, and nominal
+      conversion times with the charge they draw, from the datasheet's current for each mode */
+   uint64_t bus_bytes;                     //!< bytes transferred, including address bytes
+   uint64_t bus_clocks;                    //!< SCL clocks for those bytes
+   uint64_t bus_time;                      //!< time for those clocks (microseconds)
+   uint64_t conversion_time[BMP180_MODE_COUNT]; //!< time spent converting, per mode (microseconds)
+   uint64_t charge;                        //!< estimated sensor charge for the conversions (nC)
+   uint32_t throttled;                     //!< measurements delayed by the budget
+   uint64_t throttle_time;                 //!< total delay imposed by the budget (microseconds)
+   uint32_t refused;                       //!< measurements the budget didn't allow before their deadline
+} bmp180_stats_t;
+
+#define BMP180_STANDBY_CURRENT 100 //!< typical sensor standby current (nA)
+
+/**
+ * Cost budget, see bmp180_set_budget().
+ * Measurements are spaced so their cost stays under each ceiling on average. `current`
+ * is the sensor's average current, standby included; `bus_utilization` is the share of
+ * wall time the device's bus traffic takes. Budget left unused while idle is saved, up to
+ * `burst` microseconds' worth at the ceiling, so short bursts run undelayed.
+ */
+typedef struct
+{
+   uint32_t current;          //!< average current ceiling (nA), above BMP180_STANDBY_CURRENT; 0 for none
+   uint16_t bus_utilization;  //!< bus time ceiling, per mille of wall time, 1 to 1000; 0 for none
+   uint32_t burst;            //!< budget that can be saved up (microseconds at the ceiling)
+} bmp180_budget_t;
+
+/**
+ * Fault recovery policy, see bmp180_set_recovery().
+ * After a failed attempt the measurement is retried up to `max_retries` times, waiting
+ * `backoff` microseconds before the first retry and doubling the wait (up to `max_backoff`)
+ * for each one after. From the second retry on, the device is soft-reset first (if
+ * `soft_reset` is set); if the device doesn't respond to the reset, the bus handle is
+ * reopened (if `reopen` is set). Calibration data is never re-read.
+ */
+typedef struct
+{
+   uint8_t max_retries;
+   uint32_t backoff;      //!< microseconds
+   uint32_t max_backoff;  //!< microseconds
+   bool soft_reset;
+   bool reopen;
+} bmp180_recovery_config_t;
+
+/**
+ * Single measurement, including the raw register values it was computed from.
+ */
+typedef struct
+{
+   uint64_t timestamp; //!< sys_microsecond_tick() at the start of the temperature conversion
+   int32_t ut;         //!< uncompensated temperature
+   int32_t up;         //!< uncompensated pressure, scaled for `oss`
+   uint8_t oss;        //!< oversampling setting that `up` corresponds to
+   int32_t temperature;//!< compensated temperature, in 0.1 degrees Celsius
+   int32_t pressure;   //!< compensated pressure, in Pa
+} bmp180_sample_t;
+
+/**
+ * Software filter algorithm.
+ */
+typedef enum
+{
+   BMP180_FILTER_NONE = 0, //!< no filtering, one conversion per sample
+   BMP180_FILTER_BOXCAR,   //!< average of `decimation` conversions
+   BMP180_FILTER_CIC,      //!< CIC decimator with `order` integrator/comb stages
+   BMP180_FILTER_IIR       //!< first-order IIR, y += (x - y) / 2^iir_shift
+} bmp180_filter_type_t;
+
+/**
+ * Point in the measurement path at which the filter runs.
+ */
+typedef enum
+{
+   BMP180_FILTER_STAGE_RAW = 0,    //!< filter UP before compensation
+   BMP180_FILTER_STAGE_COMPENSATED //!< filter compensated pressure
+} bmp180_filter_stage_t;
+
+/**
+ * Software oversampling configuration.
+ * Every output sample consumes `decimation` pressure conversions (and a single temperature
+ * conversion), so the output rate is the native conversion rate divided by `decimation`.
+ * When filtering raw UP, the extra resolution is kept by compensating the result as if it
+ * had been sampled with a higher hardware oversampling setting (up to oss 3).
+ */
+typedef struct
+{
+   bmp180_filter_type_t type;
+   bmp180_filter_stage_t stage;
+   uint8_t decimation; //!< conversions per output sample (1-255)
+   uint8_t order;      //!< CIC stages (1-4), ignored for other filters
+   uint8_t iir_shift;  //!< IIR coefficient exponent (0-15), ignored for other filters
+} bmp180_filter_config_t;
+
 /**
  * @brief Initialize device descriptor
  * @param config OS/platform-specific configuration structure (e.g. see bmp180_linux.h or bmp180_esp.h) 
@@ -56,6 +191,72 @@ typedef void *bmp180_t;
  */
 bmp180_t bmp180_init(i2c_lowlevel_config *config, uint8_t i2c_address, bmp180_mode_t mode);
 
+#define BMP180_OPTIONS_VERSION  1       //!< current bmp180_options_t version
+#define BMP180_DEFAULT_SPEED    400000  //!< default i2c clock (Hz)
+#define BMP180_DEFAULT_TIMEOUT  50      //!< default transaction timeout (ms)
+#define BMP180_DEFAULT_MARGIN   500     //!< default conversion margin (us)
+
+/**
+ * How long to wait for a conversion, beyond its datasheet maximum time.
+ */
+typedef enum
+{
+   BMP180_MARGIN_FIXED = 0,    //!< wait the conversion time plus `margin` microseconds
+   BMP180_MARGIN_PROPORTIONAL, //!< wait the conversion time plus `margin` permille of it
+   BMP180_MARGIN_POLL          //!< wait the conversion time less `margin` microseconds, then poll
+                               //!< the conversion-complete bit (giving up waiting
+                               //!< BMP180_DEFAULT_MARGIN after the conversion time)
+} bmp180_margin_policy_t;
+
+/**
+ * Where the calibration coefficients come from.
+ */
+typedef enum
+{
+   BMP180_CALIBRATION_EEPROM = 0, //!< read from the device
+   BMP180_CALIBRATION_CACHE,      //!< use `calibration` if it holds coefficients (none is zero),
+                                  //!< otherwise read them from the device and store them there
+   BMP180_CALIBRATION_SUPPLIED    //!< use `calibration`; the device's EEPROM is not read
+} bmp180_calibration_source_t;
+
+/**
+ * Options for bmp180_init_ex(). Zero-valued fields select the defaults used by bmp180_init().
+ */
+typedef struct
+{
+   uint32_t version;                //!< BMP180_OPTIONS_VERSION
+   bmp180_mode_t mode;              //!< query mode
+   uint32_t speed;                  //!< i2c clock (Hz), 0 for BMP180_DEFAULT_SPEED; on Linux the
+                                    //!< adapter sets the clock, and this only affects bmp180_get_latency()
+   uint32_t timeout;                //!< transaction timeout (ms), 0 for BMP180_DEFAULT_TIMEOUT; when
+                                    //!< set, deadlines may shorten it. On Linux this is the adapter's
+                                    //!< I2C_TIMEOUT, shared by every device and user of the adapter
+   bmp180_margin_policy_t margin_policy;
+   uint32_t margin;                 //!< see bmp180_margin_policy_t; 0 selects BMP180_DEFAULT_MARGIN
+                                    //!< for BMP180_MARGIN_FIXED
+   bmp180_calibration_source_t calibration_source;
+   bmp180_calibration_t *calibration; //!< for BMP180_CALIBRATION_CACHE and _SUPPLIED
+} bmp180_options_t;
+
+/**
+ * @brief Initialize device descriptor with extended options
+ * @param config OS/platform-specific configuration structure (e.g. see bmp180_linux.h or bmp180_esp.h)
+ * @param i2c_address I2C slave address of BMP180 device (likely BMP180_DEVICE_ADDRESS)
+ * @param options initialization options; `version` must be BMP180_OPTIONS_VERSION
+ * @return bmp180_t on success, NULL on failure
+ */
+bmp180_t bmp180_init_ex(i2c_lowlevel_config *config, uint8_t i2c_address, const bmp180_options_t *options);
+
+/**
+ * @brief Worst-case time one sample takes in each mode, with the descriptor's options
+ * Includes the conversion waits (with margins, and the filter's decimation) and the bus
+ * transfers at the configured clock; polling is counted at its limit.
+ * @param bmp obtained from a successful bmp180_init() or bmp180_init_ex() call
+ * @param[out] latency sample latency for each bmp180_mode_t (microseconds)
+ * @return true on success, false for descriptors that don't use the i2c driver
+ */
+bool bmp180_get_latency(bmp180_t bmp, uint32_t latency[BMP180_MODE_COUNT]);
+
 /**
  * @brief Free device descriptor
  * @param bmp obtained from a successful bmp180_init() call
@@ -72,6 +273,170 @@ bool bmp180_free(bmp180_t bmp);
  */
 bool bmp180_measure(bmp180_t bmp, float *temperature, uint32_t *pressure);
 
+/**
+ * @brief Measure temperature and pressure, returning raw and compensated values
+ * If a filter is attached (see bmp180_set_filter()), this performs as many pressure
+ * conversions as needed to produce one filtered output.
+ * @param bmp obtained from a successful bmp180_init() call
+ * @param[out] sample measurement result
+ * @return true on success
+ */
+bool bmp180_sample(bmp180_t bmp, bmp180_sample_t *sample);
+
+/**
+ * @brief Measure temperature and pressure, giving up at a deadline
+ * A conversion that cannot complete before the deadline is not started. If the descriptor
+ * was initialized with a timeout (see bmp180_options_t), transaction timeouts are also
+ * shortened to fit the time remaining. If the call fails after the
+ * temperature conversion, the next call on this descriptor reuses that temperature
+ * (for up to one second) instead of repeating it.
+ * @param bmp obtained from a successful bmp180_init() call
+ * @param[out] sample measurement result
+ * @param deadline absolute time, in sys_microsecond_tick() microseconds; 0 for no deadline
+ * @return true on success; false on error, timeout or cancellation
+ */
+bool bmp180_sample_until(bmp180_t bmp, bmp180_sample_t *sample, uint64_t deadline);
+
+/**
+ * @brief Measure raw temperature and pressure, without compensation
+ * For nodes that leave compensation to a host, see snapshot.h. The sample counts in the
+ * statistics and honors the budget, but events and the adaptive controller, which need
+ * compensated values, don't see it.
+ * @param bmp obtained from a successful bmp180_init() call, for an i2c device without a filter
+ * @param[out] sample raw fields; temperature and pressure are set to 0
+ * @param deadline absolute time, in sys_microsecond_tick() microseconds; 0 for no deadline
+ * @return true on success; false on error, timeout or cancellation
+ */
+bool bmp180_sample_raw(bmp180_t bmp, bmp180_sample_t *sample, uint64_t deadline);
+
+/**
+ * @brief bmp180_measure() with a deadline, see bmp180_sample_until()
+ * @param bmp obtained from a successful bmp180_init() call
+ * @param[out] temperature Temperature in degrees Celsius
+ * @param[out] pressure Pressure in Pa
+ * @param deadline absolute time, in sys_microsecond_tick() microseconds; 0 for no deadline
+ * @return true on success; false on error, timeout or cancellation
+ */
+bool bmp180_measure_until(bmp180_t bmp, float *temperature, uint32_t *pressure, uint64_t deadline);
+
+/**
+ * @brief Cancel a measurement in progress on another thread
+ * The measurement returns false at its next transaction or within ~2 ms of a conversion
+ * wait. If no measurement is in progress, the next one is cancelled.
+ * @param bmp obtained from a successful bmp180_init() call
+ */
+void bmp180_cancel(bmp180_t bmp);
+
+/**
+ * @brief Current time, in the units used for deadlines and sample timestamps
+ * @return monotonic time in microseconds
+ */
+uint64_t bmp180_now(void);
+
+/**
+ * @brief Attach a software oversampling filter to a device descriptor
+ * Filter state is reset on every call.
+ * @param bmp obtained from a successful bmp180_init() call
+ * @param config filter configuration, or NULL to remove the filter
+ * @return true on success, false if the configuration is invalid
+ */
+bool bmp180_set_filter(bmp180_t bmp, const bmp180_filter_config_t *config);
+
+/**
+ * @brief Retrieve the calibration coefficients of a device
+ * @param bmp obtained from a successful bmp180_init() call
+ * @param[out] cal calibration coefficients
+ * @return true on success
+ */
+bool bmp180_get_calibration(bmp180_t bmp, bmp180_calibration_t *cal);
+
+/**
+ * Compensation state derived from one temperature reading, see bmp180_compensate_temperature().
+ * Fields other than `temperature` and `oss` are internal.
+ */
+typedef struct
+{
+   int32_t temperature; //!< compensated temperature, in 0.1 degrees Celsius
+   uint8_t oss;         //!< oversampling setting of the `up` values this state applies to
+   int32_t B3;
+   uint32_t B4;
+   uint32_t magic;      //!< B4 reciprocal, for division by multiplication
+   uint8_t shift1;
+   uint8_t shift2;
+} bmp180_temperature_stage_t;
+
+/**
+ * @brief First compensation stage: everything that depends only on the temperature
+ * @param cal calibration coefficients of the device
+ * @param oss oversampling setting of the `up` values the state will be used with
+ * @param ut uncompensated temperature
+ * @param[out] stage state for bmp180_compensate_pressure()
+ * @return true on success; false if the calibration and `ut` would divide by zero
+ */
+bool bmp180_compensate_temperature(const bmp180_calibration_t *cal, uint8_t oss, int32_t ut,
+                                   bmp180_temperature_stage_t *stage);
+
+/**
+ * @brief Second compensation stage: pressure from a temperature stage and UP
+ * A few multiplies and no division; bit-exact with single-stage compensation.
+ * @param stage from bmp180_compensate_temperature()
+ * @param up uncompensated pressure, scaled for `stage->oss`
+ * @param[out] pressure compensated pressure, in Pa
+ * @return true on success; false if the calibration would divide by zero (B4 is zero)
+ */
+bool bmp180_compensate_pressure(const bmp180_temperature_stage_t *stage, int32_t up, int32_t *pressure);
+
+/**
+ * @brief Compensate arrays of recorded raw values
+ * The temperature stage is computed once for each run of entries with the same `ut`.
+ * @param cal calibration coefficients of the device the values were recorded from
+ * @param oss oversampling setting the `up` values were recorded with
+ * @param ut uncompensated temperatures
+ * @param up uncompensated pressures, or NULL to compensate temperature only
+ * @param count number of entries in each array
+ * @param[out] temperature compensated temperatures, in 0.1 degrees Celsius (may be NULL)
+ * @param[out] pressure compensated pressures, in Pa (may be NULL; ignored if `up` is NULL)
+ * @return true on success; false if any entry would divide by zero
+ */
+bool bmp180_compensate_batch(const bmp180_calibration_t *cal, uint8_t oss, const int32_t *ut,
+                             const int32_t *up, size_t count, int32_t *temperature, int32_t *pressure);
+
+/**
+ * @brief Set the fault recovery policy for a device descriptor
+ * By default, a failed transaction fails the measurement immediately.
+ * @param bmp obtained from a successful bmp180_init() call
+ * @param config recovery policy, or NULL to disable recovery
+ * @return true on success
+ */
+bool bmp180_set_recovery(bmp180_t bmp, const bmp180_recovery_config_t *config);
+
+/**
+ * @brief Set the cost budget for a device descriptor
+ * A measurement started before the budget allows it waits. If the budget allows it too late
+ * to finish by its deadline (see bmp180_get_latency()), it fails at once and is counted as
+ * refused rather than as a timeout.
+ * Group samples wait for every member's budget.
+ * @param bmp obtained from a successful bmp180_init() call, for an i2c device
+ * @param budget ceilings, or NULL to remove the budget
+ * @return true on success, false if the budget is invalid
+ */
+bool bmp180_set_budget(bmp180_t bmp, const bmp180_budget_t *budget);
+
+/**
+ * @brief Retrieve statistics for a device descriptor
+ * @param bmp obtained from a successful bmp180_init() call
+ * @param[out] stats statistics since bmp180_init() or the last bmp180_reset_stats()
+ * @return true on success
+ */
+bool bmp180_get_stats(bmp180_t bmp, bmp180_stats_t *stats);
+
+/**
+ * @brief Reset the counters reported by bmp180_get_stats()
+ * @param bmp obtained from a successful bmp180_init() call
+ * @return true on success
+ */
+bool bmp180_reset_stats(bmp180_t bmp);
+
 #ifdef __cplusplus
 }
 #endif
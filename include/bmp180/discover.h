@@ -0,0 +1,50 @@
+/*! \copyright 2024 Zorxx Software. All rights reserved.
+ *  \license This file is released under the MIT License. See the LICENSE file for details.
+ *  \brief Parallel BMP180 discovery across I2C adapters (Linux only)
+ */
+#ifndef _BMP180_DISCOVER_H
+#define _BMP180_DISCOVER_H
+
+#include <stddef.h>
+#include "bmp180/bmp180.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BMP180_DISCOVER_DEVICE_MAX 64 /* longest adapter device path reported */
+
+typedef struct
+{
+   /* Adapters to scan, e.g. "/dev/i2c-1"; NULL to scan every /dev/i2c-* adapter, which
+      includes the channels of any multiplexer bound to a kernel i2c-mux driver */
+   const char **devices;
+   size_t device_count;
+   /* Addresses to probe on each adapter; NULL for BMP180_DEVICE_ADDRESS only */
+   const uint8_t *addresses;
+   size_t address_count;
+   bmp180_mode_t mode;   /* mode for the returned descriptors */
+} bmp180_discover_config_t;
+
+typedef struct
+{
+   bmp180_t bmp;         /* initialized, calibrated descriptor; release with bmp180_free() */
+   char device[BMP180_DISCOVER_DEVICE_MAX];
+   uint8_t address;
+   bool mux_channel;     /* the adapter is a channel of a kernel i2c-mux */
+} bmp180_discovered_t;
+
+/* Probe the configured adapters in parallel, one thread per adapter, and return a
+   descriptor for each device that answers with the BMP180 chip ID and valid calibration.
+   Results are ordered by adapter (in the order given, or by adapter number) and address.
+   If 'elapsed' is not NULL, it receives the discovery time in microseconds.
+   Returns the number of entries written to 'found' (at most 'max'); devices beyond 'max'
+   are released. */
+size_t bmp180_discover(const bmp180_discover_config_t *config, bmp180_discovered_t *found, size_t max,
+                       uint64_t *elapsed);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _BMP180_DISCOVER_H */
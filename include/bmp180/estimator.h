@@ -0,0 +1,102 @@
+/**
+ * @file estimator.h
+ * @defgroup bmp180_estimator bmp180_estimator
+ * @{
+ *
+ * Fixed-point altitude and vertical speed estimation for bmp180
+ *
+ * Copyright (c) 2024 Zorxx Software
+ *
+ * MIT Licensed as described in the file LICENSE
+ */
+#ifndef __BMP180_ESTIMATOR_H__
+#define __BMP180_ESTIMATOR_H__
+
+#include "bmp180/bmp180.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BMP180_SEA_LEVEL_PRESSURE 101325 //!< standard sea-level pressure (Pa)
+
+/**
+ * Estimator configuration.
+ *
+ * The estimator tracks altitude and vertical speed with a constant-velocity model, using
+ * the steady-state Kalman gains for the noise model below (an alpha-beta filter). Lower
+ * `acceleration_noise` relative to `altitude_noise` gives smoother, slower estimates.
+ */
+typedef struct
+{
+   uint32_t period;              //!< sample period (us), 1000 to 1000000
+   int32_t sea_level_pressure;   //!< reference pressure (Pa), 0 for BMP180_SEA_LEVEL_PRESSURE
+   uint32_t altitude_noise;      //!< measurement noise (mm RMS), at least 1
+   uint32_t acceleration_noise;  //!< process noise, vertical acceleration (mm/s^2 RMS), at least 1
+} bmp180_estimator_config_t;
+
+/**
+ * Estimator output for one sample.
+ */
+typedef struct
+{
+   uint64_t timestamp;  //!< timestamp of the sample
+   int32_t altitude;    //!< filtered altitude (mm)
+   int32_t speed;       //!< vertical speed (mm/s), positive upwards
+   int32_t measured;    //!< unfiltered altitude from this sample's pressure (mm)
+} bmp180_estimate_t;
+
+typedef void *bmp180_estimator_t;
+
+/**
+ * @brief Altitude from pressure, with the datasheet's barometric formula
+ * Uses fixed-point table interpolation: within 25 mm of the formula above 80 kPa (at the
+ * standard reference pressure), and 0.2 m across the sensor's range. Pressure ratios are
+ * clamped to 0.25 - 1.125 (about 10 km to -1 km).
+ * @param pressure pressure (Pa)
+ * @param sea_level_pressure reference pressure (Pa), 0 for BMP180_SEA_LEVEL_PRESSURE
+ * @return altitude (mm)
+ */
+int32_t bmp180_altitude(int32_t pressure, int32_t sea_level_pressure);
+
+/**
+ * @brief Create an estimator
+ * The gains are computed here, in integer arithmetic; updates use no floating point.
+ * @param config estimator configuration
+ * @return bmp180_estimator_t on success, NULL on failure
+ */
+bmp180_estimator_t bmp180_estimator_init(const bmp180_estimator_config_t *config);
+
+/**
+ * @brief Free an estimator
+ * @param est obtained from a successful bmp180_estimator_init() call
+ * @return true on success
+ */
+bool bmp180_estimator_free(bmp180_estimator_t est);
+
+/**
+ * @brief Update the estimate with a compensated sample
+ * The first sample (and the first after a gap of more than 16 periods) restarts the
+ * estimator at the measured altitude with zero speed. Shorter gaps, detected from sample
+ * timestamps, are predicted across; timestamps of 0 are taken as one period apart.
+ * @param est obtained from a successful bmp180_estimator_init() call
+ * @param sample sample to add, e.g. from bmp180_sample(); only timestamp and pressure are used
+ * @param[out] estimate updated estimate
+ * @return true on success, false if the sample's pressure is invalid
+ */
+bool bmp180_estimator_push(bmp180_estimator_t est, const bmp180_sample_t *sample,
+                           bmp180_estimate_t *estimate);
+
+/**
+ * @brief Restart the estimator at the next sample
+ * @param est obtained from a successful bmp180_estimator_init() call
+ */
+void bmp180_estimator_reset(bmp180_estimator_t est);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**@}*/
+
+#endif /* __BMP180_ESTIMATOR_H__ */
@@ -0,0 +1,107 @@
+/**
+ * @file group.h
+ * @defgroup bmp180_group bmp180_group
+ * @{
+ *
+ * Synchronized sampling of several bmp180 devices
+ *
+ * Copyright (c) 2024 Zorxx Software
+ *
+ * MIT Licensed as described in the file LICENSE
+ */
+#ifndef __BMP180_GROUP_H__
+#define __BMP180_GROUP_H__
+
+#include "bmp180/bmp180.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BMP180_GROUP_MAX_MEMBERS   16
+#define BMP180_GROUP_SKEW_BUCKETS  16 //!< skew histogram buckets, see bmp180_group_stats_t
+
+/**
+ * One member's part of a group sample.
+ */
+typedef struct
+{
+   bmp180_sample_t sample;   //!< as from bmp180_sample(); `timestamp` is the temperature conversion start
+   uint64_t pressure_start;  //!< sys_microsecond_tick() when the pressure conversion started
+   uint32_t offset;          //!< pressure_start less the earliest pressure_start in the group (us)
+} bmp180_group_sample_t;
+
+/**
+ * Group statistics. Skew is the time between the first and the last pressure conversion
+ * start of a group sample.
+ */
+typedef struct
+{
+   uint32_t samples;          //!< successful group samples
+   uint32_t failures;         //!< group samples that failed on any member
+   uint32_t skew_last;        //!< skew of the last successful sample (us)
+   uint32_t skew_min;         //!< (us)
+   uint32_t skew_max;         //!< (us)
+   uint32_t skew_mean;        //!< (us)
+   uint32_t temperature_skew_max; //!< largest skew between temperature conversion starts (us)
+   //! Samples by skew: bucket 0 counts skews under 1 us, bucket n skews of 2^(n-1) to 2^n - 1 us,
+   //! and the last bucket everything above
+   uint32_t skew_histogram[BMP180_GROUP_SKEW_BUCKETS];
+} bmp180_group_stats_t;
+
+typedef void *bmp180_group_t;
+
+/**
+ * @brief Create a group of devices to be sampled together
+ * The members stay owned by the caller and must outlive the group. Each member keeps its
+ * own mode, margin policy, statistics, subscribers and adaptive controller. Members can't
+ * share a bus address, so they're normally on separate buses (or behind a multiplexer).
+ * @param members device descriptors, from bmp180_init() or bmp180_init_ex()
+ * @param count number of members, 1 to BMP180_GROUP_MAX_MEMBERS
+ * @return bmp180_group_t on success, NULL on failure
+ */
+bmp180_group_t bmp180_group_init(const bmp180_t *members, size_t count);
+
+/**
+ * @brief Free a group; the members are not freed
+ * @param group obtained from a successful bmp180_group_init() call
+ * @return true on success
+ */
+bool bmp180_group_free(bmp180_group_t group);
+
+/**
+ * @brief Take one sample from every member, with conversions started together
+ * The temperature conversions of all members are started back to back, then read in turn;
+ * then all pressure conversions are started back to back, and read in turn. The skew is
+ * the bus time of one start command per member. When a member fails, its recovery policy
+ * (see bmp180_set_recovery()) is applied and the whole group sample is retried; the call
+ * fails once the failing member's policy is exhausted. Members must not be used from other
+ * threads during the call, and must not have a software filter attached.
+ * @param group obtained from a successful bmp180_group_init() call
+ * @param[out] samples one entry per member, in member order
+ * @return true on success, false if any member failed (no samples are valid)
+ */
+bool bmp180_group_sample(bmp180_group_t group, bmp180_group_sample_t *samples);
+
+/**
+ * @brief Retrieve a group's skew statistics
+ * @param group obtained from a successful bmp180_group_init() call
+ * @param[out] stats statistics since bmp180_group_init() or the last bmp180_group_reset_stats()
+ * @return true on success
+ */
+bool bmp180_group_get_stats(bmp180_group_t group, bmp180_group_stats_t *stats);
+
+/**
+ * @brief Reset the statistics reported by bmp180_group_get_stats()
+ * @param group obtained from a successful bmp180_group_init() call
+ * @return true on success
+ */
+bool bmp180_group_reset_stats(bmp180_group_t group);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**@}*/
+
+#endif /* __BMP180_GROUP_H__ */
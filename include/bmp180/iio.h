@@ -0,0 +1,52 @@
+/*! \copyright 2024 Zorxx Software. All rights reserved.
+ *  \license This file is released under the MIT License. See the LICENSE file for details.
+ *  \brief Linux IIO backend: buffered, triggered capture through the kernel driver
+ *
+ *  Where the kernel's bmp280 IIO driver is bound to the device (which also covers the
+ *  BMP180), the device can't be reached through i2c-dev. bmp180_iio_init() instead returns
+ *  a descriptor that reads compensated samples from the IIO buffer character device; it
+ *  works with bmp180_sample(), bmp180_measure(), the statistics, threshold events and the
+ *  sampler worker. The kernel compensates the readings, so samples carry no raw values
+ *  (ut and up are 0), and filters, adaptive mode control and bmp180_get_calibration()
+ *  aren't available. Timestamps come from the scan's timestamp channel when there is one.
+ */
+#ifndef _BMP180_IIO_H
+#define _BMP180_IIO_H
+
+#include <stddef.h>
+#include "bmp180/bmp180.h"
+#include "bmp180/ring.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct
+{
+   const char *device;   /* IIO device directory, e.g. "/sys/bus/iio/devices/iio:device0" */
+   const char *chardev;  /* buffer character device, NULL for "/dev/<device directory name>" */
+   const char *trigger;  /* trigger to attach, e.g. an hrtimer trigger created through configfs
+                            or "sysfstrig0"; NULL keeps the device's current trigger */
+   uint32_t frequency;   /* trigger sampling_frequency in Hz (hrtimer triggers), 0 to keep */
+   uint32_t length;      /* kernel buffer length in scans, 0 to keep */
+   uint32_t batch;       /* scans read per read() call, 0 for the default (64) */
+   bmp180_mode_t mode;   /* pressure oversampling, if the driver exposes it */
+} bmp180_iio_config_t;
+
+/* Configure the device's scan elements (temperature, pressure and timestamp only), trigger
+   and buffer, then enable the buffer. bmp180_free() disables it again. Returns NULL on
+   failure. */
+bmp180_t bmp180_iio_init(const bmp180_iio_config_t *config);
+/* Read up to 'max' samples with a single read() of the character device, waiting up to
+   'timeout' microseconds for the first. Each sample is accounted for as if returned by
+   bmp180_sample(). Returns the number of samples read. */
+size_t bmp180_iio_read(bmp180_t bmp, bmp180_sample_t *samples, size_t max, uint32_t timeout);
+/* As bmp180_iio_read(), pushing the samples into 'ring' (as its producer); returns the
+   number of samples pushed */
+size_t bmp180_iio_capture(bmp180_t bmp, bmp180_ring_t ring, uint32_t timeout);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _BMP180_IIO_H */
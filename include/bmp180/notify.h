@@ -0,0 +1,88 @@
+/**
+ * @file notify.h
+ * @defgroup bmp180_notify bmp180_notify
+ * @{
+ *
+ * Change-threshold event delivery for bmp180 samples
+ *
+ * Copyright (c) 2024 Zorxx Software
+ *
+ * MIT Licensed as described in the file LICENSE
+ */
+#ifndef __BMP180_NOTIFY_H__
+#define __BMP180_NOTIFY_H__
+
+#include "bmp180/bmp180.h"
+#include "bmp180/aggregate.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BMP180_MAX_SUBSCRIBERS 4 //!< subscribers per device descriptor
+
+/**
+ * Reasons for an event, combined as a bitmask.
+ */
+#define BMP180_EVENT_PRESSURE    0x01 //!< pressure moved past its deadband
+#define BMP180_EVENT_TEMPERATURE 0x02 //!< temperature moved past its deadband
+#define BMP180_EVENT_HEARTBEAT   0x04 //!< heartbeat interval expired
+#define BMP180_EVENT_FIRST       0x08 //!< first sample after subscribing
+
+/**
+ * Delivery thresholds.
+ * A channel triggers an event when it moves more than `deadband` away from the value
+ * reported in the previous event. Moving back in the opposite direction of the previous
+ * change requires `deadband + hysteresis`, so noise around a level does not cause
+ * alternating events. A deadband of 0 disables the channel.
+ */
+typedef struct
+{
+   int32_t pressure_deadband;       //!< Pa
+   int32_t pressure_hysteresis;     //!< Pa
+   int32_t temperature_deadband;    //!< 0.1 degrees Celsius
+   int32_t temperature_hysteresis;  //!< 0.1 degrees Celsius
+   uint32_t heartbeat;              //!< microseconds between events regardless of change, 0 to disable
+} bmp180_threshold_config_t;
+
+/**
+ * Event delivered to a subscriber.
+ */
+typedef struct
+{
+   uint32_t reason;              //!< BMP180_EVENT_* bitmask
+   bmp180_sample_t sample;       //!< sample that triggered the event
+   uint32_t suppressed;          //!< samples not delivered since the previous event
+   bmp180_summary_t summary;     //!< statistics of the samples since the previous event, including this one
+} bmp180_event_t;
+
+typedef void (*bmp180_event_cb)(const bmp180_event_t *event, void *arg);
+
+/**
+ * @brief Subscribe to threshold events on a device descriptor
+ * Events are delivered from within bmp180_sample() / bmp180_measure(), on the calling thread.
+ * Subscriptions must not be changed while another thread is sampling the same descriptor.
+ * @param bmp obtained from a successful bmp180_init() call
+ * @param config delivery thresholds
+ * @param callback called for each event
+ * @param arg passed to `callback`
+ * @return subscription handle (>= 0) on success, -1 on failure
+ */
+int bmp180_subscribe(bmp180_t bmp, const bmp180_threshold_config_t *config,
+                     bmp180_event_cb callback, void *arg);
+
+/**
+ * @brief Remove a subscription
+ * @param bmp obtained from a successful bmp180_init() call
+ * @param handle obtained from bmp180_subscribe()
+ * @return true on success
+ */
+bool bmp180_unsubscribe(bmp180_t bmp, int handle);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**@}*/
+
+#endif /* __BMP180_NOTIFY_H__ */
@@ -0,0 +1,76 @@
+/**
+ * @file ring.h
+ * @defgroup bmp180_ring bmp180_ring
+ * @{
+ *
+ * Lock-free single-producer/single-consumer ring buffer of bmp180 samples
+ *
+ * Copyright (c) 2024 Zorxx Software
+ *
+ * MIT Licensed as described in the file LICENSE
+ */
+#ifndef __BMP180_RING_H__
+#define __BMP180_RING_H__
+
+#include <stddef.h>
+#include "bmp180/bmp180.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef void *bmp180_ring_t;
+
+/**
+ * @brief Create a ring buffer
+ * One thread may push while another pops, without locking.
+ * @param capacity number of samples, rounded up to a power of two
+ * @return bmp180_ring_t on success, NULL on failure
+ */
+bmp180_ring_t bmp180_ring_init(uint32_t capacity);
+
+/**
+ * @brief Free a ring buffer
+ * @param ring obtained from a successful bmp180_ring_init() call
+ * @return true on success
+ */
+bool bmp180_ring_free(bmp180_ring_t ring);
+
+/**
+ * @brief Append a sample (producer side)
+ * @param ring obtained from a successful bmp180_ring_init() call
+ * @param sample sample to append
+ * @return true on success, false if the ring is full (the sample is counted as dropped)
+ */
+bool bmp180_ring_push(bmp180_ring_t ring, const bmp180_sample_t *sample);
+
+/**
+ * @brief Remove up to `max` of the oldest samples (consumer side)
+ * @param ring obtained from a successful bmp180_ring_init() call
+ * @param[out] samples destination for `max` samples
+ * @param max maximum number of samples to remove
+ * @return number of samples removed
+ */
+size_t bmp180_ring_pop(bmp180_ring_t ring, bmp180_sample_t *samples, size_t max);
+
+/**
+ * @brief Number of samples waiting to be popped
+ * @param ring obtained from a successful bmp180_ring_init() call
+ * @return sample count
+ */
+size_t bmp180_ring_count(bmp180_ring_t ring);
+
+/**
+ * @brief Number of samples dropped because the ring was full
+ * @param ring obtained from a successful bmp180_ring_init() call
+ * @return dropped sample count
+ */
+uint64_t bmp180_ring_dropped(bmp180_ring_t ring);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**@}*/
+
+#endif /* __BMP180_RING_H__ */
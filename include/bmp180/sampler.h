@@ -0,0 +1,70 @@
+/*! \copyright 2024 Zorxx Software. All rights reserved.
+ *  \license This file is released under the MIT License. See the LICENSE file for details.
+ *  \brief Real-time sampling worker (Linux only)
+ *
+ *  The worker samples a device descriptor at a fixed period on absolute CLOCK_MONOTONIC
+ *  deadlines (so timing errors don't accumulate), optionally pinned to a CPU with
+ *  SCHED_FIFO priority and locked memory, and queues the samples in a ring buffer.
+ */
+#ifndef _BMP180_SAMPLER_H
+#define _BMP180_SAMPLER_H
+
+#include <stddef.h>
+#include "bmp180/bmp180.h"
+#include "bmp180/ring.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct
+{
+   uint32_t period;      /* microseconds between conversion starts */
+   int cpu;              /* CPU to pin the worker to (below CPU_SETSIZE), -1 for no affinity */
+   int priority;         /* SCHED_FIFO priority (1-99), 0 for the default scheduler */
+   bool lock_memory;     /* lock the whole process' current and future memory (mlockall) until
+                            every sampler started with this option has stopped */
+   uint32_t capacity;    /* ring buffer capacity, in samples */
+} bmp180_sampler_config_t;
+
+/* Distribution summary, microseconds */
+typedef struct
+{
+   uint32_t p50;
+   uint32_t p90;
+   uint32_t p99;
+   uint32_t p999;
+   uint32_t max;
+} bmp180_percentiles_t;
+
+typedef struct
+{
+   uint64_t samples;                 /* samples queued */
+   uint64_t errors;                  /* failed measurements */
+   uint64_t missed;                  /* periods skipped because the worker fell behind */
+   uint64_t dropped;                 /* samples lost to a full ring buffer */
+   uint64_t refused;                 /* periods skipped by the device's budget, see bmp180_set_budget() */
+   bmp180_percentiles_t jitter;      /* |interval between conversion starts - period| */
+   bmp180_percentiles_t start_delay; /* conversion start - scheduled start */
+} bmp180_sampler_stats_t;
+
+typedef void *bmp180_sampler_t;
+
+/* Start sampling 'bmp' on a new thread; the descriptor must not be used elsewhere until
+   the worker is stopped. Returns NULL on failure, including failure to apply the
+   requested affinity, priority or memory locking (which may need privileges). */
+bmp180_sampler_t bmp180_sampler_start(bmp180_t bmp, const bmp180_sampler_config_t *config);
+/* Stop the worker and free it; samples still queued are discarded */
+bool bmp180_sampler_stop(bmp180_sampler_t sampler);
+/* Remove up to 'max' queued samples, waiting up to 'timeout' microseconds for the first
+   one. Returns the number of samples removed. */
+size_t bmp180_sampler_read(bmp180_sampler_t sampler, bmp180_sample_t *samples, size_t max,
+                           uint32_t timeout);
+/* Timing statistics since the worker started */
+bool bmp180_sampler_get_stats(bmp180_sampler_t sampler, bmp180_sampler_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _BMP180_SAMPLER_H */
@@ -0,0 +1,59 @@
+/*! \copyright 2024 Zorxx Software. All rights reserved.
+ *  \license This file is released under the MIT License. See the LICENSE file for details.
+ *  \brief Simulated BMP180 bus for tests and benchmarks (Linux only)
+ *
+ *  Any i2c_lowlevel_config whose device starts with BMP180_SIM_PREFIX (e.g. "sim:0")
+ *  selects a simulated bus instead of an i2c-dev device file. Each simulated bus has
+ *  one BMP180 at BMP180_DEVICE_ADDRESS with the datasheet calibration values.
+ *
+ *  The simulator is only in libraries built with SYS_SIM_ENABLE (the bmp180_sim CMake
+ *  target); the installed bmp180 library talks to real devices only.
+ */
+#ifndef _BMP180_SIM_H
+#define _BMP180_SIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BMP180_SIM_PREFIX "sim:"
+#define BMP180_SIM_BUSES  8  /* "sim:0" through "sim:7" */
+
+/* Faults injected into a simulated bus */
+typedef struct
+{
+   uint32_t fail_next;   /* fail this many upcoming transactions */
+   uint32_t fail_every;  /* fail every Nth transaction, 0 to disable */
+   bool hang;            /* data register reads fail until the device is soft-reset */
+   bool wedge;           /* every transaction fails until the bus handle is reopened */
+   uint32_t stall;       /* microseconds added to every transaction */
+} bmp180_sim_faults_t;
+
+/* Counters kept by a simulated bus */
+typedef struct
+{
+   uint32_t transactions;
+   uint32_t failures;
+   uint32_t resets;      /* soft resets written to the device */
+   uint32_t opens;       /* handles opened on the bus */
+   uint32_t conversions;
+   uint64_t first_start; /* when the first counted transaction started, as sample timestamps */
+   uint64_t last_end;    /* when the last counted transaction ended */
+} bmp180_sim_counters_t;
+
+/* Set the faults for a simulated bus (e.g. "sim:0"); NULL clears them */
+bool bmp180_sim_set_faults(const char *device, const bmp180_sim_faults_t *faults);
+/* Set the uncompensated values reported by the device; 'up' is for oss 0, and 'noise'
+   is the peak amplitude of pseudo-random noise added to each pressure conversion */
+bool bmp180_sim_set_values(const char *device, int32_t ut, int32_t up, uint32_t noise);
+/* Read and optionally reset the bus counters */
+bool bmp180_sim_get_counters(const char *device, bmp180_sim_counters_t *counters, bool reset);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _BMP180_SIM_H */
@@ -0,0 +1,138 @@
+/**
+ * @file snapshot.h
+ * @defgroup bmp180_snapshot bmp180_snapshot
+ * @{
+ *
+ * Raw-register snapshots of bmp180 samples, for compensation off the device
+ *
+ * A node takes raw samples with bmp180_sample_raw(), packs them into fixed-size records
+ * and ships them with its calibration, exported once per session. A host registers each
+ * device's calibration with a decoder, which compensates record streams in bulk.
+ *
+ * Copyright (c) 2024 Zorxx Software
+ *
+ * MIT Licensed as described in the file LICENSE
+ */
+#ifndef __BMP180_SNAPSHOT_H__
+#define __BMP180_SNAPSHOT_H__
+
+#include "bmp180/bmp180.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Record layout, little-endian: timestamp (48 bits, microseconds), oss (8 bits), UT (16 bits),
+ * UP (24 bits), calibration ID (32 bits).
+ */
+#define BMP180_SNAPSHOT_RECORD_SIZE      16
+/** Exported calibration: the device's EEPROM image, AC1 to MD, big-endian. */
+#define BMP180_SNAPSHOT_CALIBRATION_SIZE 22
+
+/**
+ * One decoded record.
+ */
+typedef struct
+{
+   bmp180_sample_t sample;   //!< raw and compensated values, as from bmp180_sample()
+   uint32_t calibration_id;  //!< identifies the device the record came from
+   bool valid;               //!< false if the calibration is unknown or the values can't be compensated
+} bmp180_decoded_t;
+
+/**
+ * Decoder statistics.
+ */
+typedef struct
+{
+   uint64_t records;              //!< records decoded
+   uint64_t unknown_calibration;  //!< records whose calibration ID isn't registered
+   uint64_t invalid;              //!< records with an out-of-range oss, or that don't compensate
+   uint32_t calibrations;         //!< registered calibrations
+} bmp180_decoder_stats_t;
+
+typedef void *bmp180_decoder_t;
+
+/**
+ * @brief Export calibration coefficients, e.g. once per session
+ * @param cal calibration coefficients, from bmp180_get_calibration()
+ * @param[out] buf BMP180_SNAPSHOT_CALIBRATION_SIZE bytes
+ * @return the calibration ID that records from this device carry
+ */
+uint32_t bmp180_snapshot_export_calibration(const bmp180_calibration_t *cal, uint8_t *buf);
+
+/**
+ * @brief Import calibration coefficients exported by bmp180_snapshot_export_calibration()
+ * @param buf BMP180_SNAPSHOT_CALIBRATION_SIZE bytes
+ * @param[out] cal calibration coefficients
+ * @return the calibration ID
+ */
+uint32_t bmp180_snapshot_import_calibration(const uint8_t *buf, bmp180_calibration_t *cal);
+
+/**
+ * @brief Pack a raw sample into a record
+ * Only the raw fields of the sample are used; the timestamp keeps its low 48 bits.
+ * @param sample from bmp180_sample_raw() or bmp180_sample()
+ * @param calibration_id from bmp180_snapshot_export_calibration()
+ * @param[out] record BMP180_SNAPSHOT_RECORD_SIZE bytes
+ */
+void bmp180_snapshot_pack(const bmp180_sample_t *sample, uint32_t calibration_id, uint8_t *record);
+
+/**
+ * @brief Unpack a record without compensating it
+ * @param record BMP180_SNAPSHOT_RECORD_SIZE bytes
+ * @param[out] sample raw fields; temperature and pressure are set to 0
+ * @return the record's calibration ID
+ */
+uint32_t bmp180_snapshot_unpack(const uint8_t *record, bmp180_sample_t *sample);
+
+/**
+ * @brief Create a decoder
+ * @return bmp180_decoder_t on success, NULL on failure
+ */
+bmp180_decoder_t bmp180_decoder_init(void);
+
+/**
+ * @brief Free a decoder
+ * @param dec obtained from a successful bmp180_decoder_init() call
+ * @return true on success
+ */
+bool bmp180_decoder_free(bmp180_decoder_t dec);
+
+/**
+ * @brief Register a device's exported calibration; registering it again has no effect
+ * @param dec obtained from a successful bmp180_decoder_init() call
+ * @param buf BMP180_SNAPSHOT_CALIBRATION_SIZE bytes, from bmp180_snapshot_export_calibration()
+ * @return true on success, false on allocation failure or if a different calibration has
+ *         the same ID
+ */
+bool bmp180_decoder_add_calibration(bmp180_decoder_t dec, const uint8_t *buf);
+
+/**
+ * @brief Decode and compensate packed records
+ * Consecutive records from the same device with the same oss go through
+ * bmp180_compensate_batch() together, which shares the temperature stage across repeated UT.
+ * @param dec obtained from a successful bmp180_decoder_init() call
+ * @param records `count` records of BMP180_SNAPSHOT_RECORD_SIZE bytes
+ * @param count number of records
+ * @param[out] decoded one entry per record
+ * @return number of valid entries
+ */
+size_t bmp180_decoder_decode(bmp180_decoder_t dec, const uint8_t *records, size_t count,
+                             bmp180_decoded_t *decoded);
+
+/**
+ * @brief Retrieve decoder statistics
+ * @param dec obtained from a successful bmp180_decoder_init() call
+ * @param[out] stats statistics since bmp180_decoder_init()
+ * @return true on success
+ */
+bool bmp180_decoder_get_stats(bmp180_decoder_t dec, bmp180_decoder_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**@}*/
+
+#endif /* __BMP180_SNAPSHOT_H__ */
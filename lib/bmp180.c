@@ -12,118 +12,392 @@
  * MIT Licensed as described in the file LICENSE
  */
 #include <malloc.h>
+#include <string.h> /* memset */
+#include <inttypes.h>
 #include "bmp180/bmp180.h"
 #include "bmp180_private.h"
 #include "helpers.h"
+#include "trace.h"
 
-#define I2C_TRANSFER_TIMEOUT  50 /* (milliseconds) give up on i2c transaction after this timeout */
-#define I2C_SPEED             400000 /* hz */
-#define BMP180_DELAY_BUFFER   500 /* microseconds */
+STRACE_DEFINITIONS
 
-typedef struct
+const t_bmp180_mode_info bmp180_mode_info[BMP180_MODE_COUNT] =
 {
-   i2c_lowlevel_config i2c_config;
-   i2c_lowlevel_context i2c_ctx;
-   uint32_t measurement_delay;
-   bmp180_mode_t mode;
-   t_bmp180_calibration_data cal;
-} bmp180_context_t;
+   /* conversion time, noise, current */
+   { 4500,  6, 3 },  /* BMP180_MODE_ULTRA_LOW_POWER */
+   { 7500,  5, 5 },  /* BMP180_MODE_STANDARD */
+   { 13500, 4, 7 },  /* BMP180_MODE_HIGH_RESOLUTION */
+   { 25500, 3, 12 }, /* BMP180_MODE_ULTRA_HIGH_RESOLUTION */
+};
 
-static bool bmp180_get_uncompensated_temperature(bmp180_context_t *ctx, int32_t *ut)
+#define BMP180_WAIT_SLICE     2000 /* microseconds between cancellation checks while waiting */
+
+bool bmp180_check_deadline(bmp180_context_t *ctx, uint32_t wait)
 {
-   uint8_t d[2] = { BMP180_MEASURE_TEMP };
-   if(!i2c_ll_write_reg(ctx->i2c_ctx, BMP180_CONTROL_REG, d, sizeof(uint8_t)))
+   uint32_t timeout = ctx->i2c_timeout;
+
+   if(atomic_exchange(&ctx->cancel, false))
+   {
+      SDBG("[%s] Cancelled", __func__);
+      ++ctx->stats.cancellations;
+      ctx->aborted = true;
       return false;
+   }
+   if(0 != ctx->deadline)
+   {
+      uint64_t now = sys_microsecond_tick();
+      uint64_t remaining;
+      if(now + wait >= ctx->deadline)
+      {
+         SDBG("[%s] Deadline passed", __func__);
+         ++ctx->stats.timeouts;
+         ctx->aborted = true;
+         return false;
+      }
+      remaining = (ctx->deadline - now + 999) / 1000;
+      if(remaining < timeout)
+         timeout = (uint32_t) remaining;
+   }
+   if(ctx->timeout_control && timeout != ctx->applied_timeout)
+   {
+      i2c_ll_set_timeout(ctx->i2c_ctx, timeout);
+      ctx->applied_timeout = timeout;
+   }
+   return true;
+}
 
-   sys_delay_us(4500 + BMP180_DELAY_BUFFER);
-   if(!i2c_ll_read_reg(ctx->i2c_ctx, BMP180_OUT_MSB_REG, d, sizeof(d)))
+void bmp180_cancel_reset(bmp180_context_t *ctx)
+{
+   atomic_store(&ctx->cancel, false);
+}
+
+bool bmp180_wait(bmp180_context_t *ctx, uint32_t us)
+{
+   uint64_t now = sys_microsecond_tick();
+   uint64_t end = now + us;
+
+   if(0 != ctx->deadline && end > ctx->deadline)
+   {
+      SDBG("[%s] Wait of %" PRIu32 " us would pass the deadline", __func__, us);
+      ++ctx->stats.timeouts;
+      ctx->aborted = true;
       return false;
-   uint32_t r = ((uint32_t)d[0] << 8) | d[1];
-   *ut = r;
-   SDBG("Temperature: %" PRIi32, *ut);
+   }
+   while(now < end)
+   {
+      uint64_t remaining = end - now;
+      sys_delay_us((remaining > BMP180_WAIT_SLICE) ? BMP180_WAIT_SLICE : (uint32_t) remaining);
+      if(atomic_exchange(&ctx->cancel, false))
+      {
+         ++ctx->stats.cancellations;
+         ctx->aborted = true;
+         return false;
+      }
+      now = sys_microsecond_tick();
+   }
    return true;
 }
 
-static bool bmp180_get_uncompensated_pressure(bmp180_context_t *ctx, uint32_t *up)
+/* Time to wait for a conversion of 'time' microseconds under the margin policy; when
+   polling, the time before the first poll */
+static uint32_t bmp180_conversion_delay(const bmp180_context_t *ctx, uint32_t time)
 {
-   uint8_t oss = ctx->mode;
-   uint8_t d[3] = { BMP180_MEASURE_PRESS | (oss << 6), 0 };
-   if(!i2c_ll_write_reg(ctx->i2c_ctx, BMP180_CONTROL_REG, d, sizeof(uint8_t)))
+   switch(ctx->margin_policy)
+   {
+      case BMP180_MARGIN_PROPORTIONAL:
+         return time + (uint32_t)((uint64_t) time * ctx->margin / 1000);
+      case BMP180_MARGIN_POLL:
+         return (ctx->margin < time) ? time - ctx->margin : 0;
+      default:
+         return time + ctx->margin;
+   }
+}
+
+/* Longest a conversion of 'time' microseconds can take under the margin policy */
+static uint32_t bmp180_conversion_limit(const bmp180_context_t *ctx, uint32_t time)
+{
+   if(ctx->margin_policy == BMP180_MARGIN_POLL)
+      return time + BMP180_DEFAULT_MARGIN;
+   return bmp180_conversion_delay(ctx, time);
+}
+
+/* Wait for a conversion of 'time' microseconds started at 'started' */
+static bool bmp180_conversion_wait(bmp180_context_t *ctx, uint32_t time, uint64_t started)
+{
+   uint64_t now = sys_microsecond_tick(), ready, limit;
+   uint8_t ctrl;
+
+   ready = started + bmp180_conversion_delay(ctx, time);
+   if(ready > now && !bmp180_wait(ctx, (uint32_t)(ready - now)))
+      return false;
+   if(ctx->margin_policy != BMP180_MARGIN_POLL)
+      return true;
+
+   /* Past the limit the result is read regardless, as the other policies would */
+   limit = started + bmp180_conversion_limit(ctx, time);
+   for(;;)
+   {
+      if(!bmp180_check_deadline(ctx, 0))
+         return false;
+      bmp180_account_bus(ctx, BMP180_POLL_BYTES);
+      if(!i2c_ll_read_reg(ctx->i2c_ctx, BMP180_CONTROL_REG, &ctrl, sizeof(ctrl)))
+         return false;
+      if(!(ctrl & BMP180_CONTROL_SCO) || sys_microsecond_tick() >= limit)
+         return true;
+      if(!bmp180_wait(ctx, BMP180_POLL_INTERVAL))
+         return false;
+   }
+}
+
+static uint32_t bmp180_conversion_time(const bmp180_context_t *ctx, int kind)
+{
+   return (kind == BMP180_CONVERSION_PRESSURE) ? ctx->measurement_delay : BMP180_TEMPERATURE_CONVERSION_TIME;
+}
+
+bool bmp180_conversion_start(bmp180_context_t *ctx, int kind, uint64_t *started)
+{
+   uint8_t oss = (kind == BMP180_CONVERSION_PRESSURE) ? ctx->mode : 0;
+   uint8_t d = (kind == BMP180_CONVERSION_PRESSURE) ? BMP180_MEASURE_PRESS | (oss << 6) : BMP180_MEASURE_TEMP;
+
+   if(!bmp180_check_deadline(ctx, bmp180_conversion_limit(ctx, bmp180_conversion_time(ctx, kind))))
+      return false;
+   bmp180_account_bus(ctx, BMP180_START_BYTES);
+   if(!i2c_ll_write_reg(ctx->i2c_ctx, BMP180_CONTROL_REG, &d, sizeof(d)))
       return false;
-   
-   sys_delay_us(ctx->measurement_delay + BMP180_DELAY_BUFFER);
-   if(!i2c_ll_read_reg(ctx->i2c_ctx, BMP180_OUT_MSB_REG, d, sizeof(d)))
+   /* The conversion starts when the write completes */
+   *started = sys_microsecond_tick();
+   bmp180_account_conversion(ctx, bmp180_conversion_time(ctx, kind));
+   STRACE(conversion_start, ctx, kind, oss, *started);
+   return true;
+}
+
+bool bmp180_conversion_read(bmp180_context_t *ctx, int kind, uint64_t started, uint32_t *raw)
+{
+   uint8_t oss = (kind == BMP180_CONVERSION_PRESSURE) ? ctx->mode : 0;
+   uint8_t d[3] = { 0 };
+   uint32_t r;
+   bool result;
+
+   if(!bmp180_conversion_wait(ctx, bmp180_conversion_time(ctx, kind), started)
+   || !bmp180_check_deadline(ctx, 0))
       return false;
+   STRACE(conversion_ready, ctx, kind, oss, sys_microsecond_tick());
+   bmp180_account_bus(ctx, BMP180_READ_BYTES((kind == BMP180_CONVERSION_PRESSURE) ? 3 : 2));
+   if(kind == BMP180_CONVERSION_PRESSURE)
+   {
+      result = i2c_ll_read_reg(ctx->i2c_ctx, BMP180_OUT_MSB_REG, d, 3);
+      r = (((uint32_t)d[0] << 16) | ((uint32_t)d[1] << 8) | d[2]) >> (8 - oss);
+   }
+   else
+   {
+      result = i2c_ll_read_reg(ctx->i2c_ctx, BMP180_OUT_MSB_REG, d, 2);
+      r = ((uint32_t)d[0] << 8) | d[1];
+   }
+   STRACE(conversion_readout, ctx, kind, r, result, sys_microsecond_tick());
+   if(!result)
+      return false;
+   *raw = r;
+   SDBG("%s: %" PRIu32, (kind == BMP180_CONVERSION_PRESSURE) ? "Pressure" : "Temperature", r);
+   return true;
+}
 
-   uint32_t r = ((uint32_t)d[0] << 16) | ((uint32_t)d[1] << 8) | d[2];
-   r >>= 8 - oss; 
-   *up = r;
-   SDBG("Pressure: %" PRIu32, *up);
+static bool bmp180_get_uncompensated_temperature(bmp180_context_t *ctx, int32_t *ut)
+{
+   uint64_t started;
+   uint32_t r;
+
+   if(!bmp180_conversion_start(ctx, BMP180_CONVERSION_TEMPERATURE, &started)
+   || !bmp180_conversion_read(ctx, BMP180_CONVERSION_TEMPERATURE, started, &r))
+      return false;
+   *ut = (int32_t) r;
    return true;
 }
 
+static bool bmp180_get_uncompensated_pressure(bmp180_context_t *ctx, uint32_t *up)
+{
+   uint64_t started;
+
+   return bmp180_conversion_start(ctx, BMP180_CONVERSION_PRESSURE, &started)
+       && bmp180_conversion_read(ctx, BMP180_CONVERSION_PRESSURE, started, up);
+}
+
 static bool bmp180_read_calibration(bmp180_context_t *ctx)
 {
-   for(int i = 0; i < ARRAY_SIZE(ctx->cal.raw); ++i)
+   /* All 22 bytes in one transaction; the register address auto-increments */
+   uint8_t d[sizeof(ctx->cal.raw)];
+   bmp180_account_bus(ctx, BMP180_READ_BYTES(sizeof(d)));
+   if(!i2c_ll_read_reg(ctx->i2c_ctx, BMP180_CALIBRATION_REG, d, sizeof(d)))
+      return false;
+
+   for(size_t i = 0; i < ARRAY_SIZE(ctx->cal.raw); ++i)
    {
-      uint8_t d[] = { 0, 0 };
-      uint8_t reg = BMP180_CALIBRATION_REG + (i * 2);
-      if(!i2c_ll_read_reg(ctx->i2c_ctx, reg, d, sizeof(d)))
-         return false;
-      ctx->cal.raw[i] = ((uint16_t) d[0]) << 8 | (d[1]);
+      ctx->cal.raw[i] = ((uint16_t) d[i * 2]) << 8 | (d[i * 2 + 1]);
       if(ctx->cal.raw[i] == 0)
       {
-         SDBG("Invalid read %u", i);
+         SDBG("Invalid read %zu", i);
          return false; 
       }
-      SDBG("Calibration value %u = %d", i, ctx->cal.raw[i]);
+      SDBG("Calibration value %zu = %d", i, ctx->cal.raw[i]);
+   }
+   return true;
+}
+
+static void bmp180_account(bmp180_context_t *ctx, const bmp180_sample_t *sample)
+{
+   bmp180_stats_t *st = &ctx->stats;
+   if(0 != ctx->last_sample_time)
+      st->mode_time[ctx->mode] += sample->timestamp - ctx->last_sample_time;
+   ctx->last_sample_time = sample->timestamp;
+   ++st->samples[ctx->mode];
+}
+
+void bmp180_sample_done(bmp180_context_t *ctx, const bmp180_sample_t *sample)
+{
+   STRACE(sample, ctx, sample->ut, sample->up, sample->temperature, sample->pressure, sample->timestamp);
+   bmp180_account(ctx, sample);
+   bmp180_notify(ctx, sample);
+   bmp180_adapt(ctx, sample);
+}
+
+bool bmp180_set_mode(bmp180_context_t *ctx, bmp180_mode_t mode)
+{
+   if(mode < BMP180_MODE_ULTRA_LOW_POWER || mode > BMP180_MODE_ULTRA_HIGH_RESOLUTION)
+   {
+      SERR("Invalid mode %d", mode);
+      return false;
    }
+   if(ctx->mode != mode && ctx->filter.config.type != BMP180_FILTER_NONE)
+   {
+      /* Filter state holds UP values scaled for the previous oss */
+      bmp180_filter_config_t config = ctx->filter.config;
+      bmp180_filter_init(&ctx->filter, &config);
+   }
+   ctx->mode = mode;
+   ctx->measurement_delay = bmp180_mode_info[mode].conversion_time;
    return true;
 }
 
+bmp180_context_t *bmp180_context_alloc(bmp180_mode_t mode)
+{
+   bmp180_context_t *ctx;
+
+   ctx = (bmp180_context_t *) malloc(sizeof(*ctx));
+   if(NULL == ctx)
+      return NULL;
+   memset(ctx, 0, sizeof(*ctx));
+   ctx->i2c_timeout = ctx->applied_timeout = BMP180_DEFAULT_TIMEOUT;
+   ctx->bus_speed = BMP180_DEFAULT_SPEED;
+   ctx->margin_policy = BMP180_MARGIN_FIXED;
+   ctx->margin = BMP180_DEFAULT_MARGIN;
+   atomic_init(&ctx->cancel, false);
+   if(!bmp180_set_mode(ctx, mode))
+   {
+      free(ctx);
+      return NULL;
+   }
+   return ctx;
+}
+
 /* --------------------------------------------------------------------------------------------------------
  * Exported Functions
  */
 
 bmp180_t bmp180_init(i2c_lowlevel_config *config, uint8_t i2c_address, bmp180_mode_t mode)
+{
+   bmp180_options_t options = { 0 };
+   options.version = BMP180_OPTIONS_VERSION;
+   options.mode = mode;
+   return bmp180_init_ex(config, i2c_address, &options);
+}
+
+static bool bmp180_calibration_valid(const bmp180_calibration_t *cal)
+{
+   const t_bmp180_calibration_data *c = (const t_bmp180_calibration_data *) cal;
+   for(size_t i = 0; i < ARRAY_SIZE(c->raw); ++i)
+   {
+      if(c->raw[i] == 0)
+         return false;
+   }
+   return true;
+}
+
+static bool bmp180_load_calibration(bmp180_context_t *ctx, const bmp180_options_t *options)
+{
+   bmp180_calibration_t *cal = options->calibration;
+
+   switch(options->calibration_source)
+   {
+      case BMP180_CALIBRATION_SUPPLIED:
+         if(!bmp180_calibration_valid(cal))
+            return false;
+         memcpy(ctx->cal.raw, cal, sizeof(ctx->cal.raw));
+         return true;
+      case BMP180_CALIBRATION_CACHE:
+         if(bmp180_calibration_valid(cal))
+         {
+            SDBG("[%s] Using cached calibration", __func__);
+            memcpy(ctx->cal.raw, cal, sizeof(ctx->cal.raw));
+            return true;
+         }
+         if(!bmp180_read_calibration(ctx))
+            return false;
+         memcpy(cal, ctx->cal.raw, sizeof(ctx->cal.raw));
+         return true;
+      default:
+         return bmp180_read_calibration(ctx);
+   }
+}
+
+bmp180_t bmp180_init_ex(i2c_lowlevel_config *config, uint8_t i2c_address, const bmp180_options_t *options)
 {
    bmp180_context_t *ctx;
    uint8_t id = 0;
    bool success = false;
 
-   ctx = (bmp180_context_t *) malloc(sizeof(*ctx));
+   if(NULL == options || options->version != BMP180_OPTIONS_VERSION
+   || options->margin_policy < BMP180_MARGIN_FIXED || options->margin_policy > BMP180_MARGIN_POLL
+   || options->calibration_source < BMP180_CALIBRATION_EEPROM
+   || options->calibration_source > BMP180_CALIBRATION_SUPPLIED
+   || (options->calibration_source != BMP180_CALIBRATION_EEPROM && NULL == options->calibration))
+   {
+      SERR("[%s] Invalid options", __func__);
+      return NULL;
+   }
+
+   ctx = bmp180_context_alloc(options->mode);
    if(NULL == ctx)
       return NULL;
+   if(options->speed != 0)
+      ctx->bus_speed = options->speed;
+   if(options->timeout != 0)
+   {
+      ctx->i2c_timeout = ctx->applied_timeout = options->timeout;
+      ctx->timeout_control = true;
+   }
+   ctx->margin_policy = options->margin_policy;
+   if(options->margin != 0 || options->margin_policy != BMP180_MARGIN_FIXED)
+      ctx->margin = options->margin;
 
    ctx->i2c_ctx = i2c_ll_init((i2c_address == 0) ? BMP180_DEVICE_ADDRESS : i2c_address,
-      I2C_SPEED, I2C_TRANSFER_TIMEOUT, config);
+      ctx->bus_speed, ctx->i2c_timeout, config);
    if(NULL == ctx->i2c_ctx)
    {
       SERR("[%s] i2c initialization failed", __func__);
       free(ctx);
       return NULL; 
    }
-   ctx->mode = mode;
-   switch(mode)
-   {
-      case BMP180_MODE_ULTRA_LOW_POWER:       ctx->measurement_delay = 4500; break;
-      case BMP180_MODE_STANDARD:              ctx->measurement_delay = 7500; break;
-      case BMP180_MODE_HIGH_RESOLUTION:       ctx->measurement_delay = 13500; break;
-      case BMP180_MODE_ULTRA_HIGH_RESOLUTION: ctx->measurement_delay = 25500; break;
-      default:
-         SERR("Invalid mode %d", mode);
-         free(ctx);
-         return NULL; 
-   }
+   if(ctx->timeout_control)
+      i2c_ll_set_timeout(ctx->i2c_ctx, ctx->i2c_timeout);
 
+   bmp180_account_bus(ctx, BMP180_READ_BYTES(sizeof(id)));
    if(!i2c_ll_read_reg(ctx->i2c_ctx, BMP180_VERSION_REG, &id, sizeof(id))
    || id != BMP180_CHIP_ID)
    {
       SERR("Invalid device ID (0x%02x, expected 0x%02x)", id, BMP180_CHIP_ID);
    }
-   else if(!bmp180_read_calibration(ctx))
+   else if(!bmp180_load_calibration(ctx, options))
    {
-      SERR("Failed to read calibration");
+      SERR("Failed to load calibration");
    }
    else
    {
@@ -133,49 +407,342 @@ bmp180_t bmp180_init(i2c_lowlevel_config *config, uint8_t i2c_address, bmp180_mo
 
    if(!success)
    {
+      i2c_ll_deinit(ctx->i2c_ctx);
       free(ctx);
       ctx = NULL;
    }
    return ctx;  
 }
 
+uint32_t bmp180_latency(const bmp180_context_t *ctx, bmp180_mode_t mode)
+{
+   uint32_t conversions, bytes, polls;
+   uint32_t pressure = bmp180_mode_info[mode].conversion_time;
+   uint32_t wait;
+
+   /* One temperature conversion, and one pressure conversion per filter input */
+   conversions = (ctx->filter.config.type == BMP180_FILTER_NONE) ? 1 : ctx->filter.config.decimation;
+   wait = bmp180_conversion_limit(ctx, BMP180_TEMPERATURE_CONVERSION_TIME)
+        + conversions * bmp180_conversion_limit(ctx, pressure);
+
+   bytes = BMP180_START_BYTES + BMP180_READ_BYTES(2)
+         + conversions * (BMP180_START_BYTES + BMP180_READ_BYTES(3));
+   if(ctx->margin_policy == BMP180_MARGIN_POLL)
+   {
+      /* Polls from the first poll to the limit, for each conversion */
+      polls = 1 + (bmp180_conversion_limit(ctx, BMP180_TEMPERATURE_CONVERSION_TIME)
+                   - bmp180_conversion_delay(ctx, BMP180_TEMPERATURE_CONVERSION_TIME)) / BMP180_POLL_INTERVAL;
+      polls += conversions * (1 + (bmp180_conversion_limit(ctx, pressure)
+                                   - bmp180_conversion_delay(ctx, pressure)) / BMP180_POLL_INTERVAL);
+      bytes += polls * BMP180_POLL_BYTES;
+   }
+   return wait + (uint32_t)(((uint64_t) bytes * BMP180_BYTE_CLOCKS * 1000000
+                             + ctx->bus_speed - 1) / ctx->bus_speed);
+}
+
+bool bmp180_get_latency(bmp180_t bmp, uint32_t latency[BMP180_MODE_COUNT])
+{
+   bmp180_context_t *ctx = (bmp180_context_t *) bmp;
+
+   if(NULL == ctx || NULL == latency || NULL != ctx->backend)
+      return false;
+   for(int mode = 0; mode < BMP180_MODE_COUNT; ++mode)
+      latency[mode] = bmp180_latency(ctx, (bmp180_mode_t) mode);
+   return true;
+}
+
 bool bmp180_free(bmp180_t bmp)
 {
    bmp180_context_t *ctx = (bmp180_context_t *) bmp;
    if(NULL == ctx)
       return false;
+   if(NULL != ctx->backend)
+      ctx->backend->release(ctx);
+   else
+      i2c_ll_deinit(ctx->i2c_ctx);
    free(ctx);
    return true;
 }
 
-bool bmp180_measure(bmp180_t bmp, float *temperature, uint32_t *pressure)
+static bool bmp180_sample_once(bmp180_context_t *ctx, void *arg)
 {
-   bmp180_context_t *ctx = (bmp180_context_t *) bmp;
+   bmp180_sample_t *sample = (bmp180_sample_t *) arg;
+   const bmp180_filter_config_t *fc;
    int32_t UT = 0;
    uint32_t UP = 0;
    int32_t T, P;
+   int32_t y;
+   uint8_t oss;
 
-   if(NULL == ctx)
+   fc = &ctx->filter.config;
+   oss = ctx->mode;
+
+   /* Temperature is always needed; required for pressure only. A single temperature
+      conversion is shared by every pressure conversion that feeds the filter, and one left
+      over from a measurement that failed later on is reused. */
+   if(ctx->pending_ut_valid
+   && sys_microsecond_tick() - ctx->pending_ut_time < BMP180_TEMPERATURE_REUSE_TIME)
+   {
+      sample->timestamp = ctx->pending_ut_time;
+      UT = ctx->pending_ut;
+   }
+   else
+   {
+      sample->timestamp = sys_microsecond_tick();
+      if(!bmp180_get_uncompensated_temperature(ctx, &UT))
+         return false;
+      ctx->pending_ut = UT;
+      ctx->pending_ut_time = sample->timestamp;
+      ctx->pending_ut_valid = true;
+   }
+
+   if(fc->type == BMP180_FILTER_NONE)
+   {
+      if(!bmp180_get_uncompensated_pressure(ctx, &UP))
+         return false;
+   }
+   else if(fc->stage == BMP180_FILTER_STAGE_RAW)
+   {
+      /* Keep log2(decimation) extra bits, the same trade the hardware makes
+         between sample count and UP width, up to the maximum oss of 3 */
+      uint8_t extra = 0;
+      while(oss + extra < BMP180_MODE_ULTRA_HIGH_RESOLUTION && (2 << extra) <= fc->decimation)
+         ++extra;
+      do
+      {
+         if(!bmp180_get_uncompensated_pressure(ctx, &UP))
+            return false;
+      } while(!bmp180_filter_push(&ctx->filter, UP, &y));
+      UP = (uint32_t)(y + (1 << (BMP180_FILTER_FRAC_BITS - extra - 1))) >> (BMP180_FILTER_FRAC_BITS - extra);
+      oss += extra;
+   }
+   else
+   {
+      /* Every filter input shares the temperature, so only the pressure stage repeats */
+      bmp180_temperature_stage_t stage;
+      if(bmp180_compensate_stage(&ctx->cal, oss, UT, &stage) != 0)
+         return false;
+      do
+      {
+         if(!bmp180_get_uncompensated_pressure(ctx, &UP))
+            return false;
+         if(bmp180_compensate_stage_pressure(&stage, UP, &P) != 0)
+            return false;
+      } while(!bmp180_filter_push(&ctx->filter, P, &y));
+   }
+
+   ctx->pending_ut_valid = false;
+   if(bmp180_Compensate(&ctx->cal, oss, UT, UP, &T, &P) != 0)
       return false;
+   if(fc->type != BMP180_FILTER_NONE && fc->stage == BMP180_FILTER_STAGE_COMPENSATED)
+      P = (y + (1 << (BMP180_FILTER_FRAC_BITS - 1))) >> BMP180_FILTER_FRAC_BITS;
+
+   sample->ut = UT;
+   sample->up = UP;
+   sample->oss = oss;
+   sample->temperature = T;
+   sample->pressure = P;
+   return true;
+}
+
+static bool bmp180_sample_raw_once(bmp180_context_t *ctx, void *arg)
+{
+   bmp180_sample_t *sample = (bmp180_sample_t *) arg;
+   uint32_t UP = 0;
+
+   sample->timestamp = sys_microsecond_tick();
+   if(!bmp180_get_uncompensated_temperature(ctx, &sample->ut)
+   || !bmp180_get_uncompensated_pressure(ctx, &UP))
+      return false;
+   sample->up = (int32_t) UP;
+   sample->oss = ctx->mode;
+   sample->temperature = 0;
+   sample->pressure = 0;
+   return true;
+}
+
+static bool bmp180_temperature_once(bmp180_context_t *ctx, void *arg)
+{
+   int32_t UT = 0;
 
-   /* Temperature is always needed; required for pressure only. */
    if(!bmp180_get_uncompensated_temperature(ctx, &UT))
       return false;
+   return (bmp180_Compensate(&ctx->cal, ctx->mode, UT, 0, (int32_t *) arg, NULL) == 0);
+}
+
+/* Run a measurement, applying the recovery policy after each failed attempt */
+static bool bmp180_with_recovery(bmp180_context_t *ctx, bool (*op)(bmp180_context_t *, void *), void *arg)
+{
+   uint64_t failed_at = 0;
 
-   if(NULL != pressure)
+   for(uint32_t attempt = 0; ; ++attempt)
    {
-      if(!bmp180_get_uncompensated_pressure(ctx, &UP))
+      if(op(ctx, arg))
+      {
+         if(attempt > 0)
+            bmp180_recovered(ctx, failed_at);
+         return true;
+      }
+
+      ++ctx->stats.failures;
+      if(!ctx->aborted && 0 != ctx->deadline && sys_microsecond_tick() >= ctx->deadline)
+      {
+         /* A transaction timed out at the deadline */
+         ++ctx->stats.timeouts;
+         ctx->aborted = true;
+      }
+      if(ctx->aborted)
+         return false;
+      if(attempt == 0)
+         failed_at = sys_microsecond_tick();
+      if(!bmp180_recover(ctx, attempt))
          return false;
    }
+}
 
-   if(bmp180_Compensate(&ctx->cal, ctx->mode, UT, UP, &T,
-      (NULL == pressure) ? NULL : &P) != 0)
+/* Set up the deadline for a measurement, run it with the recovery policy once the budget
+   allows, and restore the default transaction timeout */
+static bool bmp180_run(bmp180_context_t *ctx, bool (*op)(bmp180_context_t *, void *), void *arg,
+                       uint64_t deadline)
+{
+   uint64_t started;
+   bool result;
+
+   ctx->deadline = deadline;
+   ctx->aborted = false;
+   result = bmp180_budget_wait(ctx, &started) && bmp180_with_recovery(ctx, op, arg);
+   bmp180_budget_spend(ctx, started);
+   ctx->deadline = 0;
+   if(ctx->applied_timeout != ctx->i2c_timeout)
    {
+      i2c_ll_set_timeout(ctx->i2c_ctx, ctx->i2c_timeout);
+      ctx->applied_timeout = ctx->i2c_timeout;
+   }
+   return result;
+}
+
+bool bmp180_measure(bmp180_t bmp, float *temperature, uint32_t *pressure)
+{
+   return bmp180_measure_until(bmp, temperature, pressure, 0);
+}
+
+bool bmp180_measure_until(bmp180_t bmp, float *temperature, uint32_t *pressure, uint64_t deadline)
+{
+   bmp180_context_t *ctx = (bmp180_context_t *) bmp;
+   bmp180_sample_t sample;
+   int32_t T;
+
+   if(NULL == ctx)
       return false;
+
+   /* Backends only deliver complete samples */
+   if(NULL != pressure || NULL != ctx->backend)
+   {
+      if(!bmp180_sample_until(bmp, &sample, deadline))
+         return false;
+      if(NULL != temperature)
+         *temperature = (float)sample.temperature/10.0;
+      if(NULL != pressure)
+         *pressure = sample.pressure;
+      return true;
    }
+
+   if(!bmp180_run(ctx, bmp180_temperature_once, &T, deadline))
+      return false;
    if(NULL != temperature)
       *temperature = (float)T/10.0;
-   if(NULL != pressure)
-      *pressure = P;
+   return true;
+}
+
+bool bmp180_sample(bmp180_t bmp, bmp180_sample_t *sample)
+{
+   return bmp180_sample_until(bmp, sample, 0);
+}
+
+bool bmp180_sample_until(bmp180_t bmp, bmp180_sample_t *sample, uint64_t deadline)
+{
+   bmp180_context_t *ctx = (bmp180_context_t *) bmp;
+
+   if(NULL == ctx || NULL == sample)
+      return false;
+   if(!bmp180_run(ctx, (NULL != ctx->backend) ? ctx->backend->sample : bmp180_sample_once, sample, deadline))
+      return false;
+
+   bmp180_sample_done(ctx, sample);
+   return true;
+}
+
+bool bmp180_sample_raw(bmp180_t bmp, bmp180_sample_t *sample, uint64_t deadline)
+{
+   bmp180_context_t *ctx = (bmp180_context_t *) bmp;
+
+   if(NULL == ctx || NULL == sample || NULL != ctx->backend)
+      return false;
+   if(ctx->filter.config.type != BMP180_FILTER_NONE)
+   {
+      SERR("[%s] Raw samples can't be filtered", __func__);
+      return false;
+   }
+   if(!bmp180_run(ctx, bmp180_sample_raw_once, sample, deadline))
+      return false;
+
+   bmp180_account(ctx, sample);
+   return true;
+}
+
+void bmp180_cancel(bmp180_t bmp)
+{
+   bmp180_context_t *ctx = (bmp180_context_t *) bmp;
+   if(NULL != ctx)
+      atomic_store(&ctx->cancel, true);
+}
+
+uint64_t bmp180_now(void)
+{
+   return sys_microsecond_tick();
+}
+
+bool bmp180_set_filter(bmp180_t bmp, const bmp180_filter_config_t *config)
+{
+   bmp180_context_t *ctx = (bmp180_context_t *) bmp;
+   if(NULL == ctx)
+      return false;
+   if(NULL != ctx->backend)
+   {
+      SERR("[%s] Filters need raw values, which this backend doesn't provide", __func__);
+      return false;
+   }
+   return bmp180_filter_init(&ctx->filter, config);
+}
+
+bool bmp180_get_calibration(bmp180_t bmp, bmp180_calibration_t *cal)
+{
+   bmp180_context_t *ctx = (bmp180_context_t *) bmp;
+   if(NULL == ctx || NULL == cal || NULL != ctx->backend)
+      return false;
+   memcpy(cal, ctx->cal.raw, sizeof(*cal));
+   return true;
+}
+
+bool bmp180_get_stats(bmp180_t bmp, bmp180_stats_t *stats)
+{
+   bmp180_context_t *ctx = (bmp180_context_t *) bmp;
+   if(NULL == ctx || NULL == stats)
+      return false;
+   *stats = ctx->stats;
+   stats->bus_clocks = ctx->stats.bus_bytes * BMP180_BYTE_CLOCKS;
+   stats->bus_time = stats->bus_clocks * 1000000 / ctx->bus_speed;
+   stats->mode = ctx->mode;
+   stats->rate = ctx->adaptive.rate;
+   stats->noise = ctx->adaptive.noise;
+   return true;
+}
+
+bool bmp180_reset_stats(bmp180_t bmp)
+{
+   bmp180_context_t *ctx = (bmp180_context_t *) bmp;
+   if(NULL == ctx)
+      return false;
+   memset(&ctx->stats, 0, sizeof(ctx->stats));
    return true;
 }
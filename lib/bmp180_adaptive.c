@@ -0,0 +1,157 @@
+/* Copyright 2024 Zorxx Software. All rights reserved. */
+#include <inttypes.h>
+#include <string.h> /* memset */
+#include "bmp180_private.h"
+
+/* sqrt(2) as 181/128, used to move noise estimates between modes (each mode doubles
+   the hardware sample count) */
+#define SQRT2_NUM 181
+#define SQRT2_DEN 128
+
+static uint32_t abs32(int64_t x)
+{
+   return (uint32_t)((x < 0) ? -x : x);
+}
+
+static bmp180_mode_t select_mode(bmp180_context_t *ctx)
+{
+   t_bmp180_adaptive *a = &ctx->adaptive;
+   const bmp180_adaptive_config_t *c = &a->config;
+   bmp180_mode_t mode = c->max_mode;
+   int m;
+
+   /* Lowest mode expected to meet the noise target. Observed noise is normalized to
+      ULTRA_LOW_POWER; each mode up halves the noise power. */
+   if(c->target_noise > 0 && a->history >= 3)
+   {
+      uint64_t noise0 = (uint64_t) a->noise * a->noise << ctx->mode;
+      uint64_t target = (uint64_t) c->target_noise * 16 * c->target_noise * 16;
+      for(m = c->min_mode; m <= (int) c->max_mode; ++m)
+      {
+         if(noise0 <= target << m)
+            break;
+      }
+      if(m < (int) mode)
+         mode = (bmp180_mode_t) m;
+   }
+
+   /* Highest mode in which pressure changes less than the mode's noise during one conversion */
+   if(a->history >= 2)
+   {
+      for(m = mode; m > (int) c->min_mode; --m)
+      {
+         if((uint64_t) abs32(a->rate) * bmp180_mode_info[m].conversion_time
+            <= (uint64_t) bmp180_mode_info[m].noise * 1000000)
+            break;
+      }
+      mode = (bmp180_mode_t) m;
+   }
+
+   /* Highest mode that fits the budgets at the observed sample interval */
+   if(a->history >= 2 && a->interval > 0)
+   {
+      for(m = mode; m > (int) c->min_mode; --m)
+      {
+         uint64_t busy = BMP180_TEMPERATURE_CONVERSION_TIME + bmp180_mode_info[m].conversion_time;
+         if(c->bus_budget > 0 && busy * 1000 > (uint64_t) c->bus_budget * a->interval)
+            continue;
+         if(c->current_budget > 0
+         && (uint64_t) bmp180_mode_info[m].current * 1000000 > (uint64_t) c->current_budget * a->interval)
+            continue;
+         break;
+      }
+      mode = (bmp180_mode_t) m;
+   }
+
+   return mode;
+}
+
+void bmp180_adapt(bmp180_context_t *ctx, const bmp180_sample_t *sample)
+{
+   t_bmp180_adaptive *a = &ctx->adaptive;
+   bmp180_mode_t mode;
+
+   if(!a->enabled)
+      return;
+
+   if(a->primed && sample->timestamp > a->prev_time)
+   {
+      uint64_t dt = sample->timestamp - a->prev_time;
+      int32_t rate = (int32_t)(((int64_t) sample->pressure - a->prev[0]) * 1000000 / (int64_t) dt);
+      a->rate += (rate - a->rate) / 4;
+      a->interval = (a->interval == 0) ? (uint32_t) dt
+                  : (uint32_t)((int64_t) a->interval + ((int64_t) dt - a->interval) / 4);
+   }
+   if(a->history >= 2)
+   {
+      /* The second difference of white noise has a mean magnitude of ~1.95 sigma;
+         scaled by 16 for the fixed-point estimate, that's ~8x */
+      uint32_t noise = abs32((int64_t) sample->pressure - 2 * (int64_t) a->prev[0] + a->prev[1]) * 8;
+      a->noise = (a->history == 2) ? noise : (uint32_t)((int64_t) a->noise + ((int64_t) noise - a->noise) / 8);
+   }
+   a->prev[1] = a->prev[0];
+   a->prev[0] = sample->pressure;
+   a->prev_time = sample->timestamp;
+   a->primed = true;
+   if(a->history < UINT32_MAX)
+      ++a->history;
+
+   mode = select_mode(ctx);
+   if(mode == ctx->mode)
+   {
+      a->pending_count = 0;
+      return;
+   }
+   if(mode != a->pending)
+   {
+      a->pending = mode;
+      a->pending_count = 0;
+   }
+   if(++a->pending_count < a->config.hold)
+      return;
+
+   SDBG("[%s] Switching from mode %d to %d (rate %" PRIi32 " Pa/s, noise %" PRIu32 "/16 Pa)",
+      __func__, ctx->mode, mode, a->rate, a->noise);
+   for(int m = ctx->mode; m < (int) mode; ++m)
+      a->noise = a->noise * SQRT2_DEN / SQRT2_NUM;
+   for(int m = ctx->mode; m > (int) mode; --m)
+      a->noise = a->noise * SQRT2_NUM / SQRT2_DEN;
+   bmp180_set_mode(ctx, mode);
+   ++ctx->stats.mode_changes;
+   a->pending_count = 0;
+}
+
+/* --------------------------------------------------------------------------------------------------------
+ * Exported Functions
+ */
+
+bool bmp180_set_adaptive(bmp180_t bmp, const bmp180_adaptive_config_t *config)
+{
+   bmp180_context_t *ctx = (bmp180_context_t *) bmp;
+   if(NULL == ctx)
+      return false;
+
+   memset(&ctx->adaptive, 0, sizeof(ctx->adaptive));
+   if(NULL == config)
+      return true;
+   if(NULL != ctx->backend)
+   {
+      SERR("[%s] The mode of this backend is fixed at initialization", __func__);
+      return false;
+   }
+
+   if(config->min_mode < BMP180_MODE_ULTRA_LOW_POWER || config->max_mode > BMP180_MODE_ULTRA_HIGH_RESOLUTION
+   || config->min_mode > config->max_mode)
+   {
+      SERR("[%s] Invalid mode range %d-%d", __func__, config->min_mode, config->max_mode);
+      return false;
+   }
+
+   ctx->adaptive.config = *config;
+   ctx->adaptive.enabled = true;
+   if(ctx->mode < config->min_mode)
+      bmp180_set_mode(ctx, config->min_mode);
+   else if(ctx->mode > config->max_mode)
+      bmp180_set_mode(ctx, config->max_mode);
+   return true;
+}
@@ -0,0 +1,257 @@
+/* Copyright 2024 Zorxx Software. All rights reserved. */
+#include <malloc.h>
+#include <string.h> /* memset */
+#include "bmp180/aggregate.h"
+#include "helpers.h"
+#include "moments.h"
+
+#define CHANNEL_TEMPERATURE 0
+#define CHANNEL_PRESSURE    1
+#define CHANNEL_COUNT       2
+
+/* Monotonic deque of sample sequence numbers; values are looked up in the sample ring */
+typedef struct
+{
+   uint64_t *seq;
+   uint32_t head;
+   uint32_t size;
+} deque_t;
+
+typedef struct
+{
+   t_moments m;
+   deque_t dmin;     /* sliding windows only */
+   deque_t dmax;
+} channel_t;
+
+typedef struct
+{
+   bmp180_aggregate_config_t config;
+   channel_t ch[CHANNEL_COUNT];
+   uint32_t count;   /* samples in the current window */
+   uint64_t seq;     /* samples pushed since reset; 64 bits so ring slots never wrap */
+   uint32_t since_report;
+   uint64_t start;
+   uint64_t end;
+
+   /* Sliding windows: the last 'length' samples */
+   int32_t *values[CHANNEL_COUNT];
+   uint64_t *timestamps;
+} aggregate_t;
+
+/* ----------------------------------------------------------------------------------------------
+ * Monotonic deque
+ */
+
+static inline uint64_t deque_at(aggregate_t *a, deque_t *d, uint32_t i)
+{
+   return d->seq[(d->head + i) % a->config.length];
+}
+
+static inline int32_t ring_value(aggregate_t *a, int channel, uint64_t seq)
+{
+   return a->values[channel][seq % a->config.length];
+}
+
+/* Push 'seq' after removing every entry it dominates; 'want_max' selects the ordering */
+static void deque_push(aggregate_t *a, deque_t *d, int channel, uint64_t seq, bool want_max)
+{
+   int32_t v = ring_value(a, channel, seq);
+   while(d->size > 0)
+   {
+      int32_t back = ring_value(a, channel, deque_at(a, d, d->size - 1));
+      if(want_max ? (back > v) : (back < v))
+         break;
+      --d->size;
+   }
+   d->seq[(d->head + d->size) % a->config.length] = seq;
+   ++d->size;
+}
+
+static void deque_expire(aggregate_t *a, deque_t *d, uint64_t oldest)
+{
+   while(d->size > 0 && deque_at(a, d, 0) < oldest)
+   {
+      d->head = (d->head + 1) % a->config.length;
+      --d->size;
+   }
+}
+
+/* ----------------------------------------------------------------------------------------------
+ * Helpers
+ */
+
+static void window_summary(aggregate_t *a, bmp180_summary_t *summary)
+{
+   summary->start = a->start;
+   summary->end = a->end;
+   summary->count = a->count;
+   moments_summary(&a->ch[CHANNEL_TEMPERATURE].m, a->count, &summary->temperature);
+   moments_summary(&a->ch[CHANNEL_PRESSURE].m, a->count, &summary->pressure);
+}
+
+static void window_reset(aggregate_t *a)
+{
+   for(int i = 0; i < CHANNEL_COUNT; ++i)
+   {
+      a->ch[i].m.sum = 0;
+      a->ch[i].m.sumsq = 0;
+      a->ch[i].dmin.size = 0;
+      a->ch[i].dmax.size = 0;
+   }
+   a->count = 0;
+   a->since_report = 0;
+}
+
+static bool push_tumbling(aggregate_t *a, const int32_t *v, uint64_t timestamp, bmp180_summary_t *summary)
+{
+   if(a->count == 0)
+   {
+      a->start = timestamp;
+      for(int i = 0; i < CHANNEL_COUNT; ++i)
+         moments_reset(&a->ch[i].m, v[i]);
+   }
+   for(int i = 0; i < CHANNEL_COUNT; ++i)
+      moments_add(&a->ch[i].m, v[i]);
+   a->end = timestamp;
+
+   if(++a->count < a->config.length)
+      return false;
+   if(NULL != summary)
+      window_summary(a, summary);
+   window_reset(a);
+   return true;
+}
+
+static bool push_sliding(aggregate_t *a, const int32_t *v, uint64_t timestamp, bmp180_summary_t *summary)
+{
+   uint32_t length = a->config.length;
+   uint32_t slot = (uint32_t)(a->seq % length);
+
+   if(a->seq == 0)
+   {
+      for(int i = 0; i < CHANNEL_COUNT; ++i)
+         moments_reset(&a->ch[i].m, v[i]);
+   }
+
+   /* Evict the sample this one replaces */
+   if(a->count == length)
+   {
+      for(int i = 0; i < CHANNEL_COUNT; ++i)
+         moments_remove(&a->ch[i].m, a->values[i][slot]);
+   }
+   else
+      ++a->count;
+
+   a->timestamps[slot] = timestamp;
+   for(int i = 0; i < CHANNEL_COUNT; ++i)
+   {
+      channel_t *c = &a->ch[i];
+      a->values[i][slot] = v[i];
+      moments_add(&c->m, v[i]);
+
+      /* Expire before pushing, so the deque never holds more than 'length' entries */
+      deque_expire(a, &c->dmin, a->seq - a->count + 1);
+      deque_expire(a, &c->dmax, a->seq - a->count + 1);
+      deque_push(a, &c->dmin, i, a->seq, false);
+      deque_push(a, &c->dmax, i, a->seq, true);
+      c->m.min = ring_value(a, i, deque_at(a, &c->dmin, 0));
+      c->m.max = ring_value(a, i, deque_at(a, &c->dmax, 0));
+   }
+   ++a->seq;
+   a->start = a->timestamps[(a->seq - a->count) % length];
+   a->end = timestamp;
+
+   if(a->count < length || ++a->since_report < a->config.hop)
+      return false;
+   a->since_report = 0;
+   if(NULL != summary)
+      window_summary(a, summary);
+   return true;
+}
+
+/* ----------------------------------------------------------------------------------------------
+ * Exported Functions
+ */
+
+bmp180_aggregate_t bmp180_aggregate_init(const bmp180_aggregate_config_t *config)
+{
+   aggregate_t *a;
+   bool success = true;
+
+   if(NULL == config || config->length == 0
+   || (config->type == BMP180_WINDOW_SLIDING && config->hop == 0)
+   || (config->type != BMP180_WINDOW_SLIDING && config->type != BMP180_WINDOW_TUMBLING))
+   {
+      SERR("[%s] Invalid configuration", __func__);
+      return NULL;
+   }
+
+   a = (aggregate_t *) malloc(sizeof(*a));
+   if(NULL == a)
+      return NULL;
+   memset(a, 0, sizeof(*a));
+   a->config = *config;
+
+   if(config->type == BMP180_WINDOW_SLIDING)
+   {
+      a->timestamps = (uint64_t *) malloc(config->length * sizeof(uint64_t));
+      success = (NULL != a->timestamps);
+      for(int i = 0; i < CHANNEL_COUNT && success; ++i)
+      {
+         a->values[i] = (int32_t *) malloc(config->length * sizeof(int32_t));
+         a->ch[i].dmin.seq = (uint64_t *) malloc(config->length * sizeof(uint64_t));
+         a->ch[i].dmax.seq = (uint64_t *) malloc(config->length * sizeof(uint64_t));
+         success = (NULL != a->values[i] && NULL != a->ch[i].dmin.seq && NULL != a->ch[i].dmax.seq);
+      }
+   }
+
+   if(!success)
+   {
+      SERR("[%s] Memory allocation error", __func__);
+      bmp180_aggregate_free(a);
+      a = NULL;
+   }
+   return a;
+}
+
+bool bmp180_aggregate_free(bmp180_aggregate_t agg)
+{
+   aggregate_t *a = (aggregate_t *) agg;
+   if(NULL == a)
+      return false;
+   for(int i = 0; i < CHANNEL_COUNT; ++i)
+   {
+      free(a->values[i]);
+      free(a->ch[i].dmin.seq);
+      free(a->ch[i].dmax.seq);
+   }
+   free(a->timestamps);
+   free(a);
+   return true;
+}
+
+bool bmp180_aggregate_push(bmp180_aggregate_t agg, const bmp180_sample_t *sample,
+                           bmp180_summary_t *summary)
+{
+   aggregate_t *a = (aggregate_t *) agg;
+   int32_t v[CHANNEL_COUNT];
+
+   if(NULL == a || NULL == sample)
+      return false;
+
+   v[CHANNEL_TEMPERATURE] = sample->temperature;
+   v[CHANNEL_PRESSURE] = sample->pressure;
+   if(a->config.type == BMP180_WINDOW_SLIDING)
+      return push_sliding(a, v, sample->timestamp, summary);
+   return push_tumbling(a, v, sample->timestamp, summary);
+}
+
+void bmp180_aggregate_reset(bmp180_aggregate_t agg)
+{
+   aggregate_t *a = (aggregate_t *) agg;
+   if(NULL == a)
+      return;
+   window_reset(a);
+   a->seq = 0;
+}
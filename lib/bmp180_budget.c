@@ -0,0 +1,99 @@
+/* Copyright 2024 Zorxx Software. All rights reserved. */
+#include <inttypes.h>
+#include <string.h> /* memset */
+#include "bmp180_private.h"
+
+void bmp180_account_bus(bmp180_context_t *ctx, uint32_t bytes)
+{
+   ctx->stats.bus_bytes += bytes;
+   ctx->budget.pending_bytes += bytes;
+}
+
+void bmp180_account_conversion(bmp180_context_t *ctx, uint32_t time)
+{
+   const t_bmp180_mode_info *m = &bmp180_mode_info[ctx->mode];
+   uint64_t charge;
+
+   /* The datasheet's current for a mode is the average at one sample (a temperature and a
+      pressure conversion) per second, so it is the charge of that pair in uC; conversions
+      are charged pro rata by time */
+   charge = (uint64_t) m->current * 1000 * time / (BMP180_TEMPERATURE_CONVERSION_TIME + m->conversion_time);
+   ctx->stats.conversion_time[ctx->mode] += time;
+   ctx->stats.charge += charge;
+   ctx->budget.pending_charge += charge;
+}
+
+bool bmp180_budget_wait(bmp180_context_t *ctx, uint64_t *now)
+{
+   t_bmp180_budget *b = &ctx->budget;
+   uint64_t ready = (b->ready[0] > b->ready[1]) ? b->ready[0] : b->ready[1];
+
+   b->refused = false;
+   *now = sys_microsecond_tick();
+   if(ready <= *now)
+      return true;
+   if(0 != ctx->deadline && ready + bmp180_latency(ctx, ctx->mode) > ctx->deadline)
+   {
+      SDBG("[%s] Refused, the budget allows the next measurement too late for its deadline", __func__);
+      ++ctx->stats.refused;
+      b->refused = true;
+      return false;
+   }
+   SDBG("[%s] Throttled for %" PRIu64 " us", __func__, ready - *now);
+   ++ctx->stats.throttled;
+   ctx->stats.throttle_time += ready - *now;
+   while(ready > *now)
+   {
+      if(!bmp180_wait(ctx, (ready - *now > UINT32_MAX) ? UINT32_MAX : (uint32_t)(ready - *now)))
+         return false;
+      *now = sys_microsecond_tick();
+   }
+   return true;
+}
+
+void bmp180_budget_spend(bmp180_context_t *ctx, uint64_t started)
+{
+   t_bmp180_budget *b = &ctx->budget;
+   const bmp180_budget_t *c = &b->config;
+   uint64_t cost[2] = { 0, 0 };
+   uint64_t earliest = (started > c->burst) ? started - c->burst : 0;
+
+   /* Each cost is the time its resource takes to accrue at the ceiling */
+   if(c->current > 0)
+      cost[0] = b->pending_charge * 1000000 / (c->current - BMP180_STANDBY_CURRENT);
+   if(c->bus_utilization > 0)
+      cost[1] = b->pending_bytes * BMP180_BYTE_CLOCKS * 1000000 * 1000 / ((uint64_t) ctx->bus_speed * c->bus_utilization);
+   for(int i = 0; i < 2; ++i)
+   {
+      if(cost[i] > 0)
+         b->ready[i] = ((b->ready[i] > earliest) ? b->ready[i] : earliest) + cost[i];
+   }
+   b->pending_charge = 0;
+   b->pending_bytes = 0;
+}
+
+/* --------------------------------------------------------------------------------------------------------
+ * Exported Functions
+ */
+
+bool bmp180_set_budget(bmp180_t bmp, const bmp180_budget_t *budget)
+{
+   bmp180_context_t *ctx = (bmp180_context_t *) bmp;
+   if(NULL == ctx)
+      return false;
+   if(NULL != ctx->backend)
+   {
+      SERR("[%s] Costs are only accounted for the i2c driver", __func__);
+      return false;
+   }
+   if(NULL != budget
+   && ((budget->current > 0 && budget->current <= BMP180_STANDBY_CURRENT) || budget->bus_utilization > 1000))
+   {
+      SERR("[%s] Invalid budget", __func__);
+      return false;
+   }
+   memset(&ctx->budget, 0, sizeof(ctx->budget));
+   if(NULL != budget)
+      ctx->budget.config = *budget;
+   return true;
+}
@@ -1,16 +1,34 @@
 /* Copyright 2024 Zorxx Software. All rights reserved. */
 #include <stdio.h>
+#include <string.h> /* memcpy */
 #include <inttypes.h>
 #include "bmp180_private.h"
 
-int bmp180_Compensate(t_bmp180_calibration_data *cal, uint8_t oss,
-    int32_t uncompensatedTemperature, int32_t uncompensatedPressure,
-   int32_t *temperature, int32_t *pressure)
+/* Division of any 32-bit value by the invariant B4, as a multiply and shifts
+   (Granlund and Montgomery, "Division by Invariant Integers using Multiplication") */
+static void bmp180_reciprocal(bmp180_temperature_stage_t *stage)
+{
+   uint32_t d = stage->B4;
+   uint8_t l = 0;
+
+   while(l < 32 && ((uint64_t)1 << l) < d)
+      ++l; /* ceil(log2(d)) */
+   stage->magic = (uint32_t)((((uint64_t)1 << 32) * (((uint64_t)1 << l) - d)) / d + 1);
+   stage->shift1 = (l > 0) ? 1 : 0;
+   stage->shift2 = (l > 0) ? l - 1 : 0;
+}
+
+static inline uint32_t bmp180_divide(const bmp180_temperature_stage_t *stage, uint32_t n)
+{
+   uint32_t t = (uint32_t)(((uint64_t)stage->magic * n) >> 32);
+   return (t + ((n - t) >> stage->shift1)) >> stage->shift2;
+}
+
+int bmp180_compensate_stage(const t_bmp180_calibration_data *cal, uint8_t oss,
+   int32_t uncompensatedTemperature, bmp180_temperature_stage_t *stage)
 {
    int32_t X1, X2, B5;
-   int32_t X3, B3, B6;
-   int32_t T, P;
-   uint32_t B4, B7;
+   int32_t X3, B6;
 
    SDBG("AC1 = %d", cal->AC1);
    SDBG("AC2 = %d", cal->AC2);
@@ -25,59 +43,134 @@ int bmp180_Compensate(t_bmp180_calibration_data *cal, uint8_t oss,
    SDBG("MD  = %d", cal->MD);
 
    SDBG("UT  = %" PRIi32, uncompensatedTemperature);
-   SDBG("UP  = %" PRIi32, uncompensatedPressure);
 
    X1 = ((uncompensatedTemperature - (int32_t)cal->AC6) * (int32_t)cal->AC5) >> 15;
    SDBG("X1 = %" PRIi32, X1);
+   if(X1 + (int32_t)cal->MD == 0)
+      return -1; /* invalid calibration or reading */
    X2 = (((int32_t)cal->MC) << 11) / (X1 + (int32_t)cal->MD);
    SDBG("X2 = %" PRIi32, X2);
    B5 = X1 + X2;
    SDBG("B5 = %" PRIi32, B5);
-   T = (B5 + 8) >> 4;
-   SDBG("T = %" PRIi32, T);
-   if(NULL != temperature)
-      *temperature = T;
+   stage->temperature = (B5 + 8) >> 4;
+   SDBG("T = %" PRIi32, stage->temperature);
+   stage->oss = oss;
 
+   B6 = B5 - 4000;
+   SDBG("B6 = %" PRIi32, B6);
+   X1 = ((int32_t)cal->B2 * ((B6 * B6) >> 12)) >> 11;
+   SDBG("X1 = %" PRIi32, X1);
+   X2 = ((int32_t)cal->AC2 * B6) >> 11;
+   SDBG("X2 = %" PRIi32, X2);
+   X3 = X1 + X2;
+   SDBG("X3 = %" PRIi32, X3);
+
+   stage->B3 = ((((int32_t)cal->AC1 * 4 + X3) << oss) + 2) >> 2;
+   SDBG("B3 = %" PRIi32, stage->B3);
+   X1 = ((int32_t)cal->AC3 * B6) >> 13;
+   SDBG("X1 = %" PRIi32, X1);
+   X2 = ((int32_t)cal->B1 * ((B6 * B6) >> 12)) >> 16;
+   SDBG("X2 = %" PRIi32, X2);
+   X3 = ((X1 + X2) + 2) >> 2;
+   SDBG("X3 = %" PRIi32, X3);
+   stage->B4 = ((uint32_t)cal->AC4 * (uint32_t)(X3 + 32768)) >> 15;
+   SDBG("B4 = %" PRIu32, stage->B4);
+   if(0 != stage->B4)
+      bmp180_reciprocal(stage);
+
+   return 0;
+}
+
+int bmp180_compensate_stage_pressure(const bmp180_temperature_stage_t *stage,
+   int32_t uncompensatedPressure, int32_t *pressure)
+{
+   int32_t X1, X2, P;
+   uint32_t B7;
+
+   SDBG("UP  = %" PRIi32, uncompensatedPressure);
+
+   B7 = ((uint32_t)uncompensatedPressure - stage->B3) * (uint32_t)(50000UL >> stage->oss);
+   SDBG("B7 = %" PRIu32, B7);
+   if(0 == stage->B4)
+      return -1;
+
+   if(B7 < 0x80000000UL)
+      P = bmp180_divide(stage, B7 * 2);
+   else
+      P = bmp180_divide(stage, B7) * 2;
+
+   X1 = (P >> 8) * (P >> 8);
+   SDBG("X1 = %" PRIi32, X1);
+   X1 = (X1 * 3038) >> 16;
+   SDBG("X1 = %" PRIi32, X1);
+   X2 = (-7357 * P) >> 16;
+   SDBG("X2 = %" PRIi32, X2);
+   P += (X1 + X2 + (int32_t)3791) >> 4;
+   SDBG("P = %" PRIi32, P);
+
+   *pressure = P;
+   return 0;
+}
+
+int bmp180_Compensate(t_bmp180_calibration_data *cal, uint8_t oss,
+    int32_t uncompensatedTemperature, int32_t uncompensatedPressure,
+   int32_t *temperature, int32_t *pressure)
+{
+   bmp180_temperature_stage_t stage;
+
+   if(bmp180_compensate_stage(cal, oss, uncompensatedTemperature, &stage) != 0)
+      return -1;
+   if(NULL != temperature)
+      *temperature = stage.temperature;
    if(NULL != pressure)
+      return bmp180_compensate_stage_pressure(&stage, uncompensatedPressure, pressure);
+   return 0; 
+}
+
+bool bmp180_compensate_temperature(const bmp180_calibration_t *cal, uint8_t oss, int32_t ut,
+                                   bmp180_temperature_stage_t *stage)
+{
+   t_bmp180_calibration_data c;
+
+   if(NULL == cal || NULL == stage || oss > BMP180_MODE_ULTRA_HIGH_RESOLUTION)
+      return false;
+   memcpy(c.raw, cal, sizeof(c.raw));
+   return (bmp180_compensate_stage(&c, oss, ut, stage) == 0);
+}
+
+bool bmp180_compensate_pressure(const bmp180_temperature_stage_t *stage, int32_t up, int32_t *pressure)
+{
+   if(NULL == stage || NULL == pressure)
+      return false;
+   return (bmp180_compensate_stage_pressure(stage, up, pressure) == 0);
+}
+
+bool bmp180_compensate_batch(const bmp180_calibration_t *cal, uint8_t oss, const int32_t *ut,
+                             const int32_t *up, size_t count, int32_t *temperature, int32_t *pressure)
+{
+   t_bmp180_calibration_data c;
+   bmp180_temperature_stage_t stage;
+
+   if(NULL == cal || NULL == ut || oss > BMP180_MODE_ULTRA_HIGH_RESOLUTION)
+      return false;
+   memcpy(c.raw, cal, sizeof(c.raw));
+
+   for(size_t i = 0; i < count; ++i)
    {
-      B6 = B5 - 4000;
-      SDBG("B6 = %" PRIi32, B6);
-      X1 = ((int32_t)cal->B2 * ((B6 * B6) >> 12)) >> 11;
-      SDBG("X1 = %" PRIi32, X1);
-      X2 = ((int32_t)cal->AC2 * B6) >> 11;
-      SDBG("X2 = %" PRIi32, X2);
-      X3 = X1 + X2;
-      SDBG("X3 = %" PRIi32, X3);
-
-      B3 = ((((int32_t)cal->AC1 * 4 + X3) << oss) + 2) >> 2;
-      SDBG("B3 = %" PRIi32, B3);
-      X1 = ((int32_t)cal->AC3 * B6) >> 13;
-      SDBG("X1 = %" PRIi32, X1);
-      X2 = ((int32_t)cal->B1 * ((B6 * B6) >> 12)) >> 16;
-      SDBG("X2 = %" PRIi32, X2);
-      X3 = ((X1 + X2) + 2) >> 2;
-      SDBG("X3 = %" PRIi32, X3);
-      B4 = ((uint32_t)cal->AC4 * (uint32_t)(X3 + 32768)) >> 15;
-      SDBG("B4 = %" PRIi32, B4);
-      B7 = ((uint32_t)uncompensatedPressure - B3) * (uint32_t)(50000UL >> oss);
-      SDBG("B7 = %" PRIi32, B7);
-
-      if(B7 < 0x80000000UL)
-         P = (B7 * 2) / B4;
-      else
-         P = (B7 / B4) * 2;
-
-      X1 = (P >> 8) * (P >> 8);
-      SDBG("X1 = %" PRIi32, X1);
-      X1 = (X1 * 3038) >> 16;
-      SDBG("X1 = %" PRIi32, X1);
-      X2 = (-7357 * P) >> 16;
-      SDBG("X2 = %" PRIi32, X2);
-      P += (X1 + X2 + (int32_t)3791) >> 4;
-      SDBG("P = %" PRIi32, P);
-
-      *pressure = P;
+      if((i == 0 || ut[i] != ut[i - 1])
+      && bmp180_compensate_stage(&c, oss, ut[i], &stage) != 0)
+      {
+         SERR("[%s] Invalid temperature at index %zu", __func__, i);
+         return false;
+      }
+      if(NULL != temperature)
+         temperature[i] = stage.temperature;
+      if(NULL != up && NULL != pressure
+      && bmp180_compensate_stage_pressure(&stage, up[i], &pressure[i]) != 0)
+      {
+         SERR("[%s] Invalid pressure at index %zu", __func__, i);
+         return false;
+      }
    }
-
-   return 0; 
+   return true;
 }
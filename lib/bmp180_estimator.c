@@ -0,0 +1,279 @@
+/* Copyright 2024 Zorxx Software. All rights reserved. */
+#include <malloc.h>
+#include <string.h> /* memset */
+#include "bmp180/estimator.h"
+#include "helpers.h"
+
+/* Fixed-point formats (fractional bits) */
+#define STATE_FRAC_BITS   8   /* altitude (mm) and speed (mm/s) */
+#define TIME_FRAC_BITS    24  /* sample period (s) */
+#define ALPHA_FRAC_BITS   24  /* altitude gain */
+#define RATE_FRAC_BITS    20  /* speed gain, beta / period (1/s) */
+#define LAMBDA_FRAC_BITS  28  /* tracking index, and the intermediate gain computations */
+#define RATIO_FRAC_BITS   24  /* pressure ratio p/p0; the table steps by 2^-8 */
+#define RECIPROCAL_BITS   48  /* 1/period (1/us); exact for gaps up to MAX_GAP periods */
+
+#define LAMBDA_MIN        ((uint64_t) 1 << (LAMBDA_FRAC_BITS - 20))
+#define LAMBDA_MAX        ((uint64_t) 4 << LAMBDA_FRAC_BITS)
+#define PERIOD_MIN        1000
+#define PERIOD_MAX        1000000
+#define MAX_GAP           16        /* periods; longer gaps restart the estimator */
+#define STATE_LIMIT       INT32_MAX /* bound on residuals and speed, keeps products in 64 bits */
+
+/* Altitude (mm), 44330 m * (1 - (p/p0)^(1/5.255)), at pressure ratios p/p0 = i/256 for
+   i = TABLE_FIRST..TABLE_LAST */
+#define TABLE_FIRST 64
+#define TABLE_LAST  289
+static const int32_t altitude_table[TABLE_LAST - TABLE_FIRST + 1] =
+{
+   10279088, 10178477, 10079111, 9980957, 9883983, 9788156, 9693447, 9599828,
+   9507270, 9415747, 9325234, 9235706, 9147139, 9059511, 8972799, 8886984,
+   8802043, 8717957, 8634708, 8552277, 8470647, 8389799, 8309718, 8230387,
+   8151792, 8073916, 7996745, 7920266, 7844464, 7769326, 7694840, 7620993,
+   7547772, 7475167, 7403165, 7331755, 7260927, 7190670, 7120975, 7051830,
+   6983227, 6915156, 6847608, 6780573, 6714045, 6648013, 6582470, 6517407,
+   6452818, 6388693, 6325027, 6261811, 6199039, 6136703, 6074797, 6013315,
+   5952249, 5891595, 5831344, 5771493, 5712034, 5652962, 5594271, 5535956,
+   5478012, 5420434, 5363215, 5306352, 5249840, 5193673, 5137847, 5082357,
+   5027199, 4972368, 4917861, 4863672, 4809798, 4756235, 4702979, 4650025,
+   4597370, 4545011, 4492943, 4441163, 4389668, 4338454, 4287517, 4236854,
+   4186462, 4136338, 4086479, 4036881, 3987541, 3938457, 3889626, 3841044,
+   3792708, 3744617, 3696767, 3649156, 3601780, 3554638, 3507727, 3461044,
+   3414586, 3368353, 3322340, 3276545, 3230967, 3185603, 3140451, 3095509,
+   3050774, 3006244, 2961918, 2917793, 2873866, 2830137, 2786604, 2743263,
+   2700114, 2657154, 2614382, 2571796, 2529394, 2487174, 2445134, 2403273,
+   2361590, 2320081, 2278747, 2237585, 2196593, 2155770, 2115115, 2074625,
+   2034300, 1994138, 1954138, 1914297, 1874615, 1835090, 1795721, 1756507,
+   1717445, 1678535, 1639776, 1601166, 1562704, 1524388, 1486218, 1448192,
+   1410309, 1372568, 1334967, 1297505, 1260182, 1222996, 1185946, 1149031,
+   1112250, 1075601, 1039084, 1002698, 966441, 930313, 894312, 858437,
+   822689, 787065, 751564, 716186, 680930, 645794, 610778, 575882,
+   541103, 506441, 471896, 437466, 403151, 368949, 334860, 300883,
+   267017, 233262, 199617, 166080, 132651, 99329, 66114, 33004,
+   0, -32900, -65697, -98391, -130983, -163474, -195864, -228154,
+   -260344, -292436, -324431, -356328, -388128, -419833, -451442, -482957,
+   -514377, -545704, -576939, -608081, -639131, -670091, -700960, -731740,
+   -762430, -793032, -823546, -853972, -884311, -914564, -944731, -974813,
+   -1004810, -1034723,
+};
+
+typedef struct
+{
+   bmp180_estimator_config_t config;
+   uint64_t inverse;     /* 2^(RATIO_FRAC_BITS + 16) / p0 */
+   int64_t step;         /* period, Q24 s */
+   int64_t alpha;        /* Q24 */
+   int64_t rate;         /* beta / period, Q20 1/s */
+   uint64_t reciprocal;  /* ceil(2^48 / period) */
+   uint64_t gap_limit;   /* shortest interval (us) that rounds to more than MAX_GAP periods */
+
+   bool primed;
+   uint64_t timestamp;   /* of the previous sample */
+   int64_t altitude;     /* Q8 mm */
+   int64_t speed;        /* Q8 mm/s */
+} estimator_t;
+
+/* ----------------------------------------------------------------------------------------------
+ * Integer helpers, used only while computing the gains
+ */
+
+/* floor(a * 2^q / b), for results that fit in 64 bits */
+static uint64_t div_q(uint64_t a, uint64_t b, int q)
+{
+   uint64_t result = a / b, rem = a % b;
+   for(int i = 0; i < q; ++i)
+   {
+      rem <<= 1;
+      result <<= 1;
+      if(rem >= b)
+      {
+         rem -= b;
+         result |= 1;
+      }
+   }
+   return result;
+}
+
+static uint64_t isqrt(uint64_t x)
+{
+   uint64_t result = 0, bit = (uint64_t) 1 << 62;
+   while(bit > x)
+      bit >>= 2;
+   while(bit != 0)
+   {
+      if(x >= result + bit)
+      {
+         x -= result + bit;
+         result = (result >> 1) + bit;
+      }
+      else
+         result >>= 1;
+      bit >>= 2;
+   }
+   return result;
+}
+
+static inline int64_t clamp(int64_t v)
+{
+   return (v > STATE_LIMIT) ? STATE_LIMIT : (v < -STATE_LIMIT) ? -STATE_LIMIT : v;
+}
+
+/* ----------------------------------------------------------------------------------------------
+ * Altitude
+ */
+
+static uint64_t ratio_inverse(int32_t sea_level_pressure)
+{
+   if(sea_level_pressure <= 0)
+      sea_level_pressure = BMP180_SEA_LEVEL_PRESSURE;
+   return ((uint64_t) 1 << (RATIO_FRAC_BITS + 16)) / (uint32_t) sea_level_pressure;
+}
+
+static int32_t altitude(int32_t pressure, uint64_t inverse)
+{
+   const int shift = RATIO_FRAC_BITS - 8; /* table index bits */
+   uint64_t ratio = ((uint64_t)(pressure > 0 ? pressure : 0) * inverse) >> 16;
+   uint32_t index, frac;
+   const int32_t *t;
+
+   if(ratio < ((uint64_t) TABLE_FIRST << shift))
+      ratio = (uint64_t) TABLE_FIRST << shift;
+   else if(ratio >= ((uint64_t) TABLE_LAST << shift))
+      ratio = ((uint64_t) TABLE_LAST << shift) - 1;
+   index = (uint32_t)(ratio >> shift);
+   frac = (uint32_t)(ratio & ((1u << shift) - 1));
+   t = &altitude_table[index - TABLE_FIRST];
+   return t[0] + (int32_t)(((int64_t)(t[1] - t[0]) * frac) >> shift);
+}
+
+int32_t bmp180_altitude(int32_t pressure, int32_t sea_level_pressure)
+{
+   return altitude(pressure, ratio_inverse(sea_level_pressure));
+}
+
+/* ----------------------------------------------------------------------------------------------
+ * Estimator
+ */
+
+/* Steady-state gains from the tracking index lambda = sigma_a * T^2 / sigma_z (Kalata):
+   r = (4 + lambda - sqrt(8 lambda + lambda^2)) / 4, alpha = 1 - r^2, beta = 2 (1 - r)^2 */
+static void estimator_gains(estimator_t *e)
+{
+   const bmp180_estimator_config_t *c = &e->config;
+   const uint64_t one = (uint64_t) 1 << LAMBDA_FRAC_BITS;
+   uint64_t lambda, s, r, d, beta;
+
+   /* sigma_a * T / sigma_z, then times T; both in seconds */
+   lambda = div_q((uint64_t) c->acceleration_noise * c->period,
+                  (uint64_t) c->altitude_noise * 1000000, LAMBDA_FRAC_BITS);
+   if(lambda > LAMBDA_MAX * 1000000 / c->period)
+      lambda = LAMBDA_MAX;
+   else
+      lambda = lambda * c->period / 1000000;
+   if(lambda < LAMBDA_MIN)
+      lambda = LAMBDA_MIN;
+   else if(lambda > LAMBDA_MAX)
+      lambda = LAMBDA_MAX;
+
+   s = isqrt((lambda << (LAMBDA_FRAC_BITS + 3)) + lambda * lambda);
+   r = ((4 * one) + lambda - s) / 4;
+   d = one - r;
+   beta = (2 * d * d) >> LAMBDA_FRAC_BITS;
+
+   e->alpha = (int64_t)((one - ((r * r) >> LAMBDA_FRAC_BITS)) >> (LAMBDA_FRAC_BITS - ALPHA_FRAC_BITS));
+   e->rate = (int64_t)((beta * 1000000 / c->period) >> (LAMBDA_FRAC_BITS - RATE_FRAC_BITS));
+   e->step = (int64_t)(((uint64_t) c->period << TIME_FRAC_BITS) / 1000000);
+   SDBG("[%s] gains (ppm): alpha %lu, beta %lu", __func__,
+        (unsigned long)((e->alpha * 1000000) >> ALPHA_FRAC_BITS),
+        (unsigned long)((beta * 1000000) >> LAMBDA_FRAC_BITS));
+}
+
+bmp180_estimator_t bmp180_estimator_init(const bmp180_estimator_config_t *config)
+{
+   estimator_t *e;
+
+   if(NULL == config || config->period < PERIOD_MIN || config->period > PERIOD_MAX
+   || config->altitude_noise == 0 || config->acceleration_noise == 0)
+   {
+      SERR("[%s] Invalid configuration", __func__);
+      return NULL;
+   }
+
+   e = (estimator_t *) malloc(sizeof(*e));
+   if(NULL == e)
+   {
+      SERR("[%s] Memory allocation error", __func__);
+      return NULL;
+   }
+   memset(e, 0, sizeof(*e));
+   e->config = *config;
+   e->inverse = ratio_inverse(config->sea_level_pressure);
+   e->reciprocal = (((uint64_t) 1 << RECIPROCAL_BITS) + config->period - 1) / config->period;
+   e->gap_limit = (uint64_t)(MAX_GAP + 1) * config->period - config->period / 2;
+   estimator_gains(e);
+   return e;
+}
+
+bool bmp180_estimator_free(bmp180_estimator_t est)
+{
+   if(NULL == est)
+      return false;
+   free(est);
+   return true;
+}
+
+bool bmp180_estimator_push(bmp180_estimator_t est, const bmp180_sample_t *sample,
+                           bmp180_estimate_t *estimate)
+{
+   estimator_t *e = (estimator_t *) est;
+   int64_t z, predicted, residual;
+   uint32_t steps = 1;
+
+   if(NULL == e || NULL == sample || NULL == estimate || sample->pressure <= 0)
+      return false;
+
+   z = (int64_t) altitude(sample->pressure, e->inverse) * (1 << STATE_FRAC_BITS);
+   if(e->primed && 0 != sample->timestamp && 0 != e->timestamp)
+   {
+      uint64_t dt = sample->timestamp - e->timestamp;
+      if(dt > e->config.period + e->config.period / 2)
+      {
+         /* Round to whole periods by multiplying with the reciprocal: below gap_limit the
+            dividend is under 2^25 and the product is exact */
+         if(dt >= e->gap_limit)
+            e->primed = false;
+         else
+            steps = (uint32_t)(((dt + e->config.period / 2) * e->reciprocal) >> RECIPROCAL_BITS);
+      }
+   }
+
+   if(!e->primed)
+   {
+      e->altitude = z;
+      e->speed = 0;
+      e->primed = true;
+   }
+   else
+   {
+      predicted = e->altitude + ((e->speed * e->step * steps) >> TIME_FRAC_BITS);
+      residual = clamp(z - predicted);
+      e->altitude = predicted + ((residual * e->alpha) >> ALPHA_FRAC_BITS);
+      e->speed = clamp(e->speed + ((residual * e->rate) >> RATE_FRAC_BITS));
+   }
+   e->timestamp = sample->timestamp;
+
+   estimate->timestamp = sample->timestamp;
+   estimate->altitude = (int32_t)(e->altitude >> STATE_FRAC_BITS);
+   estimate->speed = (int32_t)(e->speed >> STATE_FRAC_BITS);
+   estimate->measured = (int32_t)(z >> STATE_FRAC_BITS);
+   return true;
+}
+
+void bmp180_estimator_reset(bmp180_estimator_t est)
+{
+   estimator_t *e = (estimator_t *) est;
+   if(NULL == e)
+      return;
+   e->primed = false;
+   e->timestamp = 0;
+}
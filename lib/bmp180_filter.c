@@ -0,0 +1,119 @@
+/* Copyright 2024 Zorxx Software. All rights reserved. */
+#include <string.h>
+#include "bmp180_private.h"
+
+bool bmp180_filter_init(t_bmp180_filter *f, const bmp180_filter_config_t *config)
+{
+   memset(f, 0, sizeof(*f));
+   if(NULL == config)
+      return true;
+
+   switch(config->type)
+   {
+      case BMP180_FILTER_NONE:
+         return true;
+      case BMP180_FILTER_BOXCAR:
+         break;
+      case BMP180_FILTER_CIC:
+         if(config->order < 1 || config->order > BMP180_FILTER_MAX_ORDER)
+         {
+            SERR("[%s] Invalid CIC order %u", __func__, config->order);
+            return false;
+         }
+         break;
+      case BMP180_FILTER_IIR:
+         if(config->iir_shift > 15)
+         {
+            SERR("[%s] Invalid IIR shift %u", __func__, config->iir_shift);
+            return false;
+         }
+         break;
+      default:
+         SERR("[%s] Invalid filter type %d", __func__, config->type);
+         return false;
+   }
+   if(config->decimation < 1)
+   {
+      SERR("[%s] Invalid decimation %u", __func__, config->decimation);
+      return false;
+   }
+   if(config->stage != BMP180_FILTER_STAGE_RAW && config->stage != BMP180_FILTER_STAGE_COMPENSATED)
+   {
+      SERR("[%s] Invalid filter stage %d", __func__, config->stage);
+      return false;
+   }
+
+   f->config = *config;
+   if(config->type == BMP180_FILTER_CIC)
+   {
+      /* The comb delay elements start at zero, so the first 'order' outputs
+         are a partial response */
+      f->warmup = config->order;
+      f->gain = 1;
+      for(int i = 0; i < config->order; ++i)
+         f->gain *= config->decimation;
+   }
+   return true;
+}
+
+bool bmp180_filter_push(t_bmp180_filter *f, int32_t x, int32_t *y)
+{
+   const bmp180_filter_config_t *c = &f->config;
+   int64_t out;
+
+   switch(c->type)
+   {
+      case BMP180_FILTER_BOXCAR:
+         f->acc += x;
+         if(++f->count < c->decimation)
+            return false;
+         out = (f->acc * (1 << BMP180_FILTER_FRAC_BITS)) / c->decimation;
+         f->acc = 0;
+         break;
+
+      case BMP180_FILTER_CIC:
+      {
+         uint64_t v;
+         f->integ[0] += (uint64_t)(int64_t) x;
+         for(int i = 1; i < c->order; ++i)
+            f->integ[i] += f->integ[i - 1];
+         if(++f->count < c->decimation)
+            return false;
+         v = f->integ[c->order - 1];
+         for(int i = 0; i < c->order; ++i)
+         {
+            uint64_t delayed = f->comb[i];
+            f->comb[i] = v;
+            v -= delayed;
+         }
+         out = ((int64_t) v * (1 << BMP180_FILTER_FRAC_BITS)) / f->gain;
+         break;
+      }
+
+      case BMP180_FILTER_IIR:
+         if(!f->primed)
+         {
+            f->acc = (int64_t) x * (1 << BMP180_FILTER_FRAC_BITS);
+            f->primed = true;
+         }
+         else
+            f->acc += ((int64_t) x * (1 << BMP180_FILTER_FRAC_BITS) - f->acc) >> c->iir_shift;
+         if(++f->count < c->decimation)
+            return false;
+         out = f->acc;
+         break;
+
+      default:
+         *y = x * (1 << BMP180_FILTER_FRAC_BITS);
+         return true;
+   }
+
+   f->count = 0;
+   if(f->warmup > 0)
+   {
+      --f->warmup;
+      return false;
+   }
+   *y = (int32_t) out;
+   return true;
+}
@@ -0,0 +1,214 @@
+/* Copyright 2024 Zorxx Software. All rights reserved. */
+#include <malloc.h>
+#include <string.h> /* memset */
+#include "bmp180/group.h"
+#include "bmp180_private.h"
+
+typedef struct
+{
+   size_t count;
+   bmp180_context_t *members[BMP180_GROUP_MAX_MEMBERS];
+   bmp180_group_stats_t stats;
+   uint64_t skew_sum;
+} group_t;
+
+static void group_account(group_t *g, uint32_t skew, uint32_t temperature_skew)
+{
+   bmp180_group_stats_t *st = &g->stats;
+   int bucket = 0;
+
+   while(bucket < BMP180_GROUP_SKEW_BUCKETS - 1 && skew >= (1u << bucket))
+      ++bucket;
+   ++st->skew_histogram[bucket];
+   if(st->samples == 0 || skew < st->skew_min)
+      st->skew_min = skew;
+   if(skew > st->skew_max)
+      st->skew_max = skew;
+   if(temperature_skew > st->temperature_skew_max)
+      st->temperature_skew_max = temperature_skew;
+   st->skew_last = skew;
+   g->skew_sum += skew;
+   ++st->samples;
+}
+
+/* Start one kind of conversion on every member, back to back; returns the number started */
+static size_t group_start(group_t *g, int kind, uint64_t *started)
+{
+   size_t i = 0;
+   while(i < g->count && bmp180_conversion_start(g->members[i], kind, &started[i]))
+      ++i;
+   return i;
+}
+
+/* Charge each member's budget for its part of a group sample started at 'now' */
+static void group_spend(group_t *g, uint64_t now)
+{
+   for(size_t i = 0; i < g->count; ++i)
+      bmp180_budget_spend(g->members[i], now);
+}
+
+/* One group sample; on failure, sets the index of the member that failed */
+static bool group_attempt(group_t *g, bmp180_group_sample_t *samples, size_t *failed)
+{
+   uint64_t started[BMP180_GROUP_MAX_MEMBERS];
+   uint32_t raw, skew, temperature_skew;
+   size_t i;
+
+   /* Temperature first, since pressure compensation needs it; all reads are done before
+      any pressure conversion starts, so the pressure starts are as close as possible */
+   if((i = group_start(g, BMP180_CONVERSION_TEMPERATURE, started)) < g->count)
+      goto fail;
+   temperature_skew = (uint32_t)(started[g->count - 1] - started[0]);
+   for(i = 0; i < g->count; ++i)
+   {
+      if(!bmp180_conversion_read(g->members[i], BMP180_CONVERSION_TEMPERATURE, started[i], &raw))
+         goto fail;
+      samples[i].sample.timestamp = started[i];
+      samples[i].sample.ut = (int32_t) raw;
+   }
+
+   if((i = group_start(g, BMP180_CONVERSION_PRESSURE, started)) < g->count)
+      goto fail;
+   skew = (uint32_t)(started[g->count - 1] - started[0]);
+   for(i = 0; i < g->count; ++i)
+   {
+      bmp180_context_t *ctx = g->members[i];
+      bmp180_group_sample_t *s = &samples[i];
+
+      if(!bmp180_conversion_read(ctx, BMP180_CONVERSION_PRESSURE, started[i], &raw))
+         goto fail;
+      s->pressure_start = started[i];
+      s->offset = (uint32_t)(started[i] - started[0]);
+      s->sample.up = (int32_t) raw;
+      s->sample.oss = ctx->mode;
+      if(bmp180_Compensate(&ctx->cal, s->sample.oss, s->sample.ut, s->sample.up,
+                           &s->sample.temperature, &s->sample.pressure) != 0)
+         goto fail;
+   }
+
+   group_account(g, skew, temperature_skew);
+   return true;
+
+fail:
+   *failed = i;
+   return false;
+}
+
+/* ----------------------------------------------------------------------------------------------
+ * Exported Functions
+ */
+
+bmp180_group_t bmp180_group_init(const bmp180_t *members, size_t count)
+{
+   group_t *g;
+
+   if(NULL == members || count == 0 || count > BMP180_GROUP_MAX_MEMBERS)
+   {
+      SERR("[%s] Invalid member count %zu", __func__, count);
+      return NULL;
+   }
+   for(size_t i = 0; i < count; ++i)
+   {
+      const bmp180_context_t *ctx = (const bmp180_context_t *) members[i];
+      if(NULL == ctx || NULL != ctx->backend)
+      {
+         SERR("[%s] Member %zu isn't an i2c device", __func__, i);
+         return NULL;
+      }
+   }
+
+   g = (group_t *) malloc(sizeof(*g));
+   if(NULL == g)
+   {
+      SERR("[%s] Memory allocation error", __func__);
+      return NULL;
+   }
+   memset(g, 0, sizeof(*g));
+   g->count = count;
+   for(size_t i = 0; i < count; ++i)
+      g->members[i] = (bmp180_context_t *) members[i];
+   return g;
+}
+
+bool bmp180_group_free(bmp180_group_t group)
+{
+   if(NULL == group)
+      return false;
+   free(group);
+   return true;
+}
+
+bool bmp180_group_sample(bmp180_group_t group, bmp180_group_sample_t *samples)
+{
+   group_t *g = (group_t *) group;
+   uint32_t attempts[BMP180_GROUP_MAX_MEMBERS] = { 0 };
+   uint64_t failed_at[BMP180_GROUP_MAX_MEMBERS], now;
+   size_t i;
+
+   if(NULL == g || NULL == samples)
+      return false;
+   for(i = 0; i < g->count; ++i)
+   {
+      bmp180_context_t *ctx = g->members[i];
+      if(ctx->filter.config.type != BMP180_FILTER_NONE)
+      {
+         SERR("[%s] Member %zu has a filter attached", __func__, i);
+         return false;
+      }
+      ctx->aborted = false;
+      ctx->pending_ut_valid = false;
+   }
+   /* Waiting for each member in turn leaves every member's budget satisfied at the end */
+   for(i = 0; i < g->count; ++i)
+   {
+      if(!bmp180_budget_wait(g->members[i], &now))
+         return false;
+   }
+
+   /* A failed member is recovered with its own policy, then the whole group sample is
+      retried, so that the conversions stay aligned */
+   while(!group_attempt(g, samples, &i))
+   {
+      bmp180_context_t *ctx = g->members[i];
+
+      SDBG("[%s] Member %zu failed", __func__, i);
+      ++ctx->stats.failures;
+      if(ctx->aborted || !bmp180_recover(ctx, attempts[i]))
+      {
+         ++g->stats.failures;
+         group_spend(g, now);
+         return false;
+      }
+      if(attempts[i]++ == 0)
+         failed_at[i] = sys_microsecond_tick();
+   }
+
+   for(i = 0; i < g->count; ++i)
+   {
+      if(attempts[i] > 0)
+         bmp180_recovered(g->members[i], failed_at[i]);
+      bmp180_sample_done(g->members[i], &samples[i].sample);
+   }
+   group_spend(g, now);
+   return true;
+}
+
+bool bmp180_group_get_stats(bmp180_group_t group, bmp180_group_stats_t *stats)
+{
+   group_t *g = (group_t *) group;
+   if(NULL == g || NULL == stats)
+      return false;
+   *stats = g->stats;
+   stats->skew_mean = (g->stats.samples > 0) ? (uint32_t)(g->skew_sum / g->stats.samples) : 0;
+   return true;
+}
+
+bool bmp180_group_reset_stats(bmp180_group_t group)
+{
+   group_t *g = (group_t *) group;
+   if(NULL == g)
+      return false;
+   memset(&g->stats, 0, sizeof(g->stats));
+   g->skew_sum = 0;
+   return true;
+}
@@ -0,0 +1,125 @@
+/* Copyright 2024 Zorxx Software. All rights reserved. */
+#include <string.h> /* memset */
+#include "bmp180_private.h"
+
+#define CH_TEMPERATURE 0
+#define CH_PRESSURE    1
+
+static void accumulate(t_bmp180_subscriber *s, const bmp180_sample_t *sample)
+{
+   if(s->count == 0)
+   {
+      s->start = sample->timestamp;
+      moments_reset(&s->moments[CH_TEMPERATURE], sample->temperature);
+      moments_reset(&s->moments[CH_PRESSURE], sample->pressure);
+   }
+   moments_add(&s->moments[CH_TEMPERATURE], sample->temperature);
+   moments_add(&s->moments[CH_PRESSURE], sample->pressure);
+   ++s->count;
+}
+
+/* Returns the sign of the change if the channel moved past its deadband, 0 otherwise */
+static int8_t channel_triggered(int32_t value, int32_t reported, int8_t direction,
+                                int32_t deadband, int32_t hysteresis)
+{
+   int32_t delta = value - reported;
+   int8_t sign = (delta > 0) ? 1 : -1;
+   int32_t threshold = deadband;
+
+   if(deadband <= 0 || delta == 0)
+      return 0;
+   if(direction != 0 && sign != direction)
+      threshold += hysteresis;
+   if(delta * sign <= threshold)
+      return 0;
+   return sign;
+}
+
+void bmp180_notify(bmp180_context_t *ctx, const bmp180_sample_t *sample)
+{
+   for(int n = 0; n < BMP180_MAX_SUBSCRIBERS; ++n)
+   {
+      t_bmp180_subscriber *s = &ctx->subscribers[n];
+      const bmp180_threshold_config_t *c = &s->config;
+      bmp180_event_t event;
+      int8_t t = 0, p = 0;
+
+      if(NULL == s->callback)
+         continue;
+
+      accumulate(s, sample);
+      event.reason = 0;
+      if(!s->reported)
+         event.reason |= BMP180_EVENT_FIRST;
+      else
+      {
+         t = channel_triggered(sample->temperature, s->last.temperature, s->direction[CH_TEMPERATURE],
+                               c->temperature_deadband, c->temperature_hysteresis);
+         p = channel_triggered(sample->pressure, s->last.pressure, s->direction[CH_PRESSURE],
+                               c->pressure_deadband, c->pressure_hysteresis);
+         if(t != 0)
+            event.reason |= BMP180_EVENT_TEMPERATURE;
+         if(p != 0)
+            event.reason |= BMP180_EVENT_PRESSURE;
+         if(c->heartbeat > 0 && sample->timestamp - s->last.timestamp >= c->heartbeat)
+            event.reason |= BMP180_EVENT_HEARTBEAT;
+      }
+      if(0 == event.reason)
+         continue;
+
+      event.sample = *sample;
+      event.suppressed = s->count - 1;
+      event.summary.start = s->start;
+      event.summary.end = sample->timestamp;
+      event.summary.count = s->count;
+      moments_summary(&s->moments[CH_TEMPERATURE], s->count, &event.summary.temperature);
+      moments_summary(&s->moments[CH_PRESSURE], s->count, &event.summary.pressure);
+
+      if(t != 0)
+         s->direction[CH_TEMPERATURE] = t;
+      if(p != 0)
+         s->direction[CH_PRESSURE] = p;
+      s->last = *sample;
+      s->reported = true;
+      s->count = 0;
+
+      s->callback(&event, s->arg);
+   }
+}
+
+/* --------------------------------------------------------------------------------------------------------
+ * Exported Functions
+ */
+
+int bmp180_subscribe(bmp180_t bmp, const bmp180_threshold_config_t *config,
+                     bmp180_event_cb callback, void *arg)
+{
+   bmp180_context_t *ctx = (bmp180_context_t *) bmp;
+   if(NULL == ctx || NULL == config || NULL == callback)
+      return -1;
+
+   for(int n = 0; n < BMP180_MAX_SUBSCRIBERS; ++n)
+   {
+      t_bmp180_subscriber *s = &ctx->subscribers[n];
+      if(NULL != s->callback)
+         continue;
+      memset(s, 0, sizeof(*s));
+      s->config = *config;
+      s->arg = arg;
+      s->callback = callback;
+      return n;
+   }
+
+   SERR("[%s] No free subscriber slots", __func__);
+   return -1;
+}
+
+bool bmp180_unsubscribe(bmp180_t bmp, int handle)
+{
+   bmp180_context_t *ctx = (bmp180_context_t *) bmp;
+   if(NULL == ctx || handle < 0 || handle >= BMP180_MAX_SUBSCRIBERS
+   || NULL == ctx->subscribers[handle].callback)
+      return false;
+   ctx->subscribers[handle].callback = NULL;
+   return true;
+}
@@ -3,8 +3,13 @@
 #define _BMP180_PRIVATE_H
 
 #include <stdint.h>
+#include <stdatomic.h>
 #include "helpers.h"
 #include "sys.h"
+#include "bmp180.h"
+#include "notify.h"
+#include "adaptive.h"
+#include "moments.h"
 
 /* -----------------------------------------------------------------
  * Register Definitions
@@ -22,6 +27,7 @@
 /* Values for BMP180_CONTROL_REG */
 #define BMP180_MEASURE_TEMP       0x2E
 #define BMP180_MEASURE_PRESS      0x34
+#define BMP180_CONTROL_SCO        0x20 /* set while a conversion is in progress */
 
 /* CHIP ID stored in BMP180_VERSION_REG */
 #define BMP180_CHIP_ID            0x55
@@ -53,8 +59,213 @@ typedef struct s_bmp180_calibration_data
 } t_bmp180_calibration_data;
 #pragma pack(pop)
 
+_Static_assert(sizeof(t_bmp180_calibration_data) == sizeof(bmp180_calibration_t),
+               "calibration layouts must match");
+
+/* -----------------------------------------------------------------
+ * Per-mode datasheet figures (Table 3)
+ */
+
+#define BMP180_TEMPERATURE_CONVERSION_TIME 4500 /* microseconds */
+#define BMP180_STARTUP_TIME                10000 /* microseconds, after power-on or soft reset */
+#define BMP180_TEMPERATURE_REUSE_TIME      1000000 /* microseconds a partial-progress temperature stays valid */
+#define BMP180_POLL_INTERVAL               250 /* microseconds between conversion-complete polls */
+
+/* Bus traffic, in bytes including address bytes: writing a register (address, register,
+   data), reading registers (address and register, then address and data), writing the
+   control register, and polling it */
+#define BMP180_WRITE_BYTES(length)         (2 + (length))
+#define BMP180_READ_BYTES(length)          (3 + (length))
+#define BMP180_START_BYTES                 BMP180_WRITE_BYTES(1)
+#define BMP180_POLL_BYTES                  BMP180_READ_BYTES(1)
+#define BMP180_BYTE_CLOCKS                 9 /* eight data bits and (N)ACK */
+
+typedef struct s_bmp180_mode_info
+{
+   uint32_t conversion_time;  /* pressure conversion time, microseconds */
+   uint16_t noise;            /* typical RMS pressure noise, Pa */
+   uint16_t current;          /* typical average current at one sample per second, uA */
+} t_bmp180_mode_info;
+
+extern const t_bmp180_mode_info bmp180_mode_info[BMP180_MODE_COUNT];
+
+/* -----------------------------------------------------------------
+ * Software filter
+ */
+
+#define BMP180_FILTER_FRAC_BITS   8  /* fractional bits carried by filter outputs */
+#define BMP180_FILTER_MAX_ORDER   4
+
+typedef struct s_bmp180_filter
+{
+   bmp180_filter_config_t config;
+   uint8_t count;      /* inputs accumulated towards the next output */
+   uint8_t warmup;     /* outputs remaining before the result is valid */
+   bool primed;        /* IIR state has been seeded */
+   int64_t acc;        /* boxcar sum, IIR state */
+   /* CIC integrators and comb delay elements; unsigned so that integrator
+      wrap-around is well-defined (it cancels in the combs) */
+   uint64_t integ[BMP180_FILTER_MAX_ORDER];
+   uint64_t comb[BMP180_FILTER_MAX_ORDER];
+   int64_t gain;       /* CIC gain, decimation^order */
+} t_bmp180_filter;
+
+bool bmp180_filter_init(t_bmp180_filter *f, const bmp180_filter_config_t *config);
+/* Returns true when an output is available in *y, in input units with
+   BMP180_FILTER_FRAC_BITS fractional bits */
+bool bmp180_filter_push(t_bmp180_filter *f, int32_t x, int32_t *y);
+
+/* -----------------------------------------------------------------
+ * Threshold event delivery
+ */
+
+typedef struct s_bmp180_subscriber
+{
+   bmp180_threshold_config_t config;
+   bmp180_event_cb callback;
+   void *arg;
+   bool reported;          /* an event has been delivered */
+   bmp180_sample_t last;   /* sample delivered in the previous event */
+   int8_t direction[2];    /* sign of the previous reported change (temperature, pressure) */
+   uint32_t count;         /* samples since the previous event */
+   t_moments moments[2];   /* statistics since the previous event (temperature, pressure) */
+   uint64_t start;
+} t_bmp180_subscriber;
+
+/* -----------------------------------------------------------------
+ * Adaptive mode controller
+ */
+
+typedef struct s_bmp180_adaptive
+{
+   bmp180_adaptive_config_t config;
+   bool enabled;
+   bool primed;          /* a previous sample is available */
+   int32_t prev[2];      /* previous two pressures, for the second difference */
+   uint32_t history;     /* samples observed since enabling (saturating) */
+   uint64_t prev_time;
+   int32_t rate;         /* EWMA of dP/dt, Pa/s */
+   uint32_t noise;       /* EWMA of RMS noise estimate, Pa * 16 */
+   uint32_t interval;    /* EWMA of the sample interval, microseconds */
+   bmp180_mode_t pending;
+   uint32_t pending_count;
+} t_bmp180_adaptive;
+
+/* -----------------------------------------------------------------
+ * Cost budget
+ */
+
+typedef struct s_bmp180_budget
+{
+   bmp180_budget_t config;
+   uint64_t ready[2];        /* earliest start allowed by each ceiling (charge, bus) */
+   uint64_t pending_charge;  /* nC accounted since the last bmp180_budget_spend() */
+   uint64_t pending_bytes;
+   bool refused;             /* the last measurement was refused */
+} t_bmp180_budget;
+
+/* -----------------------------------------------------------------
+ * Device context
+ */
+
+struct s_bmp180_context;
+
+/* Measurement backend other than the i2c driver (e.g. Linux IIO) */
+typedef struct s_bmp180_backend
+{
+   /* Take one sample (arg is a bmp180_sample_t *), honoring the deadline and cancellation */
+   bool (*sample)(struct s_bmp180_context *ctx, void *arg);
+   /* Release backend_ctx */
+   void (*release)(struct s_bmp180_context *ctx);
+} t_bmp180_backend;
+
+typedef struct s_bmp180_context
+{
+   i2c_lowlevel_config i2c_config;
+   i2c_lowlevel_context i2c_ctx;
+   uint32_t measurement_delay;
+   bmp180_mode_t mode;
+   t_bmp180_calibration_data cal;
+   t_bmp180_filter filter;
+   t_bmp180_subscriber subscribers[BMP180_MAX_SUBSCRIBERS];
+   t_bmp180_adaptive adaptive;
+   bmp180_stats_t stats;
+   uint64_t last_sample_time;
+   bmp180_recovery_config_t recovery;
+
+   /* Bus and conversion timing options, see bmp180_options_t */
+   uint32_t bus_speed;        /* Hz */
+   bmp180_margin_policy_t margin_policy;
+   uint32_t margin;
+   t_bmp180_budget budget;
+
+   /* Deadline and cancellation of the measurement in progress */
+   uint32_t i2c_timeout;      /* configured transaction timeout, milliseconds */
+   bool timeout_control;      /* a timeout was requested, so the library may change it */
+   uint32_t applied_timeout;  /* timeout currently set in the backend, milliseconds */
+   uint64_t deadline;         /* 0 for none */
+   atomic_bool cancel;
+   bool aborted;              /* the measurement hit its deadline or was cancelled */
+
+   /* Partial progress: temperature from a measurement that failed later on */
+   bool pending_ut_valid;
+   int32_t pending_ut;
+   uint64_t pending_ut_time;
+
+   /* NULL for the i2c driver */
+   const t_bmp180_backend *backend;
+   void *backend_ctx;
+} bmp180_context_t;
+
+/* Allocate and initialize a context, without a bus */
+bmp180_context_t *bmp180_context_alloc(bmp180_mode_t mode);
+bool bmp180_set_mode(bmp180_context_t *ctx, bmp180_mode_t mode);
+/* Check for cancellation, and that the deadline leaves room for a transaction followed by a
+   'wait' microsecond delay, bounding the transaction timeout by the time remaining.
+   Returns false to abandon the measurement. */
+bool bmp180_check_deadline(bmp180_context_t *ctx, uint32_t wait);
+/* Drop a bmp180_cancel() that no measurement consumed */
+void bmp180_cancel_reset(bmp180_context_t *ctx);
+/* Wait for 'us' microseconds, returning false (without waiting) if the wait would pass
+   the deadline, or early if the measurement is cancelled */
+bool bmp180_wait(bmp180_context_t *ctx, uint32_t us);
+
+/* Conversion phases, for callers that interleave conversions on several devices. A
+   conversion is started, then read once its time (with the margin policy) has passed
+   since 'started', the time the start command completed. */
+#define BMP180_CONVERSION_TEMPERATURE 0
+#define BMP180_CONVERSION_PRESSURE    1
+bool bmp180_conversion_start(bmp180_context_t *ctx, int kind, uint64_t *started);
+bool bmp180_conversion_read(bmp180_context_t *ctx, int kind, uint64_t started, uint32_t *raw);
+/* Statistics, events and adaptive mode control for a successful sample */
+void bmp180_sample_done(bmp180_context_t *ctx, const bmp180_sample_t *sample);
+void bmp180_notify(bmp180_context_t *ctx, const bmp180_sample_t *sample);
+void bmp180_adapt(bmp180_context_t *ctx, const bmp180_sample_t *sample);
+/* Prepare for retry number 'attempt' (starting at 0) after a failure; returns
+   false if the recovery policy is exhausted */
+bool bmp180_recover(bmp180_context_t *ctx, uint32_t attempt);
+/* Count a measurement that succeeded after failing first at 'failed_at' */
+void bmp180_recovered(bmp180_context_t *ctx, uint64_t failed_at);
+/* Worst-case duration of a sample in 'mode', as reported by bmp180_get_latency() */
+uint32_t bmp180_latency(const bmp180_context_t *ctx, bmp180_mode_t mode);
+/* Cost accounting: a transaction of 'bytes' bytes, and a conversion of 'time' microseconds
+   in the current mode */
+void bmp180_account_bus(bmp180_context_t *ctx, uint32_t bytes);
+void bmp180_account_conversion(bmp180_context_t *ctx, uint32_t time);
+/* Wait until the budget allows a measurement, setting the time the wait ended; false if
+   the measurement is refused (the wait would pass the deadline) or cancelled */
+bool bmp180_budget_wait(bmp180_context_t *ctx, uint64_t *now);
+/* Charge the costs accounted since the last call to the budget, for a measurement started
+   at 'started' */
+void bmp180_budget_spend(bmp180_context_t *ctx, uint64_t started);
+
 int bmp180_Compensate(t_bmp180_calibration_data *cal, uint8_t oss,
     int32_t uncompensatedTemperature, int32_t uncompensatedPressure,
    int32_t *temperature, int32_t *pressure);
+/* The two halves of bmp180_Compensate(), see bmp180_compensate_temperature() */
+int bmp180_compensate_stage(const t_bmp180_calibration_data *cal, uint8_t oss,
+   int32_t uncompensatedTemperature, bmp180_temperature_stage_t *stage);
+int bmp180_compensate_stage_pressure(const bmp180_temperature_stage_t *stage,
+   int32_t uncompensatedPressure, int32_t *pressure);
 
 #endif /* _BMP180_PRIVATE_H */
@@ -0,0 +1,84 @@
+/* Copyright 2024 Zorxx Software. All rights reserved. */
+#include "bmp180_private.h"
+
+static bool bmp180_soft_reset(bmp180_context_t *ctx)
+{
+   uint8_t value = BMP180_RESET_VALUE;
+   uint8_t id = 0;
+
+   if(!bmp180_check_deadline(ctx, BMP180_STARTUP_TIME))
+      return false;
+   bmp180_account_bus(ctx, BMP180_WRITE_BYTES(sizeof(value)));
+   if(!i2c_ll_write_reg(ctx->i2c_ctx, BMP180_RESET_REG, &value, sizeof(value)))
+      return false;
+   ++ctx->stats.soft_resets;
+   if(!bmp180_wait(ctx, BMP180_STARTUP_TIME) || !bmp180_check_deadline(ctx, 0))
+      return false;
+
+   /* The calibration EEPROM is unaffected by a reset; just confirm the device is back */
+   bmp180_account_bus(ctx, BMP180_READ_BYTES(sizeof(id)));
+   if(!i2c_ll_read_reg(ctx->i2c_ctx, BMP180_VERSION_REG, &id, sizeof(id)) || id != BMP180_CHIP_ID)
+   {
+      SERR("[%s] Device not responding after reset (id 0x%02x)", __func__, id);
+      return false;
+   }
+   return true;
+}
+
+bool bmp180_recover(bmp180_context_t *ctx, uint32_t attempt)
+{
+   const bmp180_recovery_config_t *c = &ctx->recovery;
+   uint64_t backoff;
+
+   if(attempt >= c->max_retries)
+      return false;
+
+   backoff = (attempt < 32) ? ((uint64_t) c->backoff << attempt) : UINT64_MAX;
+   if(c->max_backoff > 0 && backoff > c->max_backoff)
+      backoff = c->max_backoff;
+   if(backoff > 0 && !bmp180_wait(ctx, (uint32_t) backoff))
+      return false;
+   ++ctx->stats.retries;
+
+   /* The first retry assumes a transient error; after that, escalate (the i2c driver only) */
+   if(attempt == 0 || !c->soft_reset || NULL != ctx->backend)
+      return true;
+   if(bmp180_soft_reset(ctx))
+      return true;
+   if(ctx->aborted)
+      return false;
+   if(c->reopen)
+   {
+      SDBG("[%s] Reopening bus handle", __func__);
+      if(!i2c_ll_reopen(ctx->i2c_ctx))
+         return true; /* let the retry fail and count against the policy */
+      ++ctx->stats.reopens;
+      bmp180_soft_reset(ctx);
+   }
+   return true;
+}
+
+void bmp180_recovered(bmp180_context_t *ctx, uint64_t failed_at)
+{
+   uint64_t elapsed = sys_microsecond_tick() - failed_at;
+   ++ctx->stats.recoveries;
+   ctx->stats.recovery_time += elapsed;
+   if(elapsed > ctx->stats.max_recovery_time)
+      ctx->stats.max_recovery_time = (uint32_t) elapsed;
+}
+
+/* --------------------------------------------------------------------------------------------------------
+ * Exported Functions
+ */
+
+bool bmp180_set_recovery(bmp180_t bmp, const bmp180_recovery_config_t *config)
+{
+   bmp180_context_t *ctx = (bmp180_context_t *) bmp;
+   if(NULL == ctx)
+      return false;
+   if(NULL == config)
+      ctx->recovery.max_retries = 0;
+   else
+      ctx->recovery = *config;
+   return true;
+}
@@ -0,0 +1,94 @@
+/* Copyright 2024 Zorxx Software. All rights reserved. */
+#include <malloc.h>
+#include <stdatomic.h>
+#include "bmp180/ring.h"
+#include "helpers.h"
+
+typedef struct
+{
+   bmp180_sample_t *samples;
+   uint32_t mask;
+   atomic_uint head;    /* next slot to write; written by the producer only */
+   atomic_uint tail;    /* next slot to read; written by the consumer only */
+   atomic_ullong dropped;
+} ring_t;
+
+bmp180_ring_t bmp180_ring_init(uint32_t capacity)
+{
+   uint32_t size = 1;
+   ring_t *r;
+
+   if(capacity == 0 || capacity > 0x80000000UL)
+      return NULL;
+   while(size < capacity)
+      size <<= 1;
+
+   r = (ring_t *) malloc(sizeof(*r));
+   if(NULL == r)
+      return NULL;
+   r->samples = (bmp180_sample_t *) malloc(size * sizeof(bmp180_sample_t));
+   if(NULL == r->samples)
+   {
+      SERR("[%s] Memory allocation error", __func__);
+      free(r);
+      return NULL;
+   }
+   r->mask = size - 1;
+   atomic_init(&r->head, 0);
+   atomic_init(&r->tail, 0);
+   atomic_init(&r->dropped, 0);
+   return r;
+}
+
+bool bmp180_ring_free(bmp180_ring_t ring)
+{
+   ring_t *r = (ring_t *) ring;
+   if(NULL == r)
+      return false;
+   free(r->samples);
+   free(r);
+   return true;
+}
+
+bool bmp180_ring_push(bmp180_ring_t ring, const bmp180_sample_t *sample)
+{
+   ring_t *r = (ring_t *) ring;
+   uint32_t head = (uint32_t) atomic_load_explicit(&r->head, memory_order_relaxed);
+   uint32_t tail = (uint32_t) atomic_load_explicit(&r->tail, memory_order_acquire);
+
+   if(head - tail > r->mask)
+   {
+      atomic_fetch_add_explicit(&r->dropped, 1, memory_order_relaxed);
+      return false;
+   }
+   r->samples[head & r->mask] = *sample;
+   atomic_store_explicit(&r->head, (uint32_t)(head + 1), memory_order_release);
+   return true;
+}
+
+size_t bmp180_ring_pop(bmp180_ring_t ring, bmp180_sample_t *samples, size_t max)
+{
+   ring_t *r = (ring_t *) ring;
+   uint32_t tail = (uint32_t) atomic_load_explicit(&r->tail, memory_order_relaxed);
+   uint32_t head = (uint32_t) atomic_load_explicit(&r->head, memory_order_acquire);
+   size_t count = (uint32_t)(head - tail);
+
+   if(count > max)
+      count = max;
+   for(size_t i = 0; i < count; ++i)
+      samples[i] = r->samples[(tail + i) & r->mask];
+   atomic_store_explicit(&r->tail, (uint32_t)(tail + count), memory_order_release);
+   return count;
+}
+
+size_t bmp180_ring_count(bmp180_ring_t ring)
+{
+   ring_t *r = (ring_t *) ring;
+   return (uint32_t)(atomic_load(&r->head) - atomic_load(&r->tail));
+}
+
+uint64_t bmp180_ring_dropped(bmp180_ring_t ring)
+{
+   ring_t *r = (ring_t *) ring;
+   return atomic_load(&r->dropped);
+}
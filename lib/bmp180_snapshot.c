@@ -0,0 +1,283 @@
+/* Copyright 2024 Zorxx Software. All rights reserved. */
+#include <malloc.h>
+#include <inttypes.h>
+#include <string.h> /* memset, memcpy, memcmp */
+#include "bmp180/snapshot.h"
+#include "bmp180_private.h"
+
+#define DECODER_CHUNK          256  /* records unpacked per batch compensation pass */
+#define DECODER_INITIAL_SLOTS  16   /* calibration table slots; a power of two */
+
+typedef struct
+{
+   bool used;
+   uint32_t id;
+   bmp180_calibration_t cal;
+} calibration_slot_t;
+
+typedef struct
+{
+   calibration_slot_t *slots;
+   size_t capacity;             /* power of two */
+   bmp180_decoder_stats_t stats;
+} decoder_t;
+
+static void put_le(uint8_t *p, uint64_t value, int bytes)
+{
+   for(int i = 0; i < bytes; ++i)
+      p[i] = (uint8_t)(value >> (8 * i));
+}
+
+static uint64_t get_le(const uint8_t *p, int bytes)
+{
+   uint64_t value = 0;
+   for(int i = bytes - 1; i >= 0; --i)
+      value = (value << 8) | p[i];
+   return value;
+}
+
+/* FNV-1a over the exported image */
+static uint32_t calibration_id(const uint8_t *buf)
+{
+   uint32_t hash = 2166136261u;
+   for(int i = 0; i < BMP180_SNAPSHOT_CALIBRATION_SIZE; ++i)
+      hash = (hash ^ buf[i]) * 16777619u;
+   return hash;
+}
+
+/* Slot holding 'id', or the empty slot it would go in */
+static calibration_slot_t *decoder_slot(const decoder_t *d, uint32_t id)
+{
+   size_t i = id & (d->capacity - 1);
+   while(d->slots[i].used && d->slots[i].id != id)
+      i = (i + 1) & (d->capacity - 1);
+   return &d->slots[i];
+}
+
+static bool decoder_grow(decoder_t *d)
+{
+   calibration_slot_t *old = d->slots;
+   size_t old_capacity = d->capacity;
+
+   d->slots = (calibration_slot_t *) calloc(old_capacity * 2, sizeof(*d->slots));
+   if(NULL == d->slots)
+   {
+      d->slots = old;
+      return false;
+   }
+   d->capacity = old_capacity * 2;
+   for(size_t i = 0; i < old_capacity; ++i)
+   {
+      if(old[i].used)
+         *decoder_slot(d, old[i].id) = old[i];
+   }
+   free(old);
+   return true;
+}
+
+/* Compensate records [start, end) of a chunk, which share a device and oss */
+static size_t decoder_run(decoder_t *d, bmp180_decoded_t *decoded, const int32_t *ut, const int32_t *up,
+                          int32_t *temperature, int32_t *pressure, size_t start, size_t end)
+{
+   const calibration_slot_t *slot = decoder_slot(d, decoded[start].calibration_id);
+   uint8_t oss = decoded[start].sample.oss;
+   size_t n = end - start, valid = 0;
+
+   if(!slot->used)
+   {
+      d->stats.unknown_calibration += n;
+      return 0;
+   }
+   if(oss > BMP180_MODE_ULTRA_HIGH_RESOLUTION)
+   {
+      d->stats.invalid += n;
+      return 0;
+   }
+
+   if(bmp180_compensate_batch(&slot->cal, oss, ut + start, up + start, n, temperature + start, pressure + start))
+   {
+      for(size_t i = start; i < end; ++i)
+         decoded[i].valid = true;
+      valid = n;
+   }
+   else
+   {
+      /* Find the entries that don't compensate */
+      for(size_t i = start; i < end; ++i)
+      {
+         decoded[i].valid = bmp180_compensate_batch(&slot->cal, oss, ut + i, up + i, 1, temperature + i, pressure + i);
+         valid += decoded[i].valid ? 1 : 0;
+      }
+      d->stats.invalid += n - valid;
+   }
+   for(size_t i = start; i < end; ++i)
+   {
+      if(decoded[i].valid)
+      {
+         decoded[i].sample.temperature = temperature[i];
+         decoded[i].sample.pressure = pressure[i];
+      }
+   }
+   return valid;
+}
+
+/* ----------------------------------------------------------------------------------------------
+ * Exported Functions
+ */
+
+uint32_t bmp180_snapshot_export_calibration(const bmp180_calibration_t *cal, uint8_t *buf)
+{
+   t_bmp180_calibration_data c;
+
+   memcpy(c.raw, cal, sizeof(c.raw));
+   for(size_t i = 0; i < ARRAY_SIZE(c.raw); ++i)
+   {
+      buf[i * 2] = (uint8_t)(c.raw[i] >> 8);
+      buf[i * 2 + 1] = (uint8_t) c.raw[i];
+   }
+   return calibration_id(buf);
+}
+
+uint32_t bmp180_snapshot_import_calibration(const uint8_t *buf, bmp180_calibration_t *cal)
+{
+   t_bmp180_calibration_data c;
+
+   for(size_t i = 0; i < ARRAY_SIZE(c.raw); ++i)
+      c.raw[i] = ((uint16_t) buf[i * 2]) << 8 | buf[i * 2 + 1];
+   memcpy(cal, c.raw, sizeof(c.raw));
+   return calibration_id(buf);
+}
+
+void bmp180_snapshot_pack(const bmp180_sample_t *sample, uint32_t calibration_id, uint8_t *record)
+{
+   put_le(record, sample->timestamp, 6);
+   record[6] = sample->oss;
+   put_le(record + 7, (uint16_t) sample->ut, 2);
+   put_le(record + 9, (uint32_t) sample->up, 3);
+   put_le(record + 12, calibration_id, 4);
+}
+
+uint32_t bmp180_snapshot_unpack(const uint8_t *record, bmp180_sample_t *sample)
+{
+   sample->timestamp = get_le(record, 6);
+   sample->oss = record[6];
+   sample->ut = (int32_t) get_le(record + 7, 2);
+   sample->up = (int32_t) get_le(record + 9, 3);
+   sample->temperature = 0;
+   sample->pressure = 0;
+   return (uint32_t) get_le(record + 12, 4);
+}
+
+bmp180_decoder_t bmp180_decoder_init(void)
+{
+   decoder_t *d = (decoder_t *) malloc(sizeof(*d));
+   if(NULL == d)
+   {
+      SERR("[%s] Memory allocation error", __func__);
+      return NULL;
+   }
+   memset(d, 0, sizeof(*d));
+   d->capacity = DECODER_INITIAL_SLOTS;
+   d->slots = (calibration_slot_t *) calloc(d->capacity, sizeof(*d->slots));
+   if(NULL == d->slots)
+   {
+      SERR("[%s] Memory allocation error", __func__);
+      free(d);
+      return NULL;
+   }
+   return d;
+}
+
+bool bmp180_decoder_free(bmp180_decoder_t dec)
+{
+   decoder_t *d = (decoder_t *) dec;
+   if(NULL == d)
+      return false;
+   free(d->slots);
+   free(d);
+   return true;
+}
+
+bool bmp180_decoder_add_calibration(bmp180_decoder_t dec, const uint8_t *buf)
+{
+   decoder_t *d = (decoder_t *) dec;
+   calibration_slot_t *slot;
+   bmp180_calibration_t cal;
+   uint32_t id;
+
+   if(NULL == d || NULL == buf)
+      return false;
+   id = bmp180_snapshot_import_calibration(buf, &cal);
+   slot = decoder_slot(d, id);
+   if(slot->used)
+   {
+      if(memcmp(&slot->cal, &cal, sizeof(cal)) == 0)
+         return true;
+      SERR("[%s] Calibration ID 0x%08" PRIx32 " is already in use", __func__, id);
+      return false;
+   }
+
+   /* Keep the table at most three quarters full */
+   if((d->stats.calibrations + 1) * 4 > d->capacity * 3)
+   {
+      if(!decoder_grow(d))
+      {
+         SERR("[%s] Memory allocation error", __func__);
+         return false;
+      }
+      slot = decoder_slot(d, id);
+   }
+   slot->used = true;
+   slot->id = id;
+   slot->cal = cal;
+   ++d->stats.calibrations;
+   return true;
+}
+
+size_t bmp180_decoder_decode(bmp180_decoder_t dec, const uint8_t *records, size_t count,
+                             bmp180_decoded_t *decoded)
+{
+   decoder_t *d = (decoder_t *) dec;
+   int32_t ut[DECODER_CHUNK], up[DECODER_CHUNK], temperature[DECODER_CHUNK], pressure[DECODER_CHUNK];
+   size_t valid = 0;
+
+   if(NULL == d || (count > 0 && (NULL == records || NULL == decoded)))
+      return 0;
+
+   for(size_t base = 0; base < count; base += DECODER_CHUNK)
+   {
+      size_t n = (count - base < DECODER_CHUNK) ? count - base : DECODER_CHUNK;
+      bmp180_decoded_t *out = decoded + base;
+      size_t start = 0;
+
+      for(size_t i = 0; i < n; ++i)
+      {
+         out[i].calibration_id = bmp180_snapshot_unpack(records + (base + i) * BMP180_SNAPSHOT_RECORD_SIZE,
+                                                        &out[i].sample);
+         out[i].valid = false;
+         ut[i] = out[i].sample.ut;
+         up[i] = out[i].sample.up;
+      }
+
+      /* Runs of records from the same device with the same oss */
+      for(size_t i = 1; i <= n; ++i)
+      {
+         if(i < n && out[i].calibration_id == out[start].calibration_id
+         && out[i].sample.oss == out[start].sample.oss)
+            continue;
+         valid += decoder_run(d, out, ut, up, temperature, pressure, start, i);
+         start = i;
+      }
+   }
+   d->stats.records += count;
+   return valid;
+}
+
+bool bmp180_decoder_get_stats(bmp180_decoder_t dec, bmp180_decoder_stats_t *stats)
+{
+   decoder_t *d = (decoder_t *) dec;
+   if(NULL == d || NULL == stats)
+      return false;
+   *stats = d->stats;
+   return true;
+}
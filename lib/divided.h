@@ -0,0 +1,37 @@
+/*! \copyright 2024 Zorxx Software. All rights reserved.
+ *  \license This file is released under the MIT License. See the LICENSE file for details.
+ *  \brief Reference pressure stage with a plain division, shared by the sweep and bmp180ctl
+ *
+ *  This is bmp180_compensate_pressure() with the division by B4 done directly instead of by
+ *  the reciprocal; the sweep checks the two against each other and bmp180ctl times both.
+ */
+#ifndef _BMP180_DIVIDED_H
+#define _BMP180_DIVIDED_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "bmp180/bmp180.h"
+
+static inline bool bmp180_divided_pressure(const bmp180_temperature_stage_t *stage, int32_t up,
+                                           int32_t *pressure)
+{
+   int32_t X1, X2, P;
+   uint32_t B7;
+
+   if(NULL == stage || 0 == stage->B4)
+      return false;
+   B7 = ((uint32_t) up - stage->B3) * (uint32_t)(50000UL >> stage->oss);
+   if(B7 < 0x80000000UL)
+      P = (B7 * 2) / stage->B4;
+   else
+      P = (B7 / stage->B4) * 2;
+   X1 = (P >> 8) * (P >> 8);
+   X1 = (X1 * 3038) >> 16;
+   X2 = (-7357 * P) >> 16;
+   P += (X1 + X2 + (int32_t) 3791) >> 4;
+   *pressure = P;
+   return true;
+}
+
+#endif /* _BMP180_DIVIDED_H */
@@ -16,6 +16,7 @@ typedef struct
    i2c_master_bus_handle_t bus;
    bool bus_created;
    i2c_master_dev_handle_t device;
+   i2c_device_config_t dev_cfg;
    uint32_t timeout;
 } esp_i2c_t;
 
@@ -41,6 +42,7 @@ i2c_lowlevel_context SYS_WEAK i2c_ll_init(uint8_t i2c_address, uint32_t i2c_spee
    if(NULL == l)
       return NULL; 
    memcpy(&l->config, config, sizeof(l->config));
+   l->dev_cfg = dev_cfg;
    l->timeout = i2c_timeout_ms;
 
    if(NULL == config->bus)
@@ -84,10 +86,31 @@ bool SYS_WEAK i2c_ll_deinit(i2c_lowlevel_context ctx)
    return true;
 }
 
+bool SYS_WEAK i2c_ll_reopen(i2c_lowlevel_context ctx)
+{
+   esp_i2c_t *l = (esp_i2c_t *) ctx;
+   i2c_master_bus_rm_device(l->device);
+   if(i2c_master_bus_reset(*l->config.bus) != ESP_OK)
+      SERR("I2C bus reset failed");
+   if(i2c_master_bus_add_device(*l->config.bus, &l->dev_cfg, &l->device) != ESP_OK)
+   {
+      SERR("I2C device re-initialization failed");
+      return false;
+   }
+   return true;
+}
+
+bool SYS_WEAK i2c_ll_set_timeout(i2c_lowlevel_context ctx, uint32_t i2c_timeout_ms)
+{
+   esp_i2c_t *l = (esp_i2c_t *) ctx;
+   l->timeout = i2c_timeout_ms;
+   return true;
+}
+
 bool SYS_WEAK i2c_ll_write(i2c_lowlevel_context ctx, uint8_t *data, uint8_t length)
 {
    esp_i2c_t *l = (esp_i2c_t *) ctx;
-   return (i2c_master_transmit(l->device, data, length, -1) == ESP_OK);
+   return (i2c_master_transmit(l->device, data, length, (int) l->timeout) == ESP_OK);
 }
 
 bool SYS_WEAK i2c_ll_write_reg(i2c_lowlevel_context ctx, uint8_t reg, uint8_t *data, uint8_t length)
@@ -102,7 +125,7 @@ bool SYS_WEAK i2c_ll_write_reg(i2c_lowlevel_context ctx, uint8_t reg, uint8_t *d
 
    buffer[0] = reg;
    memcpy(&buffer[1], data, length);
-   result = i2c_master_transmit(l->device, buffer, length+1, -1);
+   result = i2c_master_transmit(l->device, buffer, length+1, (int) l->timeout);
    free(buffer);
 
    return (result == ESP_OK);
@@ -111,13 +134,13 @@ bool SYS_WEAK i2c_ll_write_reg(i2c_lowlevel_context ctx, uint8_t reg, uint8_t *d
 bool SYS_WEAK i2c_ll_read(i2c_lowlevel_context ctx, uint8_t *data, uint8_t length)
 {
    esp_i2c_t *l = (esp_i2c_t *) ctx;
-   return (i2c_master_receive(l->device, data, length, -1) == ESP_OK);
+   return (i2c_master_receive(l->device, data, length, (int) l->timeout) == ESP_OK);
 }
 
 bool SYS_WEAK i2c_ll_read_reg(i2c_lowlevel_context ctx, uint8_t reg, uint8_t *data, uint8_t length)
 {
    esp_i2c_t *l = (esp_i2c_t *) ctx;
-   return (i2c_master_transmit_receive(l->device, &reg, 1, data, length, -1) == ESP_OK);
+   return (i2c_master_transmit_receive(l->device, &reg, 1, data, length, (int) l->timeout) == ESP_OK);
 }
 
 mutex_lowlevel SYS_WEAK sys_mutex_init(void)
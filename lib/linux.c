@@ -15,11 +15,19 @@
 #include "sys_linux.h"
 #include "sys.h"
 #include "helpers.h"
+#include "trace.h"
+#if defined(SYS_SIM_ENABLE)
+   #include "sim_private.h"
+#endif
 
 typedef struct linux_rtci2c_s
 {
     char *device;
     int handle;
+#if defined(SYS_SIM_ENABLE)
+    sim_handle sim;  /* non-NULL for simulated devices */
+#endif
+    uint8_t address;
     uint32_t timeout;
 } linux_i2c_t;
 
@@ -28,6 +36,70 @@ typedef struct linux_mutex_s
    pthread_mutex_t mutex;
 } linux_mutex_t;
 
+static int linux_i2c_apply_timeout(linux_i2c_t *l)
+{
+#if defined(SYS_SIM_ENABLE)
+   if(NULL != l->sim)
+   {
+      sim_set_timeout(l->sim, l->timeout);
+      return 0;
+   }
+#endif
+   /* The timeout is adapter-wide, so this changes it for every user of the adapter. It is
+      specified in units of 10 ms; round up, since 0 would select the adapter's default */
+   if(ioctl(l->handle, I2C_TIMEOUT, (unsigned long)((l->timeout + 9) / 10)) < 0)
+   {
+      SERR("[%s] Failed to set timeout to %u ms (errno %d)", __func__, l->timeout, errno);
+      return -1;
+   }
+   return 0;
+}
+
+static int linux_i2c_open(linux_i2c_t *l)
+{
+#if defined(SYS_SIM_ENABLE)
+   if(sim_is_device(l->device))
+   {
+      l->sim = sim_open(l->device, l->address);
+      if(NULL == l->sim)
+      {
+         SERR("[%s] Failed to open simulated device '%s'", __func__, l->device);
+         return -1;
+      }
+      linux_i2c_apply_timeout(l);
+      return 0;
+   }
+#endif
+
+   l->handle = open(l->device, O_RDWR);
+   if(l->handle < 0)
+   {
+      SERR("[%s] Failed to open device '%s'", __func__, l->device);
+      return -1;
+   }
+   if(ioctl(l->handle, I2C_SLAVE, l->address) < 0)
+   {
+      SERR("[%s] Failed to set I2C slave address to 0x%02x", __func__, l->address);
+      close(l->handle);
+      l->handle = -1;
+      return -1;
+   }
+   /* The adapter's timeout is left alone until i2c_ll_set_timeout() */
+   return 0;
+}
+
+static void linux_i2c_close(linux_i2c_t *l)
+{
+#if defined(SYS_SIM_ENABLE)
+   if(NULL != l->sim)
+      sim_close(l->sim);
+   l->sim = NULL;
+#endif
+   if(l->handle >= 0)
+      close(l->handle);
+   l->handle = -1;
+}
+
 i2c_lowlevel_context SYS_WEAK i2c_ll_init(uint8_t i2c_address, uint32_t i2c_speed, uint32_t i2c_timeout_ms,
                                           i2c_lowlevel_config *config)
 {
@@ -42,6 +114,10 @@ i2c_lowlevel_context SYS_WEAK i2c_ll_init(uint8_t i2c_address, uint32_t i2c_spee
    }
 
    l->handle = -1;
+#if defined(SYS_SIM_ENABLE)
+   l->sim = NULL;
+#endif
+   l->address = i2c_address;
    l->timeout = i2c_timeout_ms;
    l->device = strdup(config->device);
    if(NULL == l->device)
@@ -49,24 +125,11 @@ i2c_lowlevel_context SYS_WEAK i2c_ll_init(uint8_t i2c_address, uint32_t i2c_spee
       SERR("[%s] Memory allocation error", __func__);
    }
    else
-   {
-      l->handle = open(l->device, O_RDWR);
-      if(l->handle < 0)
-      {
-         SERR("[%s] Failed to open device '%s'", __func__, l->device);
-      }
-      else if(ioctl(l->handle, I2C_SLAVE, i2c_address) < 0)
-      {
-         SERR("[%s] Failed to set I2C slave address to 0x%02x", __func__, i2c_address);
-      }
-      else
-         result = 0;
-   }
+      result = linux_i2c_open(l);
 
    if(0 != result)
    {
-      if(l->handle >= 0)
-         close(l->handle);
+      free(l->device);
       free(l);
       l = NULL;
    }
@@ -81,8 +144,7 @@ bool SYS_WEAK i2c_ll_deinit(i2c_lowlevel_context ctx)
    if(NULL == l)
       return true;
 
-   if(l->handle >= 0)
-      close(l->handle);
+   linux_i2c_close(l);
    if(NULL != l->device)
       free(l->device);
    free(l);
@@ -90,13 +152,37 @@ bool SYS_WEAK i2c_ll_deinit(i2c_lowlevel_context ctx)
    return true;
 }
 
-bool SYS_WEAK i2c_ll_write_reg(i2c_lowlevel_context ctx, uint8_t reg, uint8_t *data, uint8_t length)
+bool SYS_WEAK i2c_ll_reopen(i2c_lowlevel_context ctx)
+{
+   linux_i2c_t *l = (linux_i2c_t *) ctx;
+   uint64_t start = STRACE_TIME(i2c_reopen);
+   bool result;
+
+   linux_i2c_close(l);
+   result = (linux_i2c_open(l) == 0);
+   STRACE(i2c_reopen, ctx, result, start, sys_microsecond_tick());
+   return result;
+}
+
+bool SYS_WEAK i2c_ll_set_timeout(i2c_lowlevel_context ctx, uint32_t i2c_timeout_ms)
+{
+   linux_i2c_t *l = (linux_i2c_t *) ctx;
+   l->timeout = i2c_timeout_ms;
+   return (linux_i2c_apply_timeout(l) == 0);
+}
+
+static bool linux_i2c_write_reg(i2c_lowlevel_context ctx, uint8_t reg, uint8_t *data, uint8_t length)
 {
    linux_i2c_t *l = (linux_i2c_t *) ctx;
    struct i2c_smbus_ioctl_data args;
    union i2c_smbus_data smdata;
    int result = -EINVAL;
 
+#if defined(SYS_SIM_ENABLE)
+   if(NULL != l->sim)
+      return sim_write_reg(l->sim, reg, data, length);
+#endif
+
    if(length > I2C_SMBUS_BLOCK_MAX)
    {
       SERR("[%s] Data length overflow (%u bytes)", __func__, length);
@@ -121,10 +207,15 @@ bool SYS_WEAK i2c_ll_write_reg(i2c_lowlevel_context ctx, uint8_t reg, uint8_t *d
    return false;
 }
 
-bool SYS_WEAK i2c_ll_write(i2c_lowlevel_context ctx, uint8_t *data, uint8_t length)
+static bool linux_i2c_write(i2c_lowlevel_context ctx, uint8_t *data, uint8_t length)
 {
    linux_i2c_t *l = (linux_i2c_t *) ctx;
-   int result = write(l->handle, data, length);
+   int result;
+#if defined(SYS_SIM_ENABLE)
+   if(NULL != l->sim)
+      return (length > 0) && sim_write_reg(l->sim, data[0], &data[1], length - 1);
+#endif
+   result = write(l->handle, data, length);
    if(length == result)
    {
       SDBG("[%s] Success (%u bytes)", __func__, length);
@@ -135,13 +226,18 @@ bool SYS_WEAK i2c_ll_write(i2c_lowlevel_context ctx, uint8_t *data, uint8_t leng
    return false;
 }
 
-bool SYS_WEAK i2c_ll_read_reg(i2c_lowlevel_context ctx, uint8_t reg, uint8_t *data, uint8_t length)
+static bool linux_i2c_read_reg(i2c_lowlevel_context ctx, uint8_t reg, uint8_t *data, uint8_t length)
 {
    linux_i2c_t *l = (linux_i2c_t *) ctx;
    struct i2c_smbus_ioctl_data args;
    union i2c_smbus_data smdata;
    int result = -EINVAL;
 
+#if defined(SYS_SIM_ENABLE)
+   if(NULL != l->sim)
+      return sim_read_reg(l->sim, reg, data, length);
+#endif
+
    if(length > I2C_SMBUS_BLOCK_MAX)
    {
       SERR("[%s] Data length overflow (%u bytes)", __func__, length);
@@ -167,10 +263,18 @@ bool SYS_WEAK i2c_ll_read_reg(i2c_lowlevel_context ctx, uint8_t reg, uint8_t *da
    return false;
 }
 
-bool SYS_WEAK i2c_ll_read(i2c_lowlevel_context ctx, uint8_t *data, uint8_t length)
+static bool linux_i2c_read(i2c_lowlevel_context ctx, uint8_t *data, uint8_t length)
 {
    linux_i2c_t *l = (linux_i2c_t *) ctx;
-   int result = read(l->handle, data, length);
+   int result;
+#if defined(SYS_SIM_ENABLE)
+   if(NULL != l->sim)
+   {
+      SERR("[%s] Register-less reads are not simulated", __func__);
+      return false;
+   }
+#endif
+   result = read(l->handle, data, length);
    if(length == result)
    {
       SDBG("[%s] Success (%u bytes)", __func__, length);
@@ -182,6 +286,40 @@ bool SYS_WEAK i2c_ll_read(i2c_lowlevel_context ctx, uint8_t *data, uint8_t lengt
    return false;
 }
 
+/* Traced entry points; the probes see simulated and real transfers alike */
+
+bool SYS_WEAK i2c_ll_write_reg(i2c_lowlevel_context ctx, uint8_t reg, uint8_t *data, uint8_t length)
+{
+   uint64_t start = STRACE_TIME(i2c_write);
+   bool result = linux_i2c_write_reg(ctx, reg, data, length);
+   STRACE(i2c_write, ctx, (int) reg, length, result, start, sys_microsecond_tick());
+   return result;
+}
+
+bool SYS_WEAK i2c_ll_write(i2c_lowlevel_context ctx, uint8_t *data, uint8_t length)
+{
+   uint64_t start = STRACE_TIME(i2c_write);
+   bool result = linux_i2c_write(ctx, data, length);
+   STRACE(i2c_write, ctx, -1, length, result, start, sys_microsecond_tick());
+   return result;
+}
+
+bool SYS_WEAK i2c_ll_read_reg(i2c_lowlevel_context ctx, uint8_t reg, uint8_t *data, uint8_t length)
+{
+   uint64_t start = STRACE_TIME(i2c_read);
+   bool result = linux_i2c_read_reg(ctx, reg, data, length);
+   STRACE(i2c_read, ctx, (int) reg, length, result, start, sys_microsecond_tick());
+   return result;
+}
+
+bool SYS_WEAK i2c_ll_read(i2c_lowlevel_context ctx, uint8_t *data, uint8_t length)
+{
+   uint64_t start = STRACE_TIME(i2c_read);
+   bool result = linux_i2c_read(ctx, data, length);
+   STRACE(i2c_read, ctx, -1, length, result, start, sys_microsecond_tick());
+   return result;
+}
+
 mutex_lowlevel SYS_WEAK sys_mutex_init(void)
 {
    linux_mutex_t *ctx = malloc(sizeof(*ctx));
@@ -0,0 +1,146 @@
+/*! \copyright 2024 Zorxx Software. All rights reserved.
+ *  \license This file is released under the MIT License. See the LICENSE file for details.
+ *  \brief Parallel BMP180 discovery, Linux implementation
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <glob.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "bmp180/discover.h"
+#include "helpers.h"
+
+typedef struct
+{
+   const bmp180_discover_config_t *config;
+   const char *device;
+   const uint8_t *addresses;
+   size_t address_count;
+   pthread_t thread;
+   bool started;
+   bmp180_discovered_t *found;   /* one slot per address */
+   size_t count;
+} bus_worker_t;
+
+static const uint8_t default_address = BMP180_DEVICE_ADDRESS;
+
+/* Adapters created by a kernel i2c-mux driver have a 'mux_device' link in sysfs */
+static bool is_mux_channel(const char *device)
+{
+   const char *name = strrchr(device, '/');
+   char path[128];
+
+   if(NULL == name || strncmp(name, "/i2c-", 5) != 0)
+      return false;
+   snprintf(path, sizeof(path), "/sys/class/i2c-adapter%s/mux_device", name);
+   return access(path, F_OK) == 0;
+}
+
+static void *bus_worker(void *arg)
+{
+   bus_worker_t *w = (bus_worker_t *) arg;
+   i2c_lowlevel_config config;
+
+   config.device = w->device;
+   for(size_t i = 0; i < w->address_count; ++i)
+   {
+      bmp180_t bmp = bmp180_init(&config, w->addresses[i], w->config->mode);
+      if(NULL == bmp)
+         continue;
+
+      bmp180_discovered_t *d = &w->found[w->count++];
+      d->bmp = bmp;
+      snprintf(d->device, sizeof(d->device), "%s", w->device);
+      d->address = w->addresses[i];
+      d->mux_channel = is_mux_channel(w->device);
+      SDBG("[%s] Found device at %s:0x%02x", __func__, w->device, w->addresses[i]);
+   }
+   return NULL;
+}
+
+/* Sort /dev/i2c-N by adapter number rather than lexically */
+static int adapter_compare(const void *a, const void *b)
+{
+   const char *pa = strrchr(*(const char **) a, '-');
+   const char *pb = strrchr(*(const char **) b, '-');
+   return atoi(pa + 1) - atoi(pb + 1);
+}
+
+size_t bmp180_discover(const bmp180_discover_config_t *config, bmp180_discovered_t *found, size_t max,
+                       uint64_t *elapsed)
+{
+   uint64_t start = bmp180_now();
+   const char **devices;
+   size_t device_count;
+   const uint8_t *addresses;
+   size_t address_count;
+   bus_worker_t *workers = NULL;
+   glob_t g = { 0 };
+   bool globbed = false;
+   size_t total = 0;
+
+   if(NULL == config || (NULL == found && max > 0))
+      return 0;
+
+   devices = config->devices;
+   device_count = config->device_count;
+   if(NULL == devices)
+   {
+      if(glob("/dev/i2c-*", 0, NULL, &g) != 0)
+      {
+         SERR("[%s] No I2C adapters found", __func__);
+         return 0;
+      }
+      globbed = true;
+      qsort(g.gl_pathv, g.gl_pathc, sizeof(char *), adapter_compare);
+      devices = (const char **) g.gl_pathv;
+      device_count = g.gl_pathc;
+   }
+   addresses = (NULL == config->addresses) ? &default_address : config->addresses;
+   address_count = (NULL == config->addresses) ? 1 : config->address_count;
+
+   workers = (bus_worker_t *) calloc(device_count, sizeof(*workers));
+   if(NULL == workers)
+      goto done;
+   for(size_t i = 0; i < device_count; ++i)
+   {
+      bus_worker_t *w = &workers[i];
+      w->config = config;
+      w->device = devices[i];
+      w->addresses = addresses;
+      w->address_count = address_count;
+      w->found = (bmp180_discovered_t *) calloc(address_count, sizeof(bmp180_discovered_t));
+      if(NULL == w->found)
+         continue;
+      w->started = (pthread_create(&w->thread, NULL, bus_worker, w) == 0);
+      if(!w->started)
+      {
+         SERR("[%s] Failed to start worker for %s, probing inline", __func__, w->device);
+         bus_worker(w);
+      }
+   }
+
+   for(size_t i = 0; i < device_count; ++i)
+   {
+      bus_worker_t *w = &workers[i];
+      if(w->started)
+         pthread_join(w->thread, NULL);
+      for(size_t n = 0; n < w->count; ++n)
+      {
+         if(total < max)
+            found[total++] = w->found[n];
+         else
+            bmp180_free(w->found[n].bmp);
+      }
+      free(w->found);
+   }
+   free(workers);
+
+done:
+   if(globbed)
+      globfree(&g);
+   if(NULL != elapsed)
+      *elapsed = bmp180_now() - start;
+   return total;
+}
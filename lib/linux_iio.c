@@ -0,0 +1,516 @@
+/*! \copyright 2024 Zorxx Software. All rights reserved.
+ *  \license This file is released under the MIT License. See the LICENSE file for details.
+ *  \brief Linux IIO backend
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <dirent.h>
+#include <unistd.h>
+#include "bmp180/iio.h"
+#include "bmp180_private.h"
+
+#define IIO_DEFAULT_BATCH 64
+#define IIO_POLL_SLICE    10    /* milliseconds between cancellation checks */
+#define IIO_PATH_MAX      256
+
+#define CH_PRESSURE  0
+#define CH_TEMP      1
+#define CH_TIMESTAMP 2
+#define CH_COUNT     3
+
+typedef struct
+{
+   bool enabled;
+   int index;          /* position in the scan */
+   bool is_signed;
+   bool big_endian;
+   uint32_t bits;      /* significant bits */
+   uint32_t bytes;     /* storage size */
+   uint32_t shift;
+   uint32_t offset;    /* byte offset within a scan */
+   double scale;       /* processed = (raw + bias) * scale */
+   double bias;
+} iio_channel_t;
+
+typedef struct
+{
+   char device[IIO_PATH_MAX];
+   int fd;
+   iio_channel_t ch[CH_COUNT];
+   uint32_t scan_size;
+   uint8_t *buf;
+   size_t capacity;    /* bytes */
+   size_t pos;         /* next unconsumed byte */
+   size_t fill;        /* bytes in buf */
+} iio_t;
+
+static const char *channel_names[CH_COUNT] = { "in_pressure", "in_temp", "in_timestamp" };
+
+/* ----------------------------------------------------------------------------------------------
+ * sysfs
+ */
+
+/* Build "dir/name" in an IIO_PATH_MAX buffer, failing if it doesn't fit */
+static bool path_join(char *path, const char *dir, const char *name)
+{
+   int length = snprintf(path, IIO_PATH_MAX, "%s/%s", dir, name);
+   if(length < 0 || length >= IIO_PATH_MAX)
+   {
+      SERR("[%s] Path too long: %s/%s", __func__, dir, name);
+      return false;
+   }
+   return true;
+}
+
+static bool sysfs_write(const char *dir, const char *name, const char *value)
+{
+   char path[IIO_PATH_MAX];
+   size_t length = strlen(value);
+   bool success;
+   int fd;
+
+   if(!path_join(path, dir, name))
+      return false;
+   fd = open(path, O_WRONLY | O_TRUNC);
+   if(fd < 0)
+      return false;
+   success = (write(fd, value, length) == (ssize_t) length);
+   close(fd);
+   if(!success)
+   {
+      SERR("[%s] Failed to write '%s' to %s (errno %d)", __func__, value, path, errno);
+   }
+   return success;
+}
+
+static bool sysfs_write_u32(const char *dir, const char *name, uint32_t value)
+{
+   char s[16];
+   snprintf(s, sizeof(s), "%u", value);
+   return sysfs_write(dir, name, s);
+}
+
+/* Reads the attribute without its trailing newline */
+static bool sysfs_read(const char *dir, const char *name, char *value, size_t size)
+{
+   char path[IIO_PATH_MAX];
+   ssize_t length;
+   int fd;
+
+   if(!path_join(path, dir, name))
+      return false;
+   fd = open(path, O_RDONLY);
+   if(fd < 0)
+      return false;
+   length = read(fd, value, size - 1);
+   close(fd);
+   if(length < 0)
+      return false;
+   while(length > 0 && (value[length - 1] == '\n' || value[length - 1] == ' '))
+      --length;
+   value[length] = '\0';
+   return true;
+}
+
+static bool sysfs_exists(const char *dir, const char *name)
+{
+   char path[IIO_PATH_MAX];
+   return path_join(path, dir, name) && access(path, F_OK) == 0;
+}
+
+/* Find the trigger named 'name' among the device's siblings and set its frequency */
+static bool set_trigger_frequency(const char *device, const char *name, uint32_t frequency)
+{
+   char parent[IIO_PATH_MAX], dir[IIO_PATH_MAX], value[64];
+   const char *slash = strrchr(device, '/');
+   struct dirent *e;
+   bool found = false;
+   DIR *d;
+
+   snprintf(parent, sizeof(parent), "%.*s", (NULL == slash) ? 1 : (int)(slash - device),
+            (NULL == slash) ? "." : device);
+   d = opendir(parent);
+   if(NULL == d)
+      return false;
+   while(!found && NULL != (e = readdir(d)))
+   {
+      if(strncmp(e->d_name, "trigger", 7) != 0)
+         continue;
+      if(!path_join(dir, parent, e->d_name))
+         continue;
+      if(sysfs_read(dir, "name", value, sizeof(value)) && strcmp(value, name) == 0)
+         found = sysfs_write_u32(dir, "sampling_frequency", frequency);
+   }
+   closedir(d);
+   return found;
+}
+
+/* ----------------------------------------------------------------------------------------------
+ * Scan layout
+ */
+
+/* Type strings look like "le:s32/32>>0" (endianness:sign bits/storage>>shift) */
+static bool parse_type(const char *type, iio_channel_t *c)
+{
+   char endian, sign;
+   unsigned bits, storage, shift = 0;
+
+   if(sscanf(type, "%ce:%c%u/%u>>%u", &endian, &sign, &bits, &storage, &shift) < 4
+   || (storage != 8 && storage != 16 && storage != 32 && storage != 64) || bits > storage)
+      return false;
+   c->big_endian = (endian == 'b');
+   c->is_signed = (sign == 's');
+   c->bits = bits;
+   c->bytes = storage / 8;
+   c->shift = shift;
+   return true;
+}
+
+/* Enable our channels, disable any others, and compute the scan layout. Each element is
+   aligned to its own size, and the scan is padded to the largest element. */
+static bool configure_scan(iio_t *iio)
+{
+   char scan[IIO_PATH_MAX], name[96], value[64];
+   uint32_t offset = 0, align = 1;
+   struct dirent *e;
+   DIR *d;
+
+   if(!path_join(scan, iio->device, "scan_elements"))
+      return false;
+   d = opendir(scan);
+   if(NULL == d)
+   {
+      SERR("[%s] %s has no scan elements (no buffer support?)", __func__, iio->device);
+      return false;
+   }
+   while(NULL != (e = readdir(d)))
+   {
+      size_t length = strlen(e->d_name);
+      bool ours = false;
+      if(length < 4 || strcmp(e->d_name + length - 3, "_en") != 0)
+         continue;
+      for(int i = 0; i < CH_COUNT; ++i)
+      {
+         if(strlen(channel_names[i]) == length - 3 && strncmp(e->d_name, channel_names[i], length - 3) == 0)
+            ours = true;
+      }
+      if(!ours)
+         sysfs_write(scan, e->d_name, "0");
+   }
+   closedir(d);
+
+   for(int i = 0; i < CH_COUNT; ++i)
+   {
+      iio_channel_t *c = &iio->ch[i];
+      snprintf(name, sizeof(name), "%s_en", channel_names[i]);
+      if(!sysfs_exists(scan, name))
+      {
+         if(i == CH_TIMESTAMP)
+            continue;
+         SERR("[%s] Missing scan element %s", __func__, channel_names[i]);
+         return false;
+      }
+      snprintf(name, sizeof(name), "%s_type", channel_names[i]);
+      if(!sysfs_read(scan, name, value, sizeof(value)) || !parse_type(value, c))
+      {
+         SERR("[%s] Can't parse %s", __func__, name);
+         return false;
+      }
+      snprintf(name, sizeof(name), "%s_index", channel_names[i]);
+      if(!sysfs_read(scan, name, value, sizeof(value)))
+         return false;
+      c->index = atoi(value);
+      snprintf(name, sizeof(name), "%s_en", channel_names[i]);
+      if(!sysfs_write(scan, name, "1"))
+         return false;
+      c->enabled = true;
+
+      c->scale = 1.0;
+      c->bias = 0.0;
+      snprintf(name, sizeof(name), "%s_scale", channel_names[i]);
+      if(sysfs_read(iio->device, name, value, sizeof(value)))
+         c->scale = atof(value);
+      snprintf(name, sizeof(name), "%s_offset", channel_names[i]);
+      if(sysfs_read(iio->device, name, value, sizeof(value)))
+         c->bias = atof(value);
+   }
+
+   /* Lay out the enabled channels in index order */
+   for(int i = 0; i < CH_COUNT; ++i)
+      iio->ch[i].offset = UINT32_MAX;
+   for(;;)
+   {
+      iio_channel_t *next = NULL;
+      for(int i = 0; i < CH_COUNT; ++i)
+      {
+         iio_channel_t *c = &iio->ch[i];
+         if(c->enabled && c->offset == UINT32_MAX && (NULL == next || c->index < next->index))
+            next = c;
+      }
+      if(NULL == next)
+         break;
+      offset = (offset + next->bytes - 1) / next->bytes * next->bytes;
+      next->offset = offset;
+      offset += next->bytes;
+      if(next->bytes > align)
+         align = next->bytes;
+   }
+   iio->scan_size = (offset + align - 1) / align * align;
+   return true;
+}
+
+static int64_t channel_value(const iio_channel_t *c, const uint8_t *scan)
+{
+   const uint8_t *p = scan + c->offset;
+   uint64_t raw = 0;
+
+   for(uint32_t i = 0; i < c->bytes; ++i)
+   {
+      uint32_t b = c->big_endian ? i : c->bytes - 1 - i;
+      raw = (raw << 8) | p[b];
+   }
+   raw >>= c->shift;
+   if(c->bits < 64)
+   {
+      raw &= (UINT64_C(1) << c->bits) - 1;
+      if(c->is_signed && (raw & (UINT64_C(1) << (c->bits - 1))))
+         raw |= ~((UINT64_C(1) << c->bits) - 1);
+   }
+   return (int64_t) raw;
+}
+
+/* IIO units: temperature in milli degrees Celsius, pressure in kPa, timestamps in ns */
+static void convert_scan(bmp180_context_t *ctx, iio_t *iio, const uint8_t *scan, bmp180_sample_t *sample)
+{
+   const iio_channel_t *t = &iio->ch[CH_TEMP];
+   const iio_channel_t *p = &iio->ch[CH_PRESSURE];
+
+   sample->timestamp = iio->ch[CH_TIMESTAMP].enabled
+                     ? (uint64_t)(channel_value(&iio->ch[CH_TIMESTAMP], scan) / 1000) : sys_microsecond_tick();
+   sample->ut = 0;
+   sample->up = 0;
+   sample->oss = ctx->mode;
+   sample->temperature = (int32_t) lround(((double) channel_value(t, scan) + t->bias) * t->scale / 100.0);
+   sample->pressure = (int32_t) lround(((double) channel_value(p, scan) + p->bias) * p->scale * 1000.0);
+}
+
+/* ----------------------------------------------------------------------------------------------
+ * Backend
+ */
+
+static size_t iio_available(const iio_t *iio)
+{
+   return (iio->fill - iio->pos) / iio->scan_size;
+}
+
+/* One read() of as many scans as fit, waiting until 'deadline' (0 for none) for data */
+static bool iio_fill(bmp180_context_t *ctx, iio_t *iio, uint64_t deadline)
+{
+   struct pollfd pfd = { .fd = iio->fd, .events = POLLIN };
+   ssize_t length;
+
+   /* Keep any partial scan */
+   memmove(iio->buf, iio->buf + iio->pos, iio->fill - iio->pos);
+   iio->fill -= iio->pos;
+   iio->pos = 0;
+
+   for(;;)
+   {
+      uint64_t now = sys_microsecond_tick();
+      int timeout = IIO_POLL_SLICE;
+
+      if(atomic_exchange(&ctx->cancel, false))
+      {
+         ++ctx->stats.cancellations;
+         ctx->aborted = true;
+         return false;
+      }
+      if(0 != deadline)
+         timeout = (now >= deadline) ? 0 : (deadline - now < IIO_POLL_SLICE * 1000)
+                 ? (int)((deadline - now + 999) / 1000) : IIO_POLL_SLICE;
+      if(poll(&pfd, 1, timeout) < 0 && errno != EINTR)
+         return false;
+      if(pfd.revents & POLLIN)
+         break;
+      if(pfd.revents & (POLLERR | POLLHUP | POLLNVAL))
+      {
+         SERR("[%s] Buffer device closed (events 0x%x)", __func__, pfd.revents);
+         return false;
+      }
+      if(0 != deadline && now >= deadline)
+         return false;
+   }
+
+   length = read(iio->fd, iio->buf + iio->fill, iio->capacity - iio->fill);
+   if(length <= 0)
+   {
+      if(length < 0 && (errno == EAGAIN || errno == EINTR))
+         return true;
+      SERR("[%s] Read failed (result %zd, errno %d)", __func__, length, errno);
+      return false;
+   }
+   iio->fill += (size_t) length;
+   return true;
+}
+
+static bool iio_sample(bmp180_context_t *ctx, void *arg)
+{
+   iio_t *iio = (iio_t *) ctx->backend_ctx;
+
+   while(iio_available(iio) == 0)
+   {
+      if(!iio_fill(ctx, iio, ctx->deadline))
+         return false;
+   }
+   convert_scan(ctx, iio, iio->buf + iio->pos, (bmp180_sample_t *) arg);
+   iio->pos += iio->scan_size;
+   return true;
+}
+
+static void iio_release(bmp180_context_t *ctx)
+{
+   iio_t *iio = (iio_t *) ctx->backend_ctx;
+   if(NULL == iio)
+      return;
+   sysfs_write(iio->device, "buffer/enable", "0");
+   if(iio->fd >= 0)
+      close(iio->fd);
+   free(iio->buf);
+   free(iio);
+   ctx->backend_ctx = NULL;
+}
+
+static const t_bmp180_backend iio_backend = { iio_sample, iio_release };
+
+/* ----------------------------------------------------------------------------------------------
+ * Exported Functions
+ */
+
+bmp180_t bmp180_iio_init(const bmp180_iio_config_t *config)
+{
+   char chardev[IIO_PATH_MAX];
+   const char *config_trigger, *device;
+   bmp180_context_t *ctx;
+   iio_t *iio;
+   uint32_t batch;
+
+   if(NULL == config || NULL == config->device)
+      return NULL;
+   ctx = bmp180_context_alloc(config->mode);
+   if(NULL == ctx)
+      return NULL;
+   iio = (iio_t *) calloc(1, sizeof(*iio));
+   if(NULL == iio)
+   {
+      free(ctx);
+      return NULL;
+   }
+   iio->fd = -1;
+   config_trigger = config->trigger;
+   ctx->backend = &iio_backend;
+   ctx->backend_ctx = iio;
+   if(strlen(config->device) >= sizeof(iio->device))
+   {
+      SERR("[%s] Path too long: %s", __func__, config->device);
+      goto fail;
+   }
+   strcpy(iio->device, config->device);
+
+   /* The buffer must be disabled while it's reconfigured */
+   if(!sysfs_write(iio->device, "buffer/enable", "0"))
+   {
+      SERR("[%s] Can't access %s/buffer", __func__, iio->device);
+      goto fail;
+   }
+   if(!configure_scan(iio))
+      goto fail;
+   if(NULL != config->trigger && !sysfs_write(iio->device, "trigger/current_trigger", config->trigger))
+      goto fail;
+   if(config->frequency > 0)
+   {
+      char trigger[64];
+      if(NULL == config->trigger && sysfs_read(iio->device, "trigger/current_trigger", trigger, sizeof(trigger)))
+         config_trigger = trigger;
+      if(NULL == config_trigger || !set_trigger_frequency(iio->device, config_trigger, config->frequency))
+      {
+         SERR("[%s] Failed to set the trigger frequency", __func__);
+      }
+   }
+   if(config->length > 0 && !sysfs_write_u32(iio->device, "buffer/length", config->length))
+      goto fail;
+   /* Timestamps comparable with bmp180_now() */
+   if(sysfs_exists(iio->device, "current_timestamp_clock"))
+      sysfs_write(iio->device, "current_timestamp_clock", "monotonic");
+   if(sysfs_exists(iio->device, "in_pressure_oversampling_ratio"))
+      sysfs_write_u32(iio->device, "in_pressure_oversampling_ratio", 1u << config->mode);
+
+   batch = (config->batch > 0) ? config->batch : IIO_DEFAULT_BATCH;
+   iio->capacity = (size_t) batch * iio->scan_size;
+   iio->buf = (uint8_t *) malloc(iio->capacity);
+   if(NULL == iio->buf)
+      goto fail;
+
+   if(NULL == config->chardev)
+   {
+      const char *name = strrchr(iio->device, '/');
+      if(!path_join(chardev, "/dev", (NULL == name) ? iio->device : name + 1))
+         goto fail;
+      device = chardev;
+   }
+   else
+      device = config->chardev;
+   iio->fd = open(device, O_RDONLY | O_NONBLOCK);
+   if(iio->fd < 0)
+   {
+      SERR("[%s] Failed to open %s (errno %d)", __func__, device, errno);
+      goto fail;
+   }
+   if(!sysfs_write(iio->device, "buffer/enable", "1"))
+      goto fail;
+   return ctx;
+
+fail:
+   bmp180_free(ctx);
+   return NULL;
+}
+
+size_t bmp180_iio_read(bmp180_t bmp, bmp180_sample_t *samples, size_t max, uint32_t timeout)
+{
+   bmp180_context_t *ctx = (bmp180_context_t *) bmp;
+   iio_t *iio;
+   size_t count = 0;
+
+   if(NULL == ctx || ctx->backend != &iio_backend || NULL == samples)
+      return 0;
+   iio = (iio_t *) ctx->backend_ctx;
+
+   if(iio_available(iio) == 0)
+   {
+      ctx->aborted = false;
+      if(!iio_fill(ctx, iio, sys_microsecond_tick() + timeout))
+         return 0;
+   }
+   /* Only buffered scans, so these never block */
+   while(count < max && iio_available(iio) > 0 && bmp180_sample(bmp, &samples[count]))
+      ++count;
+   return count;
+}
+
+size_t bmp180_iio_capture(bmp180_t bmp, bmp180_ring_t ring, uint32_t timeout)
+{
+   bmp180_sample_t samples[IIO_DEFAULT_BATCH];
+   size_t count, pushed = 0;
+
+   count = bmp180_iio_read(bmp, samples, ARRAY_SIZE(samples), timeout);
+   for(size_t i = 0; i < count; ++i)
+   {
+      if(bmp180_ring_push(ring, &samples[i]))
+         ++pushed;
+   }
+   return pushed;
+}
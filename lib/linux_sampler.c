@@ -0,0 +1,343 @@
+/*! \copyright 2024 Zorxx Software. All rights reserved.
+ *  \license This file is released under the MIT License. See the LICENSE file for details.
+ *  \brief Real-time sampling worker, Linux implementation
+ */
+#define _GNU_SOURCE /* pthread_attr_setaffinity_np */
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include "bmp180/sampler.h"
+#include "bmp180_private.h"
+
+/* Histogram with 1 us buckets up to HIST_FINE_LIMIT, then 64 us buckets up to
+   HIST_FINE_LIMIT + HIST_COARSE_BUCKETS * 64; larger values land in the last bucket */
+#define HIST_FINE_LIMIT     1024
+#define HIST_COARSE_SHIFT   6
+#define HIST_COARSE_BUCKETS 1024
+#define HIST_BUCKETS        (HIST_FINE_LIMIT + HIST_COARSE_BUCKETS)
+
+/* mlockall() is process-wide; memory stays locked while any sampler that asked for it runs */
+static pthread_mutex_t lock_mutex = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t lock_count;
+
+typedef struct
+{
+   uint32_t counts[HIST_BUCKETS];
+   uint64_t total;
+   uint32_t max;
+} histogram_t;
+
+typedef struct
+{
+   bmp180_t bmp;
+   bmp180_sampler_config_t config;
+   bmp180_ring_t ring;
+   pthread_t thread;
+   atomic_bool stop;
+
+   pthread_mutex_t mutex;  /* protects the statistics and 'ready' */
+   pthread_cond_t ready;
+   atomic_int waiting;     /* readers blocked in bmp180_sampler_read() */
+
+   uint64_t samples;
+   uint64_t errors;
+   uint64_t missed;
+   uint64_t refused;
+   histogram_t jitter;
+   histogram_t start_delay;
+} sampler_t;
+
+/* ----------------------------------------------------------------------------------------------
+ * Helpers
+ */
+
+static bool memory_lock(void)
+{
+   bool result = true;
+   pthread_mutex_lock(&lock_mutex);
+   if(0 == lock_count && mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+   {
+      SERR("[%s] Failed to lock memory (errno %d)", __func__, errno);
+      result = false;
+   }
+   else
+      ++lock_count;
+   pthread_mutex_unlock(&lock_mutex);
+   return result;
+}
+
+static void memory_unlock(void)
+{
+   pthread_mutex_lock(&lock_mutex);
+   if(0 == --lock_count)
+      munlockall();
+   pthread_mutex_unlock(&lock_mutex);
+}
+
+static void histogram_add(histogram_t *h, uint64_t value)
+{
+   uint32_t bucket;
+   if(value < HIST_FINE_LIMIT)
+      bucket = (uint32_t) value;
+   else
+   {
+      uint64_t coarse = (value - HIST_FINE_LIMIT) >> HIST_COARSE_SHIFT;
+      bucket = HIST_FINE_LIMIT + (uint32_t)((coarse < HIST_COARSE_BUCKETS) ? coarse : HIST_COARSE_BUCKETS - 1);
+   }
+   ++h->counts[bucket];
+   ++h->total;
+   if(value > h->max)
+      h->max = (value > UINT32_MAX) ? UINT32_MAX : (uint32_t) value;
+}
+
+/* Upper bound of the bucket holding the given quantile (in parts per thousand) */
+static uint32_t histogram_quantile(const histogram_t *h, uint32_t permille)
+{
+   uint64_t target = (h->total * permille + 999) / 1000;
+   uint64_t seen = 0;
+
+   if(0 == h->total)
+      return 0;
+   for(uint32_t i = 0; i < HIST_BUCKETS; ++i)
+   {
+      seen += h->counts[i];
+      if(seen >= target)
+      {
+         uint32_t upper = (i < HIST_FINE_LIMIT) ? i
+                        : HIST_FINE_LIMIT + ((i - HIST_FINE_LIMIT + 1) << HIST_COARSE_SHIFT) - 1;
+         return (upper < h->max) ? upper : h->max;
+      }
+   }
+   return h->max;
+}
+
+static void histogram_summary(const histogram_t *h, bmp180_percentiles_t *p)
+{
+   p->p50 = histogram_quantile(h, 500);
+   p->p90 = histogram_quantile(h, 900);
+   p->p99 = histogram_quantile(h, 990);
+   p->p999 = histogram_quantile(h, 999);
+   p->max = h->max;
+}
+
+static void sleep_until(uint64_t us)
+{
+   struct timespec ts;
+   ts.tv_sec = us / 1000000;
+   ts.tv_nsec = (us % 1000000) * 1000;
+   while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+      ;
+}
+
+static void *sampler_thread(void *arg)
+{
+   sampler_t *s = (sampler_t *) arg;
+   uint32_t period = s->config.period;
+   uint64_t next = bmp180_now() + period;
+   uint64_t prev_start = 0;
+   bmp180_sample_t sample;
+
+   while(!atomic_load(&s->stop))
+   {
+      bool ok;
+      uint64_t now;
+
+      sleep_until(next);
+      if(atomic_load(&s->stop))
+         break;
+
+      /* The measurement must finish before the next one is due */
+      ok = bmp180_sample_until(s->bmp, &sample, next + period);
+
+      pthread_mutex_lock(&s->mutex);
+      if(ok)
+      {
+         uint64_t start = sample.timestamp;
+         histogram_add(&s->start_delay, (start > next) ? start - next : 0);
+         if(0 != prev_start)
+         {
+            int64_t error = (int64_t)(start - prev_start) - period;
+            histogram_add(&s->jitter, (error < 0) ? -error : error);
+         }
+         prev_start = start;
+         if(bmp180_ring_push(s->ring, &sample))
+            ++s->samples;
+         if(atomic_load(&s->waiting) > 0)
+            pthread_cond_broadcast(&s->ready);
+      }
+      else
+      {
+         if(((bmp180_context_t *) s->bmp)->budget.refused)
+            ++s->refused;
+         else
+            ++s->errors;
+         prev_start = 0;
+      }
+
+      /* Skip any periods that have already passed, rather than bunching up samples */
+      next += period;
+      now = bmp180_now();
+      if(now >= next + period)
+      {
+         uint64_t skipped = (now - next) / period;
+         s->missed += skipped;
+         next += skipped * period;
+         prev_start = 0;
+      }
+      pthread_mutex_unlock(&s->mutex);
+   }
+   return NULL;
+}
+
+/* ----------------------------------------------------------------------------------------------
+ * Exported Functions
+ */
+
+bmp180_sampler_t bmp180_sampler_start(bmp180_t bmp, const bmp180_sampler_config_t *config)
+{
+   pthread_attr_t attr;
+   sampler_t *s;
+   int result;
+
+   if(NULL == bmp || NULL == config || config->period == 0 || config->capacity == 0)
+      return NULL;
+   if(config->cpu >= CPU_SETSIZE)
+   {
+      SERR("[%s] CPU %d is out of range", __func__, config->cpu);
+      return NULL;
+   }
+
+   s = (sampler_t *) calloc(1, sizeof(*s));
+   if(NULL == s)
+      return NULL;
+   s->bmp = bmp;
+   s->config = *config;
+   atomic_init(&s->stop, false);
+   atomic_init(&s->waiting, 0);
+   pthread_mutex_init(&s->mutex, NULL);
+   pthread_cond_init(&s->ready, NULL);
+   s->ring = bmp180_ring_init(config->capacity);
+   if(NULL == s->ring)
+   {
+      free(s);
+      return NULL;
+   }
+   if(config->lock_memory && !memory_lock())
+   {
+      bmp180_ring_free(s->ring);
+      free(s);
+      return NULL;
+   }
+
+   pthread_attr_init(&attr);
+   if(config->cpu >= 0)
+   {
+      cpu_set_t cpus;
+      CPU_ZERO(&cpus);
+      CPU_SET(config->cpu, &cpus);
+      pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+   }
+   if(config->priority > 0)
+   {
+      struct sched_param param = { .sched_priority = config->priority };
+      pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+      pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+      pthread_attr_setschedparam(&attr, &param);
+   }
+   result = pthread_create(&s->thread, &attr, sampler_thread, s);
+   pthread_attr_destroy(&attr);
+   if(0 != result)
+   {
+      SERR("[%s] Failed to start worker (error %d)", __func__, result);
+      if(config->lock_memory)
+         memory_unlock();
+      bmp180_ring_free(s->ring);
+      free(s);
+      return NULL;
+   }
+   return s;
+}
+
+bool bmp180_sampler_stop(bmp180_sampler_t sampler)
+{
+   sampler_t *s = (sampler_t *) sampler;
+   if(NULL == s)
+      return false;
+
+   atomic_store(&s->stop, true);
+   bmp180_cancel(s->bmp);
+   pthread_join(s->thread, NULL);
+   /* Don't leave the cancellation pending if the worker wasn't measuring */
+   bmp180_cancel_reset((bmp180_context_t *) s->bmp);
+   if(s->config.lock_memory)
+      memory_unlock();
+
+   pthread_mutex_lock(&s->mutex);
+   pthread_cond_broadcast(&s->ready);
+   pthread_mutex_unlock(&s->mutex);
+
+   bmp180_ring_free(s->ring);
+   pthread_cond_destroy(&s->ready);
+   pthread_mutex_destroy(&s->mutex);
+   free(s);
+   return true;
+}
+
+size_t bmp180_sampler_read(bmp180_sampler_t sampler, bmp180_sample_t *samples, size_t max,
+                           uint32_t timeout)
+{
+   sampler_t *s = (sampler_t *) sampler;
+   struct timespec ts;
+   size_t count;
+
+   if(NULL == s || NULL == samples)
+      return 0;
+
+   count = bmp180_ring_pop(s->ring, samples, max);
+   if(count > 0 || 0 == timeout)
+      return count;
+
+   clock_gettime(CLOCK_REALTIME, &ts);
+   ts.tv_sec += timeout / 1000000;
+   ts.tv_nsec += (long)(timeout % 1000000) * 1000;
+   if(ts.tv_nsec >= 1000000000L)
+   {
+      ++ts.tv_sec;
+      ts.tv_nsec -= 1000000000L;
+   }
+
+   pthread_mutex_lock(&s->mutex);
+   atomic_fetch_add(&s->waiting, 1);
+   while(bmp180_ring_count(s->ring) == 0 && !atomic_load(&s->stop))
+   {
+      if(pthread_cond_timedwait(&s->ready, &s->mutex, &ts) == ETIMEDOUT)
+         break;
+   }
+   atomic_fetch_sub(&s->waiting, 1);
+   pthread_mutex_unlock(&s->mutex);
+
+   return bmp180_ring_pop(s->ring, samples, max);
+}
+
+bool bmp180_sampler_get_stats(bmp180_sampler_t sampler, bmp180_sampler_stats_t *stats)
+{
+   sampler_t *s = (sampler_t *) sampler;
+   if(NULL == s || NULL == stats)
+      return false;
+
+   pthread_mutex_lock(&s->mutex);
+   stats->samples = s->samples;
+   stats->errors = s->errors;
+   stats->missed = s->missed;
+   stats->refused = s->refused;
+   stats->dropped = bmp180_ring_dropped(s->ring);
+   histogram_summary(&s->jitter, &stats->jitter);
+   histogram_summary(&s->start_delay, &stats->start_delay);
+   pthread_mutex_unlock(&s->mutex);
+   return true;
+}
@@ -0,0 +1,66 @@
+/*! \copyright 2024 Zorxx Software. All rights reserved.
+ *  \license This file is released under the MIT License. See the LICENSE file for details.
+ *  \brief Streaming min/max/mean/stddev of one channel, shared by aggregation and events
+ *
+ *  Values are accumulated relative to the first one, which keeps the sums small and exact.
+ */
+#ifndef _BMP180_MOMENTS_H
+#define _BMP180_MOMENTS_H
+
+#include <stdint.h>
+#include <math.h>   /* sqrtf */
+#include "bmp180/aggregate.h"
+
+typedef struct
+{
+   int32_t ref;      /* offset subtracted before accumulating */
+   int64_t sum;
+   int64_t sumsq;
+   int32_t min;
+   int32_t max;
+} t_moments;
+
+/* Start over, with 'ref' as the offset (normally the first value) */
+static inline void moments_reset(t_moments *m, int32_t ref)
+{
+   m->ref = m->min = m->max = ref;
+   m->sum = m->sumsq = 0;
+}
+
+static inline void moments_add(t_moments *m, int32_t v)
+{
+   int64_t d = (int64_t) v - m->ref;
+   m->sum += d;
+   m->sumsq += d * d;
+   if(v < m->min)
+      m->min = v;
+   if(v > m->max)
+      m->max = v;
+}
+
+/* Take back a value added earlier; min and max are left to the caller */
+static inline void moments_remove(t_moments *m, int32_t v)
+{
+   int64_t d = (int64_t) v - m->ref;
+   m->sum -= d;
+   m->sumsq -= d * d;
+}
+
+static inline void moments_summary(const t_moments *m, uint32_t count, bmp180_channel_summary_t *s)
+{
+   double mean = (double) m->sum / count;
+   double var = 0.0;
+
+   s->min = m->min;
+   s->max = m->max;
+   s->mean = (float)(m->ref + mean);
+   if(count > 1)
+   {
+      var = ((double) m->sumsq - (double) m->sum * mean) / (count - 1);
+      if(var < 0.0)
+         var = 0.0;
+   }
+   s->stddev = sqrtf((float) var);
+}
+
+#endif /* _BMP180_MOMENTS_H */
@@ -0,0 +1,272 @@
+/*! \copyright 2024 Zorxx Software. All rights reserved.
+ *  \license This file is released under the MIT License. See the LICENSE file for details.
+ *  \brief Simulated BMP180 bus, used by the Linux backend for tests and benchmarks
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "bmp180_private.h"
+#include "sim_private.h"
+
+typedef struct
+{
+   pthread_mutex_t mutex;
+   bmp180_sim_faults_t faults;
+   bmp180_sim_counters_t counters;
+   int32_t ut;
+   int32_t up;
+   uint32_t noise;
+   uint32_t seed;
+   uint8_t ctrl;
+   uint8_t out[3];
+} sim_bus_t;
+
+typedef struct
+{
+   sim_bus_t *bus;
+   uint8_t address;
+   uint32_t timeout;  /* microseconds */
+} sim_device_t;
+
+static const t_bmp180_calibration_data sim_calibration =
+   { { { 408, -72, -14383, 32741, 32757, 23153, 6190, 4, -32768, -8711, 2868 } } };
+
+/* Noise scaling per oss, x1000: 2^oss samples of 2^oss-scaled values */
+static const uint32_t sim_noise_scale[BMP180_MODE_COUNT] = { 1000, 1414, 2000, 2828 };
+
+static sim_bus_t sim_buses[BMP180_SIM_BUSES];
+static pthread_once_t sim_once = PTHREAD_ONCE_INIT;
+
+static void sim_init_buses(void)
+{
+   for(int i = 0; i < BMP180_SIM_BUSES; ++i)
+   {
+      sim_bus_t *b = &sim_buses[i];
+      memset(b, 0, sizeof(*b));
+      pthread_mutex_init(&b->mutex, NULL);
+      b->ut = 27898;   /* datasheet example values */
+      b->up = 23843;
+      b->seed = 1 + i;
+   }
+}
+
+static sim_bus_t *sim_find(const char *device)
+{
+   char *end;
+   long index;
+
+   if(!sim_is_device(device))
+      return NULL;
+   index = strtol(device + strlen(BMP180_SIM_PREFIX), &end, 10);
+   if(*end != '\0' || index < 0 || index >= BMP180_SIM_BUSES)
+      return NULL;
+   pthread_once(&sim_once, sim_init_buses);
+   return &sim_buses[index];
+}
+
+static int32_t sim_random(sim_bus_t *b, uint32_t amplitude)
+{
+   if(0 == amplitude)
+      return 0;
+   b->seed = b->seed * 1103515245 + 12345;
+   return (int32_t)((b->seed >> 8) % (2 * amplitude + 1)) - (int32_t) amplitude;
+}
+
+/* Called with the bus mutex held; returns false if the transaction should fail */
+static bool sim_transaction(sim_device_t *d, uint8_t reg, bool read)
+{
+   sim_bus_t *b = d->bus;
+   bool fail = false;
+
+   if(0 == b->counters.transactions++)
+      b->counters.first_start = sys_microsecond_tick();
+   if(b->faults.stall > 0)
+   {
+      /* A stalled transaction is abandoned when the bus timeout expires */
+      if(d->timeout > 0 && b->faults.stall > d->timeout)
+      {
+         usleep(d->timeout);
+         ++b->counters.failures;
+         b->counters.last_end = sys_microsecond_tick();
+         return false;
+      }
+      usleep(b->faults.stall);
+   }
+   b->counters.last_end = sys_microsecond_tick();
+
+   if(d->address != BMP180_DEVICE_ADDRESS || b->faults.wedge)
+      fail = true;
+   else if(b->faults.fail_next > 0)
+   {
+      --b->faults.fail_next;
+      fail = true;
+   }
+   else if(b->faults.fail_every > 0 && (b->counters.transactions % b->faults.fail_every) == 0)
+      fail = true;
+   else if(read && b->faults.hang && reg >= BMP180_OUT_MSB_REG && reg <= BMP180_OUT_XLSB_REG)
+      fail = true;
+
+   if(fail)
+      ++b->counters.failures;
+   return !fail;
+}
+
+/* ----------------------------------------------------------------------------------------------
+ * Backend interface
+ */
+
+bool sim_is_device(const char *device)
+{
+   return NULL != device && strncmp(device, BMP180_SIM_PREFIX, strlen(BMP180_SIM_PREFIX)) == 0;
+}
+
+sim_handle sim_open(const char *device, uint8_t i2c_address)
+{
+   sim_bus_t *b = sim_find(device);
+   sim_device_t *d;
+
+   if(NULL == b)
+      return NULL;
+   d = (sim_device_t *) malloc(sizeof(*d));
+   if(NULL == d)
+      return NULL;
+   d->bus = b;
+   d->address = i2c_address;
+   d->timeout = 0;
+
+   pthread_mutex_lock(&b->mutex);
+   ++b->counters.opens;
+   b->faults.wedge = false;
+   pthread_mutex_unlock(&b->mutex);
+   return d;
+}
+
+void sim_close(sim_handle h)
+{
+   free(h);
+}
+
+void sim_set_timeout(sim_handle h, uint32_t timeout_ms)
+{
+   sim_device_t *d = (sim_device_t *) h;
+   d->timeout = timeout_ms * 1000;
+}
+
+bool sim_write_reg(sim_handle h, uint8_t reg, const uint8_t *data, uint8_t length)
+{
+   sim_device_t *d = (sim_device_t *) h;
+   sim_bus_t *b = d->bus;
+   bool result;
+
+   pthread_mutex_lock(&b->mutex);
+   result = sim_transaction(d, reg, false);
+   if(result && length > 0)
+   {
+      if(reg == BMP180_RESET_REG && data[0] == BMP180_RESET_VALUE)
+      {
+         ++b->counters.resets;
+         b->faults.hang = false;
+         b->ctrl = 0;
+         memset(b->out, 0, sizeof(b->out));
+      }
+      else if(reg == BMP180_CONTROL_REG && data[0] == BMP180_MEASURE_TEMP)
+      {
+         ++b->counters.conversions;
+         b->ctrl = data[0];
+         b->out[0] = (uint8_t)(b->ut >> 8);
+         b->out[1] = (uint8_t) b->ut;
+         b->out[2] = 0;
+      }
+      else if(reg == BMP180_CONTROL_REG && (data[0] & 0x3F) == BMP180_MEASURE_PRESS)
+      {
+         uint8_t oss = data[0] >> 6;
+         uint32_t amplitude = b->noise * sim_noise_scale[oss] / 1000;
+         uint32_t up = (uint32_t)((b->up << oss) + sim_random(b, amplitude));
+         uint32_t raw = up << (8 - oss);
+         ++b->counters.conversions;
+         b->ctrl = data[0];
+         b->out[0] = (uint8_t)(raw >> 16);
+         b->out[1] = (uint8_t)(raw >> 8);
+         b->out[2] = (uint8_t) raw;
+      }
+   }
+   pthread_mutex_unlock(&b->mutex);
+   return result;
+}
+
+bool sim_read_reg(sim_handle h, uint8_t reg, uint8_t *data, uint8_t length)
+{
+   sim_device_t *d = (sim_device_t *) h;
+   sim_bus_t *b = d->bus;
+   bool result;
+
+   pthread_mutex_lock(&b->mutex);
+   result = sim_transaction(d, reg, true);
+   for(uint8_t i = 0; i < length; ++i)
+   {
+      uint8_t r = reg + i;
+      uint8_t v = 0;
+      if(!result)
+         v = 0;
+      else if(r == BMP180_VERSION_REG)
+         v = BMP180_CHIP_ID;
+      else if(r == BMP180_CONTROL_REG)
+         v = b->ctrl & ~0x20; /* conversions complete immediately (SCO clear) */
+      else if(r >= BMP180_OUT_MSB_REG && r <= BMP180_OUT_XLSB_REG)
+         v = b->out[r - BMP180_OUT_MSB_REG];
+      else if(r >= BMP180_CALIBRATION_REG && r < BMP180_CALIBRATION_REG + sizeof(sim_calibration.raw))
+      {
+         uint16_t word = sim_calibration.raw[(r - BMP180_CALIBRATION_REG) / 2];
+         v = ((r - BMP180_CALIBRATION_REG) & 1) ? (uint8_t) word : (uint8_t)(word >> 8);
+      }
+      data[i] = v;
+   }
+   pthread_mutex_unlock(&b->mutex);
+   return result;
+}
+
+/* ----------------------------------------------------------------------------------------------
+ * Exported Functions
+ */
+
+bool bmp180_sim_set_faults(const char *device, const bmp180_sim_faults_t *faults)
+{
+   sim_bus_t *b = sim_find(device);
+   if(NULL == b)
+      return false;
+   pthread_mutex_lock(&b->mutex);
+   if(NULL == faults)
+      memset(&b->faults, 0, sizeof(b->faults));
+   else
+      b->faults = *faults;
+   pthread_mutex_unlock(&b->mutex);
+   return true;
+}
+
+bool bmp180_sim_set_values(const char *device, int32_t ut, int32_t up, uint32_t noise)
+{
+   sim_bus_t *b = sim_find(device);
+   if(NULL == b)
+      return false;
+   pthread_mutex_lock(&b->mutex);
+   b->ut = ut;
+   b->up = up;
+   b->noise = noise;
+   pthread_mutex_unlock(&b->mutex);
+   return true;
+}
+
+bool bmp180_sim_get_counters(const char *device, bmp180_sim_counters_t *counters, bool reset)
+{
+   sim_bus_t *b = sim_find(device);
+   if(NULL == b)
+      return false;
+   pthread_mutex_lock(&b->mutex);
+   if(NULL != counters)
+      *counters = b->counters;
+   if(reset)
+      memset(&b->counters, 0, sizeof(b->counters));
+   pthread_mutex_unlock(&b->mutex);
+   return true;
+}
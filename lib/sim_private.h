@@ -0,0 +1,21 @@
+/*! \copyright 2024 Zorxx Software. All rights reserved.
+ *  \license This file is released under the MIT License. See the LICENSE file for details.
+ *  \brief Simulated BMP180 bus, used by the Linux backend
+ */
+#ifndef _SIM_PRIVATE_H
+#define _SIM_PRIVATE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "sim.h"
+
+typedef void *sim_handle;
+
+bool sim_is_device(const char *device);
+sim_handle sim_open(const char *device, uint8_t i2c_address);
+void sim_close(sim_handle h);
+void sim_set_timeout(sim_handle h, uint32_t timeout_ms);
+bool sim_write_reg(sim_handle h, uint8_t reg, const uint8_t *data, uint8_t length);
+bool sim_read_reg(sim_handle h, uint8_t reg, uint8_t *data, uint8_t length);
+
+#endif /* _SIM_PRIVATE_H */
@@ -2,11 +2,12 @@
  *  \license This file is released under the MIT License. See the LICENSE file for details.
  *  \brief lowlevel interface
  */
+/* Version 2 adds i2c_ll_reopen() and i2c_ll_set_timeout() */
 #ifdef _SYS_PORTABILITY_H
    #ifndef SYS_PORTABILITY_VERSION
-      #define SYS_PORTABILITY_VERSION 1
+      #define SYS_PORTABILITY_VERSION 2
    #else
-      #if SYS_PORTABILITY_VERSION != 1
+      #if SYS_PORTABILITY_VERSION != 2
          #error "System portability version mismatch"
       #endif
    #endif
@@ -38,6 +39,11 @@ bool i2c_ll_write(i2c_lowlevel_context ctx, uint8_t *data, uint8_t length);
 bool i2c_ll_write_reg(i2c_lowlevel_context ctx, uint8_t reg, uint8_t *data, uint8_t length);
 bool i2c_ll_read(i2c_lowlevel_context ctx, uint8_t *data, uint8_t length);
 bool i2c_ll_read_reg(i2c_lowlevel_context ctx, uint8_t reg, uint8_t *data, uint8_t length);
+/* Release and re-acquire the device handle, e.g. after the adapter or bus has been reset */
+bool i2c_ll_reopen(i2c_lowlevel_context ctx);
+/* Change the timeout applied to subsequent transactions; on Linux this is the adapter-wide
+ * I2C_TIMEOUT, and the timeout given to i2c_ll_init() is only applied by this call */
+bool i2c_ll_set_timeout(i2c_lowlevel_context ctx, uint32_t i2c_timeout_ms);
 
 /* time */
 #if defined(ESP_PLATFORM)
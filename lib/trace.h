@@ -0,0 +1,55 @@
+/*! \copyright 2024 Zorxx Software. All rights reserved.
+ *  \license This file is released under the MIT License. See the LICENSE file for details.
+ *  \brief Static (USDT) tracepoints
+ *
+ *  With SYS_TRACE_ENABLE on Linux, each probe below is a SystemTap-style SDT probe in the
+ *  "bmp180" provider, usable from perf, bpftrace and SystemTap. A probe is a single nop
+ *  until a tracer attaches; its arguments (including any timestamps) are only evaluated
+ *  while its semaphore shows a tracer is attached. Otherwise, the probes compile away.
+ *
+ *  Timestamps are sys_microsecond_tick() values; 'reg' is -1 for register-less transfers;
+ *  'kind' is 0 for temperature and 1 for pressure conversions.
+ */
+#ifndef _SYS_TRACE_H
+#define _SYS_TRACE_H
+
+/* name, arguments */
+#define STRACE_PROBES(X) \
+   X(i2c_write)           /* ctx, reg, length, result, start, end */ \
+   X(i2c_read)            /* ctx, reg, length, result, start, end */ \
+   X(i2c_reopen)          /* ctx, result, start, end */ \
+   X(conversion_start)    /* bmp, kind, oss, timestamp */ \
+   X(conversion_ready)    /* bmp, kind, oss, timestamp */ \
+   X(conversion_readout)  /* bmp, kind, raw value, result, timestamp */ \
+   X(sample)              /* bmp, ut, up, temperature, pressure, timestamp */
+
+#if defined(SYS_TRACE_ENABLE) && defined(__linux__)
+   #define _SDT_HAS_SEMAPHORES 1
+   #include <sys/sdt.h>
+
+   #define STRACE_SEMAPHORE(name) bmp180_##name##_semaphore
+   #define STRACE_DECLARE(name) extern unsigned short STRACE_SEMAPHORE(name);
+   #define STRACE_DEFINE(name) \
+      unsigned short STRACE_SEMAPHORE(name) __attribute__((section(".probes"), used));
+   STRACE_PROBES(STRACE_DECLARE)
+
+   /* Define the semaphores; expanded in exactly one translation unit */
+   #define STRACE_DEFINITIONS STRACE_PROBES(STRACE_DEFINE)
+   #define STRACE_ENABLED(name) __builtin_expect(STRACE_SEMAPHORE(name) != 0, 0)
+   #define STRACE(name, ...) \
+      do { if(STRACE_ENABLED(name)) STAP_PROBEV(bmp180, name, __VA_ARGS__); } while(0)
+   /* Timestamp for a later probe, taken only while a tracer is attached */
+   #define STRACE_TIME(name) (STRACE_ENABLED(name) ? sys_microsecond_tick() : 0)
+
+#else
+   /* Keeps the arguments referenced, so disabling tracing doesn't cause unused warnings */
+   static inline void strace_unused(int unused, ...) { (void) unused; }
+
+   #define STRACE_DEFINITIONS
+   #define STRACE_ENABLED(name) 0
+   #define STRACE(name, ...) do { if(0) strace_unused(0, __VA_ARGS__); } while(0)
+   #define STRACE_TIME(name) 0
+
+#endif
+
+#endif /* _SYS_TRACE_H */
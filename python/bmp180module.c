@@ -0,0 +1,711 @@
+/*! \copyright 2024 Zorxx Software. All rights reserved.
+ *  \license This file is released under the MIT License. See the LICENSE file for details.
+ *  \brief CPython bindings
+ *
+ *  Batch functions take any object exporting a contiguous buffer (NumPy arrays, array.array,
+ *  memoryview); they fill or read it in place with the GIL released.
+ */
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <string.h>
+#include "bmp180/bmp180.h"
+#include "bmp180/sampler.h"
+#include "bmp180/sim.h"
+
+#define READ_CHUNK 64 /* samples copied out of the sampler ring per call */
+
+typedef struct
+{
+   PyObject_HEAD
+   bmp180_t bmp;
+   char *device;
+   int samplers;   /* running samplers using 'bmp' */
+   int busy;       /* calls using 'bmp' with the GIL released */
+} DeviceObject;
+
+typedef struct
+{
+   PyObject_HEAD
+   bmp180_sampler_t sampler;
+   DeviceObject *device;
+   int readers;    /* calls blocked in read_into() with the GIL released */
+} SamplerObject;
+
+static PyTypeObject DeviceType;
+static PyTypeObject SamplerType;
+
+/* ----------------------------------------------------------------------------------------------
+ * Buffers
+ */
+
+/* Destination (or source) arrays of a batch call; any of them may be absent */
+enum { COL_TIMESTAMP, COL_UT, COL_UP, COL_TEMPERATURE, COL_PRESSURE, COL_COUNT };
+
+typedef struct
+{
+   Py_buffer view[COL_COUNT];
+   bool used[COL_COUNT];
+   Py_ssize_t length;
+} columns_t;
+
+static bool buffer_get(PyObject *obj, Py_buffer *view, const char *name, Py_ssize_t itemsize,
+                       bool is_signed, bool writable)
+{
+   char code;
+
+   if(PyObject_GetBuffer(obj, view, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT | (writable ? PyBUF_WRITABLE : 0)) != 0)
+      return false;
+
+   /* Skip any byte-order prefix; only native layouts are accepted */
+   code = (NULL == view->format) ? 'B' : view->format[strlen(view->format) - 1];
+   if(view->itemsize != itemsize || view->ndim > 1
+   || (is_signed ? strchr("ilq", code) : strchr("ILQ", code)) == NULL
+   || (NULL != view->format && strlen(view->format) > 1 && strchr("@=", view->format[0]) == NULL))
+   {
+      PyErr_Format(PyExc_TypeError, "%s must be a 1-D %s%d buffer", name, is_signed ? "int" : "uint",
+                   (int)(itemsize * 8));
+      PyBuffer_Release(view);
+      return false;
+   }
+   return true;
+}
+
+static void columns_release(columns_t *c)
+{
+   for(int i = 0; i < COL_COUNT; ++i)
+   {
+      if(c->used[i])
+         PyBuffer_Release(&c->view[i]);
+   }
+}
+
+/* Acquire each non-None object; 'length' becomes the shortest of them */
+static bool columns_get(columns_t *c, PyObject **objs, const char **names, bool writable)
+{
+   memset(c, 0, sizeof(*c));
+   c->length = PY_SSIZE_T_MAX;
+   for(int i = 0; i < COL_COUNT; ++i)
+   {
+      bool ok;
+      if(NULL == objs[i] || Py_None == objs[i])
+         continue;
+      ok = (i == COL_TIMESTAMP) ? buffer_get(objs[i], &c->view[i], names[i], 8, false, writable)
+                                : buffer_get(objs[i], &c->view[i], names[i], 4, true, writable);
+      if(!ok)
+      {
+         columns_release(c);
+         return false;
+      }
+      c->used[i] = true;
+      if(c->view[i].len / c->view[i].itemsize < c->length)
+         c->length = c->view[i].len / c->view[i].itemsize;
+   }
+   if(PY_SSIZE_T_MAX == c->length)
+      c->length = 0;
+   return true;
+}
+
+static void columns_store(columns_t *c, Py_ssize_t i, const bmp180_sample_t *s)
+{
+   if(c->used[COL_TIMESTAMP])
+      ((uint64_t *) c->view[COL_TIMESTAMP].buf)[i] = s->timestamp;
+   if(c->used[COL_UT])
+      ((int32_t *) c->view[COL_UT].buf)[i] = s->ut;
+   if(c->used[COL_UP])
+      ((int32_t *) c->view[COL_UP].buf)[i] = s->up;
+   if(c->used[COL_TEMPERATURE])
+      ((int32_t *) c->view[COL_TEMPERATURE].buf)[i] = s->temperature;
+   if(c->used[COL_PRESSURE])
+      ((int32_t *) c->view[COL_PRESSURE].buf)[i] = s->pressure;
+}
+
+static const char *column_kwlist[] = { "timestamp", "ut", "up", "temperature", "pressure" };
+
+static PyObject *sample_tuple(const bmp180_sample_t *s)
+{
+   return Py_BuildValue("(KiiIii)", (unsigned long long) s->timestamp, (int) s->ut, (int) s->up,
+                        (unsigned int) s->oss, (int) s->temperature, (int) s->pressure);
+}
+
+/* ----------------------------------------------------------------------------------------------
+ * Device
+ */
+
+static int Device_init(DeviceObject *self, PyObject *args, PyObject *kwds)
+{
+   static char *kwlist[] = { "device", "address", "mode", NULL };
+   const char *device;
+   int address = 0;
+   int mode = BMP180_MODE_HIGH_RESOLUTION;
+
+   if(!PyArg_ParseTupleAndKeywords(args, kwds, "s|ii", kwlist, &device, &address, &mode))
+      return -1;
+   if(mode < BMP180_MODE_ULTRA_LOW_POWER || mode > BMP180_MODE_ULTRA_HIGH_RESOLUTION)
+   {
+      PyErr_SetString(PyExc_ValueError, "invalid mode");
+      return -1;
+   }
+   if(NULL != self->bmp || self->busy > 0)
+   {
+      PyErr_SetString(PyExc_RuntimeError, "device already open");
+      return -1;
+   }
+
+   /* Left over from a failed __init__(), or from before close() */
+   free(self->device);
+   self->device = strdup(device);
+   if(NULL == self->device)
+   {
+      PyErr_NoMemory();
+      return -1;
+   }
+
+   ++self->busy;
+   Py_BEGIN_ALLOW_THREADS
+   i2c_lowlevel_config config = { .device = self->device };
+   self->bmp = bmp180_init(&config, (uint8_t) address, (bmp180_mode_t) mode);
+   Py_END_ALLOW_THREADS
+   --self->busy;
+
+   if(NULL == self->bmp)
+   {
+      PyErr_Format(PyExc_OSError, "failed to open BMP180 on %s", device);
+      return -1;
+   }
+   return 0;
+}
+
+static void Device_dealloc(DeviceObject *self)
+{
+   /* Calls in progress and samplers hold references, so nothing is using 'bmp' here */
+   if(NULL != self->bmp)
+      bmp180_free(self->bmp);
+   free(self->device);
+   Py_TYPE(self)->tp_free((PyObject *) self);
+}
+
+static bool Device_check(DeviceObject *self)
+{
+   if(NULL == self->bmp)
+   {
+      PyErr_SetString(PyExc_ValueError, "device is closed");
+      return false;
+   }
+   return true;
+}
+
+/* Claim the device for a call that releases the GIL; another thread could otherwise
+   close it, or use it concurrently, while the call is in progress */
+static bool Device_acquire(DeviceObject *self)
+{
+   if(!Device_check(self))
+      return false;
+   if(self->samplers > 0)
+   {
+      PyErr_SetString(PyExc_RuntimeError, "device is in use by a sampler");
+      return false;
+   }
+   if(self->busy > 0)
+   {
+      PyErr_SetString(PyExc_RuntimeError, "device is in use by another thread");
+      return false;
+   }
+   ++self->busy;
+   return true;
+}
+
+static void Device_release(DeviceObject *self)
+{
+   --self->busy;
+}
+
+static PyObject *Device_close(DeviceObject *self, PyObject *Py_UNUSED(args))
+{
+   if(self->samplers > 0)
+   {
+      PyErr_SetString(PyExc_RuntimeError, "device is in use by a sampler");
+      return NULL;
+   }
+   if(self->busy > 0)
+   {
+      PyErr_SetString(PyExc_RuntimeError, "device is in use by another thread");
+      return NULL;
+   }
+   if(NULL != self->bmp)
+   {
+      bmp180_free(self->bmp);
+      self->bmp = NULL;
+   }
+   Py_RETURN_NONE;
+}
+
+static PyObject *Device_enter(DeviceObject *self, PyObject *Py_UNUSED(args))
+{
+   Py_INCREF(self);
+   return (PyObject *) self;
+}
+
+static PyObject *Device_exit(DeviceObject *self, PyObject *Py_UNUSED(args))
+{
+   return Device_close(self, NULL);
+}
+
+static PyObject *Device_measure(DeviceObject *self, PyObject *Py_UNUSED(args))
+{
+   float temperature;
+   uint32_t pressure;
+   bool ok;
+
+   if(!Device_acquire(self))
+      return NULL;
+   Py_BEGIN_ALLOW_THREADS
+   ok = bmp180_measure(self->bmp, &temperature, &pressure);
+   Py_END_ALLOW_THREADS
+   Device_release(self);
+   if(!ok)
+      return PyErr_Format(PyExc_OSError, "measurement failed");
+   return Py_BuildValue("(dk)", (double) temperature, (unsigned long) pressure);
+}
+
+static PyObject *Device_sample(DeviceObject *self, PyObject *Py_UNUSED(args))
+{
+   bmp180_sample_t sample;
+   bool ok;
+
+   if(!Device_acquire(self))
+      return NULL;
+   Py_BEGIN_ALLOW_THREADS
+   ok = bmp180_sample(self->bmp, &sample);
+   Py_END_ALLOW_THREADS
+   Device_release(self);
+   if(!ok)
+      return PyErr_Format(PyExc_OSError, "measurement failed");
+   return sample_tuple(&sample);
+}
+
+static PyObject *Device_read_into(DeviceObject *self, PyObject *args, PyObject *kwds)
+{
+   static char *kwlist[] = { "timestamp", "ut", "up", "temperature", "pressure", NULL };
+   PyObject *objs[COL_COUNT] = { NULL };
+   columns_t c;
+   Py_ssize_t n = 0;
+
+   if(!PyArg_ParseTupleAndKeywords(args, kwds, "|OOOOO", kwlist, &objs[0], &objs[1], &objs[2],
+                                   &objs[3], &objs[4]))
+      return NULL;
+   if(!Device_acquire(self))
+      return NULL;
+   if(!columns_get(&c, objs, column_kwlist, true))
+   {
+      Device_release(self);
+      return NULL;
+   }
+
+   Py_BEGIN_ALLOW_THREADS
+   for(; n < c.length; ++n)
+   {
+      bmp180_sample_t sample;
+      if(!bmp180_sample(self->bmp, &sample))
+         break;
+      columns_store(&c, n, &sample);
+   }
+   Py_END_ALLOW_THREADS
+   Device_release(self);
+
+   columns_release(&c);
+   return PyLong_FromSsize_t(n);
+}
+
+static PyObject *Device_calibration(DeviceObject *self, PyObject *Py_UNUSED(args))
+{
+   bmp180_calibration_t cal;
+
+   if(!Device_check(self))
+      return NULL;
+   bmp180_get_calibration(self->bmp, &cal);
+   return Py_BuildValue("(hhhHHHhhhhh)", cal.AC1, cal.AC2, cal.AC3, cal.AC4, cal.AC5, cal.AC6,
+                        cal.B1, cal.B2, cal.MB, cal.MC, cal.MD);
+}
+
+static PyObject *Device_stats(DeviceObject *self, PyObject *args, PyObject *kwds)
+{
+   static char *kwlist[] = { "reset", NULL };
+   bmp180_stats_t s;
+   int reset = 0;
+
+   if(!Device_check(self))
+      return NULL;
+   if(!PyArg_ParseTupleAndKeywords(args, kwds, "|p", kwlist, &reset))
+      return NULL;
+   bmp180_get_stats(self->bmp, &s);
+   if(reset)
+      bmp180_reset_stats(self->bmp);
+   return Py_BuildValue("{s:i,s:(kkkk),s:(KKKK),s:k,s:i,s:k,s:k,s:k,s:k,s:k,s:k,s:K,s:k,s:k,s:k,"
+                        "s:K,s:K,s:K,s:(KKKK),s:K,s:k,s:K,s:k}",
+      "mode", (int) s.mode,
+      "samples", (unsigned long) s.samples[0], (unsigned long) s.samples[1],
+                 (unsigned long) s.samples[2], (unsigned long) s.samples[3],
+      "mode_time", (unsigned long long) s.mode_time[0], (unsigned long long) s.mode_time[1],
+                   (unsigned long long) s.mode_time[2], (unsigned long long) s.mode_time[3],
+      "mode_changes", (unsigned long) s.mode_changes,
+      "rate", (int) s.rate,
+      "noise", (unsigned long) s.noise,
+      "failures", (unsigned long) s.failures,
+      "retries", (unsigned long) s.retries,
+      "soft_resets", (unsigned long) s.soft_resets,
+      "reopens", (unsigned long) s.reopens,
+      "recoveries", (unsigned long) s.recoveries,
+      "recovery_time", (unsigned long long) s.recovery_time,
+      "max_recovery_time", (unsigned long) s.max_recovery_time,
+      "timeouts", (unsigned long) s.timeouts,
+      "cancellations", (unsigned long) s.cancellations,
+      "bus_bytes", (unsigned long long) s.bus_bytes,
+      "bus_clocks", (unsigned long long) s.bus_clocks,
+      "bus_time", (unsigned long long) s.bus_time,
+      "conversion_time", (unsigned long long) s.conversion_time[0], (unsigned long long) s.conversion_time[1],
+                         (unsigned long long) s.conversion_time[2], (unsigned long long) s.conversion_time[3],
+      "charge", (unsigned long long) s.charge,
+      "throttled", (unsigned long) s.throttled,
+      "throttle_time", (unsigned long long) s.throttle_time,
+      "refused", (unsigned long) s.refused);
+}
+
+static PyMethodDef Device_methods[] = {
+   { "close", (PyCFunction) Device_close, METH_NOARGS, "Release the device" },
+   { "__enter__", (PyCFunction) Device_enter, METH_NOARGS, NULL },
+   { "__exit__", (PyCFunction) Device_exit, METH_VARARGS, NULL },
+   { "measure", (PyCFunction) Device_measure, METH_NOARGS,
+     "measure() -> (temperature degC, pressure Pa)" },
+   { "sample", (PyCFunction) Device_sample, METH_NOARGS,
+     "sample() -> (timestamp us, ut, up, oss, temperature 0.1 degC, pressure Pa)" },
+   { "read_into", (PyCFunction)(void (*)(void)) Device_read_into, METH_VARARGS | METH_KEYWORDS,
+     "read_into(timestamp=None, ut=None, up=None, temperature=None, pressure=None) -> count\n"
+     "Take one sample per element of the shortest buffer (uint64 timestamps, int32 otherwise)" },
+   { "calibration", (PyCFunction) Device_calibration, METH_NOARGS,
+     "calibration() -> (AC1, AC2, AC3, AC4, AC5, AC6, B1, B2, MB, MC, MD)" },
+   { "stats", (PyCFunction)(void (*)(void)) Device_stats, METH_VARARGS | METH_KEYWORDS,
+     "stats(reset=False) -> dict with the fields of bmp180_stats_t" },
+   { NULL }
+};
+
+static PyTypeObject DeviceType = {
+   PyVarObject_HEAD_INIT(NULL, 0)
+   .tp_name = "bmp180.Device",
+   .tp_doc = "Device(device, address=0, mode=MODE_HIGH_RESOLUTION)",
+   .tp_basicsize = sizeof(DeviceObject),
+   .tp_flags = Py_TPFLAGS_DEFAULT,
+   .tp_new = PyType_GenericNew,
+   .tp_init = (initproc) Device_init,
+   .tp_dealloc = (destructor) Device_dealloc,
+   .tp_methods = Device_methods,
+};
+
+/* ----------------------------------------------------------------------------------------------
+ * Sampler
+ */
+
+static int Sampler_init(SamplerObject *self, PyObject *args, PyObject *kwds)
+{
+   static char *kwlist[] = { "device", "period", "capacity", "cpu", "priority", "lock_memory", NULL };
+   bmp180_sampler_config_t config = { 0 };
+   DeviceObject *device;
+   unsigned int period, capacity = 1024;
+   int cpu = -1, priority = 0, lock_memory = 0;
+
+   if(!PyArg_ParseTupleAndKeywords(args, kwds, "O!I|Iiip", kwlist, &DeviceType, &device, &period,
+                                   &capacity, &cpu, &priority, &lock_memory))
+      return -1;
+   if(!Device_check(device))
+      return -1;
+   if(device->busy > 0)
+   {
+      PyErr_SetString(PyExc_RuntimeError, "device is in use by another thread");
+      return -1;
+   }
+   if(NULL != self->sampler)
+   {
+      PyErr_SetString(PyExc_RuntimeError, "sampler already running");
+      return -1;
+   }
+
+   config.period = period;
+   config.capacity = capacity;
+   config.cpu = cpu;
+   config.priority = priority;
+   config.lock_memory = lock_memory;
+   self->sampler = bmp180_sampler_start(device->bmp, &config);
+   if(NULL == self->sampler)
+   {
+      PyErr_SetString(PyExc_OSError, "failed to start sampler");
+      return -1;
+   }
+   Py_INCREF(device);
+   ++device->samplers;
+   self->device = device;
+   return 0;
+}
+
+static void Sampler_stop_internal(SamplerObject *self)
+{
+   if(NULL != self->sampler)
+   {
+      bmp180_sampler_t sampler = self->sampler;
+      self->sampler = NULL;
+      Py_BEGIN_ALLOW_THREADS
+      bmp180_sampler_stop(sampler);
+      Py_END_ALLOW_THREADS
+      --self->device->samplers;
+   }
+   Py_CLEAR(self->device);
+}
+
+static void Sampler_dealloc(SamplerObject *self)
+{
+   Sampler_stop_internal(self);
+   Py_TYPE(self)->tp_free((PyObject *) self);
+}
+
+static PyObject *Sampler_stop(SamplerObject *self, PyObject *Py_UNUSED(args))
+{
+   if(self->readers > 0)
+   {
+      PyErr_SetString(PyExc_RuntimeError, "sampler is being read");
+      return NULL;
+   }
+   Sampler_stop_internal(self);
+   Py_RETURN_NONE;
+}
+
+static PyObject *Sampler_enter(SamplerObject *self, PyObject *Py_UNUSED(args))
+{
+   Py_INCREF(self);
+   return (PyObject *) self;
+}
+
+static PyObject *Sampler_exit(SamplerObject *self, PyObject *Py_UNUSED(args))
+{
+   return Sampler_stop(self, NULL);
+}
+
+static PyObject *Sampler_read_into(SamplerObject *self, PyObject *args, PyObject *kwds)
+{
+   static char *kwlist[] = { "timestamp", "ut", "up", "temperature", "pressure", "timeout", NULL };
+   PyObject *objs[COL_COUNT] = { NULL };
+   unsigned int timeout = 0;
+   bmp180_sampler_t sampler = self->sampler;
+   columns_t c;
+   Py_ssize_t n = 0;
+
+   if(NULL == sampler)
+   {
+      PyErr_SetString(PyExc_ValueError, "sampler is stopped");
+      return NULL;
+   }
+   if(!PyArg_ParseTupleAndKeywords(args, kwds, "|OOOOOI", kwlist, &objs[0], &objs[1], &objs[2],
+                                   &objs[3], &objs[4], &timeout))
+      return NULL;
+   if(!columns_get(&c, objs, column_kwlist, true))
+      return NULL;
+
+   /* The ring has a single consumer */
+   if(self->readers > 0)
+   {
+      columns_release(&c);
+      PyErr_SetString(PyExc_RuntimeError, "sampler is being read");
+      return NULL;
+   }
+
+   /* Drain what's queued, waiting up to 'timeout' only while nothing has been read */
+   ++self->readers;
+   Py_BEGIN_ALLOW_THREADS
+   while(n < c.length)
+   {
+      bmp180_sample_t chunk[READ_CHUNK];
+      size_t want = (size_t)((c.length - n < READ_CHUNK) ? c.length - n : READ_CHUNK);
+      size_t got = bmp180_sampler_read(sampler, chunk, want, (0 == n) ? timeout : 0);
+      for(size_t i = 0; i < got; ++i)
+         columns_store(&c, n + (Py_ssize_t) i, &chunk[i]);
+      n += (Py_ssize_t) got;
+      if(got < want)
+         break;
+   }
+   Py_END_ALLOW_THREADS
+   --self->readers;
+
+   columns_release(&c);
+   return PyLong_FromSsize_t(n);
+}
+
+static PyObject *Sampler_stats(SamplerObject *self, PyObject *Py_UNUSED(args))
+{
+   bmp180_sampler_stats_t s;
+   const bmp180_percentiles_t *p[2] = { &s.jitter, &s.start_delay };
+   PyObject *pct[2];
+   PyObject *result;
+
+   if(NULL == self->sampler)
+   {
+      PyErr_SetString(PyExc_ValueError, "sampler is stopped");
+      return NULL;
+   }
+   bmp180_sampler_get_stats(self->sampler, &s);
+   for(int i = 0; i < 2; ++i)
+   {
+      pct[i] = Py_BuildValue("{s:k,s:k,s:k,s:k,s:k}", "p50", (unsigned long) p[i]->p50,
+                             "p90", (unsigned long) p[i]->p90, "p99", (unsigned long) p[i]->p99,
+                             "p999", (unsigned long) p[i]->p999, "max", (unsigned long) p[i]->max);
+   }
+   if(NULL == pct[0] || NULL == pct[1])
+   {
+      Py_XDECREF(pct[0]);
+      Py_XDECREF(pct[1]);
+      return NULL;
+   }
+   result = Py_BuildValue("{s:K,s:K,s:K,s:K,s:K,s:N,s:N}",
+      "samples", (unsigned long long) s.samples, "errors", (unsigned long long) s.errors,
+      "missed", (unsigned long long) s.missed, "dropped", (unsigned long long) s.dropped,
+      "refused", (unsigned long long) s.refused,
+      "jitter", pct[0], "start_delay", pct[1]);
+   return result;
+}
+
+static PyMethodDef Sampler_methods[] = {
+   { "stop", (PyCFunction) Sampler_stop, METH_NOARGS, "Stop the worker thread" },
+   { "__enter__", (PyCFunction) Sampler_enter, METH_NOARGS, NULL },
+   { "__exit__", (PyCFunction) Sampler_exit, METH_VARARGS, NULL },
+   { "read_into", (PyCFunction)(void (*)(void)) Sampler_read_into, METH_VARARGS | METH_KEYWORDS,
+     "read_into(timestamp=None, ut=None, up=None, temperature=None, pressure=None, timeout=0) -> count\n"
+     "Move queued samples into the buffers, waiting up to 'timeout' microseconds for the first" },
+   { "stats", (PyCFunction) Sampler_stats, METH_NOARGS, "stats() -> dict" },
+   { NULL }
+};
+
+static PyTypeObject SamplerType = {
+   PyVarObject_HEAD_INIT(NULL, 0)
+   .tp_name = "bmp180.Sampler",
+   .tp_doc = "Sampler(device, period, capacity=1024, cpu=-1, priority=0, lock_memory=False)",
+   .tp_basicsize = sizeof(SamplerObject),
+   .tp_flags = Py_TPFLAGS_DEFAULT,
+   .tp_new = PyType_GenericNew,
+   .tp_init = (initproc) Sampler_init,
+   .tp_dealloc = (destructor) Sampler_dealloc,
+   .tp_methods = Sampler_methods,
+};
+
+/* ----------------------------------------------------------------------------------------------
+ * Module functions
+ */
+
+static PyObject *bmp180py_compensate(PyObject *Py_UNUSED(module), PyObject *args, PyObject *kwds)
+{
+   static char *kwlist[] = { "calibration", "oss", "ut", "up", "temperature", "pressure", NULL };
+   static const char *names[] = { NULL, "ut", "up", NULL, NULL };
+   static const char *out_names[] = { NULL, NULL, NULL, "temperature", "pressure" };
+   PyObject *in_objs[COL_COUNT] = { NULL };
+   PyObject *out_objs[COL_COUNT] = { NULL };
+   bmp180_calibration_t cal;
+   unsigned int oss;
+   columns_t in, out;
+   bool ok;
+
+   if(!PyArg_ParseTupleAndKeywords(args, kwds, "(hhhHHHhhhhh)IOO|OO", kwlist,
+                                   &cal.AC1, &cal.AC2, &cal.AC3, &cal.AC4, &cal.AC5, &cal.AC6,
+                                   &cal.B1, &cal.B2, &cal.MB, &cal.MC, &cal.MD, &oss,
+                                   &in_objs[COL_UT], &in_objs[COL_UP],
+                                   &out_objs[COL_TEMPERATURE], &out_objs[COL_PRESSURE]))
+      return NULL;
+   if(oss > BMP180_MODE_ULTRA_HIGH_RESOLUTION)
+   {
+      PyErr_SetString(PyExc_ValueError, "invalid oss");
+      return NULL;
+   }
+   if(!columns_get(&in, in_objs, names, false))
+      return NULL;
+   if(!columns_get(&out, out_objs, out_names, true))
+   {
+      columns_release(&in);
+      return NULL;
+   }
+   if(!in.used[COL_UT] || (out.used[COL_PRESSURE] && !in.used[COL_UP]) || in.length < out.length)
+   {
+      PyErr_SetString(PyExc_ValueError, "input buffers must be at least as long as the outputs");
+      columns_release(&in);
+      columns_release(&out);
+      return NULL;
+   }
+
+   Py_BEGIN_ALLOW_THREADS
+   ok = bmp180_compensate_batch(&cal, (uint8_t) oss, (const int32_t *) in.view[COL_UT].buf,
+      in.used[COL_UP] ? (const int32_t *) in.view[COL_UP].buf : NULL, (size_t) out.length,
+      out.used[COL_TEMPERATURE] ? (int32_t *) out.view[COL_TEMPERATURE].buf : NULL,
+      out.used[COL_PRESSURE] ? (int32_t *) out.view[COL_PRESSURE].buf : NULL);
+   Py_END_ALLOW_THREADS
+
+   columns_release(&in);
+   columns_release(&out);
+   if(!ok)
+      return PyErr_Format(PyExc_ValueError, "compensation failed");
+   return PyLong_FromSsize_t(out.length);
+}
+
+static PyObject *bmp180py_now(PyObject *Py_UNUSED(module), PyObject *Py_UNUSED(args))
+{
+   return PyLong_FromUnsignedLongLong(bmp180_now());
+}
+
+static PyObject *bmp180py_sim_set_values(PyObject *Py_UNUSED(module), PyObject *args)
+{
+   const char *device;
+   int ut, up;
+   unsigned int noise = 0;
+
+   if(!PyArg_ParseTuple(args, "sii|I", &device, &ut, &up, &noise))
+      return NULL;
+   if(!bmp180_sim_set_values(device, ut, up, noise))
+      return PyErr_Format(PyExc_ValueError, "%s is not a simulated bus", device);
+   Py_RETURN_NONE;
+}
+
+static PyMethodDef module_methods[] = {
+   { "compensate", (PyCFunction)(void (*)(void)) bmp180py_compensate, METH_VARARGS | METH_KEYWORDS,
+     "compensate(calibration, oss, ut, up, temperature=None, pressure=None) -> count\n"
+     "Compensate recorded int32 UT/UP buffers into int32 output buffers" },
+   { "now", bmp180py_now, METH_NOARGS, "now() -> monotonic time in microseconds" },
+   { "sim_set_values", bmp180py_sim_set_values, METH_VARARGS,
+     "sim_set_values(device, ut, up, noise=0): set the raw values of a simulated bus" },
+   { NULL }
+};
+
+static struct PyModuleDef module_def = {
+   PyModuleDef_HEAD_INIT,
+   .m_name = "bmp180",
+   .m_doc = "Bosch BMP180 pressure sensor library",
+   .m_size = -1,
+   .m_methods = module_methods,
+};
+
+PyMODINIT_FUNC PyInit_bmp180(void)
+{
+   PyObject *m;
+
+   if(PyType_Ready(&DeviceType) < 0 || PyType_Ready(&SamplerType) < 0)
+      return NULL;
+   m = PyModule_Create(&module_def);
+   if(NULL == m)
+      return NULL;
+
+   Py_INCREF(&DeviceType);
+   Py_INCREF(&SamplerType);
+   if(PyModule_AddObject(m, "Device", (PyObject *) &DeviceType) < 0
+   || PyModule_AddObject(m, "Sampler", (PyObject *) &SamplerType) < 0
+   || PyModule_AddIntConstant(m, "MODE_ULTRA_LOW_POWER", BMP180_MODE_ULTRA_LOW_POWER) < 0
+   || PyModule_AddIntConstant(m, "MODE_STANDARD", BMP180_MODE_STANDARD) < 0
+   || PyModule_AddIntConstant(m, "MODE_HIGH_RESOLUTION", BMP180_MODE_HIGH_RESOLUTION) < 0
+   || PyModule_AddIntConstant(m, "MODE_ULTRA_HIGH_RESOLUTION", BMP180_MODE_ULTRA_HIGH_RESOLUTION) < 0
+   || PyModule_AddStringConstant(m, "SIM_PREFIX", BMP180_SIM_PREFIX) < 0)
+   {
+      Py_DECREF(m);
+      return NULL;
+   }
+   return m;
+}
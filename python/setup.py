@@ -0,0 +1,30 @@
+# Copyright 2024 Zorxx Software. All rights reserved.
+# Builds the extension together with the library sources, e.g. `pip install ./python`
+import os
+import re
+from setuptools import setup, Extension
+
+root = os.path.abspath(os.path.join(os.path.dirname(__file__), '..'))
+lib = os.path.join(root, 'lib')
+
+
+def library_sources():
+    """BMP180_SOURCES from the top-level CMakeLists.txt, plus the simulated bus"""
+    with open(os.path.join(root, 'CMakeLists.txt')) as f:
+        match = re.search(r'set\(BMP180_SOURCES\s+([^)]*)\)', f.read())
+    return [os.path.join(root, s) for s in match.group(1).split()] + [os.path.join(lib, 'sim.c')]
+
+
+setup(
+    name='bmp180',
+    version='1.3.0',
+    description='Bosch BMP180 pressure sensor library',
+    license='MIT',
+    ext_modules=[Extension(
+        'bmp180',
+        sources=['bmp180module.c'] + library_sources(),
+        include_dirs=[lib, os.path.join(root, 'include'), os.path.join(root, 'include', 'bmp180')],
+        define_macros=[('SYS_SIM_ENABLE', None)],  # sim_set_values() and the tests use the simulated bus
+        extra_compile_args=['-std=gnu11'],
+        libraries=['m', 'pthread'])],
+)
@@ -0,0 +1,181 @@
+# Copyright 2024 Zorxx Software. All rights reserved.
+# Exercises the bindings against the simulated bus; NumPy is used when installed.
+import array
+import threading
+import time
+import unittest
+
+import bmp180
+
+try:
+    import numpy
+except ImportError:
+    numpy = None
+
+DEVICE = bmp180.SIM_PREFIX + '3'
+DATASHEET = (408, -72, -14383, 32741, 32757, 23153, 6190, 4, -32768, -8711, 2868)
+
+
+def columns(count):
+    return {'timestamp': array.array('Q', [0] * count),
+            'ut': array.array('i', [0] * count),
+            'up': array.array('i', [0] * count),
+            'temperature': array.array('i', [0] * count),
+            'pressure': array.array('i', [0] * count)}
+
+
+class DeviceTest(unittest.TestCase):
+    def test_measure(self):
+        with bmp180.Device(DEVICE, mode=bmp180.MODE_ULTRA_LOW_POWER) as dev:
+            self.assertEqual(dev.calibration(), DATASHEET)
+            temperature, pressure = dev.measure()
+            self.assertAlmostEqual(temperature, 15.0)
+            self.assertEqual(pressure, 69964)
+            timestamp, ut, up, oss, t, p = dev.sample()
+            self.assertEqual((ut, up, oss, t, p), (27898, 23843, 0, 150, 69964))
+            self.assertGreater(timestamp, 0)
+            stats = dev.stats()
+            self.assertEqual(stats['samples'][0], 2)
+            self.assertEqual(stats['conversion_time'][0], 2 * 9000)
+            self.assertEqual(stats['charge'], 2 * 3000)
+            self.assertEqual(stats['recoveries'], 0)
+            self.assertGreater(stats['bus_clocks'], 0)
+            self.assertEqual(len(stats['mode_time']), 4)
+        self.assertRaises(ValueError, dev.measure)
+
+    def test_open_failure(self):
+        self.assertRaises(OSError, bmp180.Device, bmp180.SIM_PREFIX + '99')
+
+    def test_reopen(self):
+        dev = bmp180.Device(DEVICE)
+        self.assertRaises(RuntimeError, dev.__init__, DEVICE)
+        dev.close()
+        dev.__init__(DEVICE, mode=bmp180.MODE_ULTRA_LOW_POWER)
+        self.assertEqual(dev.sample()[5], 69964)
+        dev.close()
+
+    def test_read_into(self):
+        c = columns(8)
+        with bmp180.Device(DEVICE, mode=bmp180.MODE_ULTRA_LOW_POWER) as dev:
+            self.assertEqual(dev.read_into(**c), 8)
+        self.assertEqual(list(c['pressure']), [69964] * 8)
+        self.assertEqual(list(c['ut']), [27898] * 8)
+        self.assertEqual(sorted(c['timestamp']), list(c['timestamp']))
+
+    def test_buffer_types(self):
+        with bmp180.Device(DEVICE) as dev:
+            self.assertRaises(TypeError, dev.read_into, pressure=array.array('d', [0.0]))
+            self.assertRaises(TypeError, dev.read_into, timestamp=array.array('i', [0]))
+            self.assertRaises(BufferError, dev.read_into, pressure=b'\0\0\0\0')
+
+    def test_close_while_reading(self):
+        """The device can't be closed or used by another thread while a read is in progress"""
+        errors = []
+        pressure = array.array('i', [0] * 64)
+
+        def interfere():
+            time.sleep(0.1)
+            for call in (dev.close, dev.sample, dev.measure):
+                try:
+                    call()
+                except RuntimeError:
+                    errors.append(call.__name__)
+
+        with bmp180.Device(DEVICE, mode=bmp180.MODE_ULTRA_LOW_POWER) as dev:
+            thread = threading.Thread(target=interfere)
+            thread.start()
+            self.assertEqual(dev.read_into(pressure=pressure), 64)
+            thread.join()
+        self.assertEqual(errors, ['close', 'sample', 'measure'])
+        self.assertEqual(list(pressure), [69964] * 64)
+
+
+class CompensateTest(unittest.TestCase):
+    def test_matches_scalar(self):
+        ut = array.array('i', [27898 + n for n in range(-50, 50)])
+        up = array.array('i', [23843 + 10 * n for n in range(-50, 50)])
+        t = array.array('i', [0] * len(ut))
+        p = array.array('i', [0] * len(ut))
+        self.assertEqual(bmp180.compensate(DATASHEET, 0, ut, up, t, p), len(ut))
+        self.assertEqual((t[50], p[50]), (150, 69964))
+        self.assertEqual(sorted(p), list(p))
+
+    def test_short_input(self):
+        out = array.array('i', [0] * 4)
+        self.assertRaises(ValueError, bmp180.compensate, DATASHEET, 0,
+                          array.array('i', [0] * 2), array.array('i', [0] * 2), out)
+
+    def test_invalid_calibration(self):
+        """A zero denominator is reported rather than crashing the interpreter"""
+        cal = (0,) * 11
+        out = array.array('i', [0])
+        self.assertRaises(ValueError, bmp180.compensate, cal, 0, array.array('i', [0]),
+                          array.array('i', [0]), out, out)
+
+    @unittest.skipIf(numpy is None, 'NumPy not installed')
+    def test_numpy(self):
+        ut = numpy.full(1000, 27898, dtype=numpy.int32)
+        up = numpy.full(1000, 23843, dtype=numpy.int32)
+        t = numpy.empty_like(ut)
+        p = numpy.empty_like(up)
+        bmp180.compensate(DATASHEET, 0, ut, up, temperature=t, pressure=p)
+        self.assertTrue((t == 150).all() and (p == 69964).all())
+
+
+class SamplerTest(unittest.TestCase):
+    def test_read_into(self):
+        c = columns(64)
+        got = 0
+        with bmp180.Device(DEVICE, mode=bmp180.MODE_ULTRA_LOW_POWER) as dev:
+            with bmp180.Sampler(dev, 10000, capacity=16) as sampler:
+                self.assertRaises(RuntimeError, dev.close)
+                self.assertRaises(RuntimeError, dev.sample)
+                self.assertRaises(RuntimeError, dev.measure)
+                while got < 5:
+                    view = {k: memoryview(v)[got:] for k, v in c.items()}
+                    got += sampler.read_into(timeout=1000000, **view)
+                stats = sampler.stats()
+            self.assertGreaterEqual(stats['samples'], 5)
+        self.assertEqual(list(c['pressure'][:got]), [69964] * got)
+        self.assertRaises(ValueError, sampler.read_into)
+
+    def test_one_reader(self):
+        """A second thread can't read while another read is blocked"""
+        errors = []
+
+        def read():
+            time.sleep(0.1)
+            try:
+                sampler.read_into(pressure=array.array('i', [0]))
+            except RuntimeError:
+                errors.append(1)
+
+        with bmp180.Device(DEVICE) as dev:
+            with bmp180.Sampler(dev, 1000000) as sampler:
+                thread = threading.Thread(target=read)
+                thread.start()
+                sampler.read_into(pressure=array.array('i', [0] * 4), timeout=500000)
+                thread.join()
+        self.assertEqual(errors, [1])
+
+    def test_releases_gil(self):
+        """Another Python thread keeps running while a read is blocked"""
+        ticks = []
+        stop = threading.Event()
+
+        def spin():
+            while not stop.is_set():
+                ticks.append(1)
+
+        with bmp180.Device(DEVICE) as dev:
+            with bmp180.Sampler(dev, 1000000) as sampler:
+                thread = threading.Thread(target=spin)
+                thread.start()
+                sampler.read_into(pressure=array.array('i', [0]), timeout=200000)
+                stop.set()
+                thread.join()
+        self.assertGreater(len(ticks), 0)
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -2,7 +2,22 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <inttypes.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <string.h>
 #include "bmp180_private.h"
+#include "bmp180/aggregate.h"
+#include "bmp180/estimator.h"
+#include "bmp180/sim.h"
+#include "bmp180/sampler.h"
+#include "bmp180/discover.h"
+#include "bmp180/iio.h"
+#include "bmp180/group.h"
+#include "bmp180/snapshot.h"
+#include <stdlib.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <math.h>
 
 typedef struct
 {
@@ -40,6 +55,1384 @@ static t_test_vector test_vectors[] =
      98032L }, /* result (compensated) pressure, in pascals */
 };
 
+/* Readings the algorithm can't compensate; the result fields are unused */
+static t_test_vector invalid_vectors[] =
+{
+   /* X1 + MD is zero, in the temperature stage's division */
+   { { 408, -72, -14383, 32741, 32757, 23153, 6190, 4, -32768, -8711, 2868 },
+     0, 20285L, 23843L, 0L, 0L },
+
+   /* AC4 of zero makes B4 zero, in the pressure stage's division */
+   { { 408, -72, -14383, 0, 32757, 23153, 6190, 4, -32768, -8711, 2868 },
+     0, 27898L, 23843L, 150L, 0L },
+};
+
+static bool test_filters(void)
+{
+    const bmp180_filter_config_t configs[] =
+    {
+        { BMP180_FILTER_BOXCAR, BMP180_FILTER_STAGE_RAW, 8, 0, 0 },
+        { BMP180_FILTER_CIC, BMP180_FILTER_STAGE_RAW, 4, 3, 0 },
+        { BMP180_FILTER_IIR, BMP180_FILTER_STAGE_RAW, 2, 0, 3 },
+    };
+    bool success = true;
+
+    for(size_t i = 0; i < ARRAY_SIZE(configs); ++i)
+    {
+        const bmp180_filter_config_t *c = &configs[i];
+        t_bmp180_filter f;
+        int outputs = 0, inputs = 0;
+        int32_t y;
+
+        if(!bmp180_filter_init(&f, c))
+        {
+            SDBG("Filter %zu: initialization failed", i+1);
+            success = false;
+            continue;
+        }
+
+        /* Alternating input averages to 23843.5; every output (after any warm-up)
+           must land on it, and one must arrive every 'decimation' inputs */
+        while(outputs < 8 && inputs < 1000)
+        {
+            int32_t x = 23843 + (inputs++ & 1);
+            if(!bmp180_filter_push(&f, x, &y))
+                continue;
+            ++outputs;
+            if(inputs % c->decimation != 0)
+            {
+                SDBG("Filter %zu: output after %d inputs", i+1, inputs);
+                success = false;
+            }
+            if(c->type != BMP180_FILTER_IIR && y != (47687 << (BMP180_FILTER_FRAC_BITS - 1)))
+            {
+                SDBG("Filter %zu: output %" PRIi32 " after %d inputs", i+1, y, inputs);
+                success = false;
+            }
+            if(c->type == BMP180_FILTER_IIR && (y >> BMP180_FILTER_FRAC_BITS) != 23843)
+            {
+                SDBG("Filter %zu: output %" PRIi32 " after %d inputs", i+1, y, inputs);
+                success = false;
+            }
+        }
+        if(outputs < 8)
+        {
+            SDBG("Filter %zu: only %d outputs", i+1, outputs);
+            success = false;
+        }
+        else
+        {
+            SDBG("Filter test case %zu success", i+1);
+        }
+    }
+
+    /* An unknown stage is rejected rather than taken as compensated */
+    {
+        const bmp180_filter_config_t bad = { BMP180_FILTER_BOXCAR, (bmp180_filter_stage_t) 2, 8, 0, 0 };
+        t_bmp180_filter f;
+        if(bmp180_filter_init(&f, &bad))
+        {
+            SDBG("Filter: invalid stage accepted");
+            success = false;
+        }
+    }
+    return success;
+}
+
+static bool test_aggregate(void)
+{
+    const bmp180_aggregate_config_t configs[] =
+    {
+        { BMP180_WINDOW_TUMBLING, 10, 0 },
+        { BMP180_WINDOW_SLIDING, 7, 3 },
+    };
+    bool success = true;
+
+    for(size_t i = 0; i < ARRAY_SIZE(configs); ++i)
+    {
+        const bmp180_aggregate_config_t *c = &configs[i];
+        bmp180_aggregate_t agg = bmp180_aggregate_init(c);
+        int32_t history[100];
+        int reports = 0;
+
+        if(NULL == agg)
+        {
+            SDBG("Aggregate %zu: initialization failed", i+1);
+            success = false;
+            continue;
+        }
+
+        for(int n = 0; n < (int) ARRAY_SIZE(history); ++n)
+        {
+            bmp180_sample_t sample = { 0 };
+            bmp180_summary_t s;
+            int32_t min = INT32_MAX, max = INT32_MIN;
+            int64_t sum = 0;
+
+            sample.timestamp = n;
+            sample.pressure = history[n] = 100000 + (int32_t)((n * 7919) % 61) - 30;
+            sample.temperature = 250;
+            if(!bmp180_aggregate_push(agg, &sample, &s))
+                continue;
+
+            /* Compare with a brute-force computation over the same window */
+            ++reports;
+            for(int k = n + 1 - (int) c->length; k <= n; ++k)
+            {
+                if(history[k] < min) min = history[k];
+                if(history[k] > max) max = history[k];
+                sum += history[k];
+            }
+            if(s.count != c->length || s.start != (uint64_t)(n + 1 - c->length) || s.end != (uint64_t) n
+            || s.pressure.min != min || s.pressure.max != max
+            || (int64_t)(s.pressure.mean * c->length + 0.5f) != sum
+            || s.temperature.min != 250 || s.temperature.stddev != 0.0f)
+            {
+                SDBG("Aggregate %zu: mismatch at sample %d (min %" PRIi32 "/%" PRIi32 ", max %" PRIi32 "/%" PRIi32 ")",
+                   i+1, n, s.pressure.min, min, s.pressure.max, max);
+                success = false;
+            }
+        }
+        if(reports == 0)
+            success = false;
+        else
+        {
+            SDBG("Aggregate test case %zu success (%d windows)", i+1, reports);
+        }
+        bmp180_aggregate_free(agg);
+    }
+    return success;
+}
+
+static double reference_altitude(double pressure)
+{
+    return 44330000.0 * (1.0 - pow(pressure / BMP180_SEA_LEVEL_PRESSURE, 1.0 / 5.255));
+}
+
+static bool test_estimator(void)
+{
+    const bmp180_estimator_config_t config = { 20000, 0, 300, 500 };
+    const double T = config.period / 1e6;
+    bmp180_estimator_t est = bmp180_estimator_init(&config);
+    double lambda, r, alpha, beta, h = 0, v = 0;
+    double err_measured = 0, err_filtered = 0, max_h = 0, max_v = 0;
+    bool success = true;
+
+    /* Table interpolation against the formula */
+    for(int32_t p = 30000; p <= 110000; p += 97)
+    {
+        double e = fabs(bmp180_altitude(p, 0) - reference_altitude(p));
+        if(e > 200.0 || (p >= 80000 && e > 25.0))
+        {
+            SDBG("Estimator: altitude at %" PRIi32 " Pa is off by %.0f mm", p, e);
+            success = false;
+            break;
+        }
+    }
+    if(bmp180_altitude(BMP180_SEA_LEVEL_PRESSURE, 0) != 0 || bmp180_altitude(100000, 100000) != 0)
+        success = false;
+
+    if(NULL == est)
+        return false;
+
+    /* Floating-point reference with the same model */
+    lambda = (double) config.acceleration_noise * T * T / config.altitude_noise;
+    r = (4.0 + lambda - sqrt(8.0 * lambda + lambda * lambda)) / 4.0;
+    alpha = 1.0 - r * r;
+    beta = 2.0 * (1.0 - r) * (1.0 - r);
+
+    /* Hover for 2 s, climb at 2 m/s for 10 s, hover for 8 s, with +/-3 Pa of noise */
+    for(int n = 0; n < 1000; ++n)
+    {
+        double t = n * T;
+        double truth = 150000.0 + 2000.0 * ((t < 2.0) ? 0.0 : (t < 12.0) ? t - 2.0 : 10.0);
+        bmp180_sample_t sample = { 0 };
+        bmp180_estimate_t estimate;
+        double z;
+
+        sample.timestamp = 1000000 + (uint64_t) n * config.period;
+        sample.pressure = (int32_t) lround(BMP180_SEA_LEVEL_PRESSURE * pow(1.0 - truth / 44330000.0, 5.255))
+                        + (int32_t)((n * 7919) % 7) - 3;
+        if(!bmp180_estimator_push(est, &sample, &estimate))
+        {
+            success = false;
+            break;
+        }
+
+        z = reference_altitude(sample.pressure);
+        if(n == 0)
+            h = z;
+        else
+        {
+            double residual = z - (h + v * T);
+            h = h + v * T + alpha * residual;
+            v = v + beta / T * residual;
+        }
+        if(fabs(estimate.altitude - h) > max_h) max_h = fabs(estimate.altitude - h);
+        if(fabs(estimate.speed - v) > max_v) max_v = fabs(estimate.speed - v);
+        if(t >= 15.0)
+        {
+            err_measured += (estimate.measured - truth) * (estimate.measured - truth);
+            err_filtered += (estimate.altitude - truth) * (estimate.altitude - truth);
+        }
+        if((n == 550 && fabs(estimate.speed - 2000.0) > 300.0) || (n == 999 && abs(estimate.speed) > 300))
+        {
+            SDBG("Estimator: speed %" PRIi32 " mm/s at %.1f s", estimate.speed, t);
+            success = false;
+        }
+    }
+    if(max_h > 50.0 || max_v > 50.0 || err_filtered * 4 > err_measured)
+    {
+        SDBG("Estimator: max difference from reference %.0f mm, %.0f mm/s; RMS error %.0f mm (unfiltered %.0f mm)",
+           max_h, max_v, sqrt(err_filtered / 250), sqrt(err_measured / 250));
+        success = false;
+    }
+
+    /* A gap of three periods is predicted across; a long one restarts the estimator */
+    {
+        bmp180_sample_t sample = { 0 };
+        bmp180_estimate_t a, b;
+        bmp180_estimator_reset(est);
+        for(int n = 0; n < 200; ++n)
+        {
+            sample.timestamp = 1000000 + (uint64_t) n * config.period;
+            sample.pressure = 100000 - n; /* climbing at about 4.2 m/s */
+            bmp180_estimator_push(est, &sample, &a);
+        }
+        sample.timestamp += 3 * config.period;
+        sample.pressure -= 3;
+        bmp180_estimator_push(est, &sample, &b);
+        if(abs(a.speed - 4200) > 400 || b.altitude - a.altitude < 150 || b.altitude - a.altitude > 350)
+        {
+            SDBG("Estimator: %" PRIi32 " mm/s, %" PRIi32 " mm across a gap", a.speed, b.altitude - a.altitude);
+            success = false;
+        }
+        sample.timestamp += 100 * config.period;
+        bmp180_estimator_push(est, &sample, &b);
+        if(b.speed != 0 || b.altitude != b.measured)
+            success = false;
+    }
+
+    if(NULL != bmp180_estimator_init(&(bmp180_estimator_config_t){ 0, 0, 300, 500 }))
+        success = false;
+    bmp180_estimator_free(est);
+    if(success)
+    {
+        SDBG("Estimator test success (max difference from reference %.1f mm, %.1f mm/s)", max_h, max_v);
+    }
+    return success;
+}
+
+typedef struct
+{
+    int events;
+    bmp180_event_t last;
+} t_notify_result;
+
+static void notify_callback(const bmp180_event_t *event, void *arg)
+{
+    t_notify_result *r = (t_notify_result *) arg;
+    ++r->events;
+    r->last = *event;
+}
+
+static bool test_notify(void)
+{
+    const bmp180_threshold_config_t config = { 10, 5, 0, 0, 1000 };
+    bmp180_context_t ctx = { 0 };
+    t_notify_result r = { 0 };
+    bmp180_sample_t sample = { 0 };
+    bool success = true;
+
+    if(bmp180_subscribe(&ctx, &config, notify_callback, &r) != 0)
+        return false;
+
+    /* First sample is always delivered; noise within the deadband is not */
+    sample.pressure = 100000;
+    bmp180_notify(&ctx, &sample);
+    for(int i = 1; i <= 20; ++i)
+    {
+        sample.timestamp = i;
+        sample.pressure = 100000 + ((i & 1) ? 7 : -7);
+        bmp180_notify(&ctx, &sample);
+    }
+    if(r.events != 1 || r.last.reason != BMP180_EVENT_FIRST)
+    {
+        SDBG("Notify: %d events after noise", r.events);
+        success = false;
+    }
+
+    /* Rising past the deadband; falling back needs deadband + hysteresis */
+    sample.timestamp = 21;
+    sample.pressure = 100011;
+    bmp180_notify(&ctx, &sample);
+    if(r.events != 2 || r.last.reason != BMP180_EVENT_PRESSURE || r.last.suppressed != 20
+    || r.last.summary.count != 21 || r.last.summary.pressure.min != 99993 || r.last.summary.pressure.max != 100011)
+    {
+        SDBG("Notify: unexpected rising event (%d events, %" PRIu32 " suppressed)", r.events, r.last.suppressed);
+        success = false;
+    }
+    sample.timestamp = 22;
+    sample.pressure = 100011 - 14;
+    bmp180_notify(&ctx, &sample);
+    sample.timestamp = 23;
+    sample.pressure = 100011 - 16;
+    bmp180_notify(&ctx, &sample);
+    if(r.events != 3 || r.last.sample.pressure != 100011 - 16 || r.last.suppressed != 1)
+    {
+        SDBG("Notify: unexpected hysteresis behavior (%d events)", r.events);
+        success = false;
+    }
+
+    /* Heartbeat */
+    sample.timestamp = 23 + 1000;
+    bmp180_notify(&ctx, &sample);
+    if(r.events != 4 || r.last.reason != BMP180_EVENT_HEARTBEAT)
+    {
+        SDBG("Notify: missing heartbeat (%d events)", r.events);
+        success = false;
+    }
+
+    if(!bmp180_unsubscribe(&ctx, 0))
+        success = false;
+    if(success)
+    {
+        SDBG("Notify test success");
+    }
+    return success;
+}
+
+static bool test_adaptive(void)
+{
+    const bmp180_adaptive_config_t config =
+       { BMP180_MODE_ULTRA_LOW_POWER, BMP180_MODE_ULTRA_HIGH_RESOLUTION, 0, 2, 0, 0 };
+    bmp180_context_t ctx = { 0 };
+    bmp180_sample_t sample = { 0 };
+    bool success = true;
+
+    bmp180_set_mode(&ctx, BMP180_MODE_STANDARD);
+    if(!bmp180_set_adaptive(&ctx, &config))
+        return false;
+
+    /* Calm conditions, 10 Hz: highest resolution */
+    for(int i = 0; i < 10; ++i)
+    {
+        sample.timestamp += 100000;
+        sample.pressure = 100000 + (i & 1);
+        bmp180_adapt(&ctx, &sample);
+    }
+    if(ctx.mode != BMP180_MODE_ULTRA_HIGH_RESOLUTION)
+    {
+        SDBG("Adaptive: mode %d in calm conditions", ctx.mode);
+        success = false;
+    }
+
+    /* 1000 Pa/s: only ULTRA_LOW_POWER converts fast enough to stay within its noise */
+    for(int i = 0; i < 20; ++i)
+    {
+        sample.timestamp += 100000;
+        sample.pressure += 100;
+        bmp180_adapt(&ctx, &sample);
+    }
+    if(ctx.mode != BMP180_MODE_ULTRA_LOW_POWER || ctx.stats.mode_changes < 2)
+    {
+        SDBG("Adaptive: mode %d after fast change (%" PRIu32 " switches)", ctx.mode, ctx.stats.mode_changes);
+        success = false;
+    }
+
+    /* Bus budget of 10% at 10 Hz allows at most 10 ms of conversion per sample */
+    bmp180_adaptive_config_t budget = config;
+    budget.bus_budget = 100;
+    bmp180_set_adaptive(&ctx, &budget);
+    for(int i = 0; i < 10; ++i)
+    {
+        sample.timestamp += 100000;
+        bmp180_adapt(&ctx, &sample);
+    }
+    if(ctx.mode != BMP180_MODE_ULTRA_LOW_POWER)
+    {
+        SDBG("Adaptive: mode %d with bus budget", ctx.mode);
+        success = false;
+    }
+    budget.bus_budget = 200;
+    bmp180_set_adaptive(&ctx, &budget);
+    for(int i = 0; i < 10; ++i)
+    {
+        sample.timestamp += 100000;
+        bmp180_adapt(&ctx, &sample);
+    }
+    if(ctx.mode != BMP180_MODE_HIGH_RESOLUTION)
+    {
+        SDBG("Adaptive: mode %d with 20%% bus budget", ctx.mode);
+        success = false;
+    }
+
+    if(success)
+    {
+        SDBG("Adaptive test success");
+    }
+    return success;
+}
+
+static bool test_recovery(void)
+{
+    const char *device = BMP180_SIM_PREFIX "0";
+    const bmp180_recovery_config_t policy = { 3, 1000, 8000, true, true };
+    const struct
+    {
+        const char *name;
+        bmp180_sim_faults_t faults;
+        uint32_t retries, soft_resets, reopens;
+    } cases[] =
+    {
+        { "transient", { .fail_next = 1 }, 1, 0, 0 },
+        { "hang",      { .hang = true },   2, 1, 0 },
+        { "wedge",     { .wedge = true },  2, 1, 1 },
+    };
+    i2c_lowlevel_config config = { .device = device };
+    bmp180_sample_t sample;
+    bmp180_stats_t stats;
+    bool success = true;
+    bmp180_t bmp;
+
+    bmp = bmp180_init(&config, 0, BMP180_MODE_ULTRA_LOW_POWER);
+    if(NULL == bmp)
+        return false;
+    if(!bmp180_sample(bmp, &sample) || sample.temperature != 150 || sample.pressure != 69964)
+    {
+        SDBG("Recovery: simulated sample mismatch");
+        success = false;
+    }
+
+    /* Without a policy, a fault fails the measurement */
+    bmp180_sim_set_faults(device, &cases[0].faults);
+    if(bmp180_sample(bmp, &sample))
+        success = false;
+
+    bmp180_set_recovery(bmp, &policy);
+    for(size_t i = 0; i < ARRAY_SIZE(cases); ++i)
+    {
+        bmp180_reset_stats(bmp);
+        bmp180_sim_set_faults(device, &cases[i].faults);
+        if(!bmp180_sample(bmp, &sample) || !bmp180_get_stats(bmp, &stats)
+        || stats.recoveries != 1 || stats.retries != cases[i].retries
+        || stats.soft_resets != cases[i].soft_resets || stats.reopens != cases[i].reopens
+        || sample.pressure != 69964)
+        {
+            SDBG("Recovery: %s fault not recovered as expected", cases[i].name);
+            success = false;
+        }
+        else
+        {
+            SDBG("Recovery test case %s success: recovered in %" PRIu32 " us", cases[i].name,
+               stats.max_recovery_time);
+        }
+    }
+    bmp180_sim_set_faults(device, NULL);
+    bmp180_free(bmp);
+    return success;
+}
+
+static void *cancel_thread(void *arg)
+{
+    usleep(3000);
+    bmp180_cancel((bmp180_t) arg);
+    return NULL;
+}
+
+static bool test_deadline(void)
+{
+    const char *device = BMP180_SIM_PREFIX "1";
+    i2c_lowlevel_config config = { .device = device };
+    /* Deadlines only shorten the transaction timeout when one was requested */
+    bmp180_options_t options = { BMP180_OPTIONS_VERSION, BMP180_MODE_ULTRA_HIGH_RESOLUTION };
+    bmp180_sim_faults_t stall = { .stall = 200000 };
+    bmp180_sim_counters_t counters;
+    bmp180_sample_t sample;
+    bmp180_stats_t stats;
+    bool success = true;
+    uint64_t start, elapsed;
+    pthread_t thread;
+    bmp180_t bmp;
+
+    options.timeout = BMP180_DEFAULT_TIMEOUT;
+    bmp = bmp180_init_ex(&config, 0, &options);
+    if(NULL == bmp)
+        return false;
+
+    /* A stalled bus is abandoned at the deadline, not after the stall */
+    bmp180_sim_set_faults(device, &stall);
+    start = bmp180_now();
+    if(bmp180_sample_until(bmp, &sample, start + 20000))
+        success = false;
+    elapsed = bmp180_now() - start;
+    bmp180_sim_set_faults(device, NULL);
+    bmp180_get_stats(bmp, &stats);
+    if(elapsed > 40000 || stats.timeouts != 1)
+    {
+        SDBG("Deadline: stalled sample took %" PRIu64 " us (%" PRIu32 " timeouts)", elapsed, stats.timeouts);
+        success = false;
+    }
+
+    /* Not enough time for the pressure conversion: the temperature is kept for the retry */
+    bmp180_sim_get_counters(device, NULL, true);
+    if(bmp180_sample_until(bmp, &sample, bmp180_now() + 10000))
+        success = false;
+    if(!bmp180_sample_until(bmp, &sample, bmp180_now() + 40000) || sample.pressure < 69960 || sample.pressure > 69970)
+    {
+        SDBG("Deadline: resumed sample failed (%" PRIi32 " Pa)", sample.pressure);
+        success = false;
+    }
+    bmp180_sim_get_counters(device, &counters, false);
+    if(counters.conversions != 2)
+    {
+        SDBG("Deadline: %" PRIu32 " conversions for a resumed sample", counters.conversions);
+        success = false;
+    }
+
+    /* Cancellation from another thread */
+    start = bmp180_now();
+    pthread_create(&thread, NULL, cancel_thread, bmp);
+    if(bmp180_sample(bmp, &sample))
+        success = false;
+    elapsed = bmp180_now() - start;
+    pthread_join(thread, NULL);
+    bmp180_get_stats(bmp, &stats);
+    if(elapsed > 20000 || stats.cancellations != 1)
+    {
+        SDBG("Deadline: cancelled sample took %" PRIu64 " us", elapsed);
+        success = false;
+    }
+
+    if(success)
+    {
+        SDBG("Deadline test success");
+    }
+    bmp180_free(bmp);
+    return success;
+}
+
+static bool test_sampler(void)
+{
+    const bmp180_sampler_config_t sampler_config = { 15000, -1, 0, false, 4 };
+    const bmp180_sampler_config_t invalid_cpu = { 15000, 1 << 20, 0, false, 4 };
+    i2c_lowlevel_config config = { .device = BMP180_SIM_PREFIX "2" };
+    bmp180_sample_t samples[8];
+    bmp180_sampler_stats_t stats;
+    bmp180_sampler_t sampler;
+    bool success = true;
+    uint64_t first = 0, last = 0;
+    size_t total = 0;
+    bmp180_t bmp;
+
+    bmp = bmp180_init(&config, 0, BMP180_MODE_ULTRA_LOW_POWER);
+    if(NULL == bmp)
+        return false;
+
+    /* A CPU past CPU_SETSIZE is rejected */
+    if(NULL != (sampler = bmp180_sampler_start(bmp, &invalid_cpu)))
+    {
+        SDBG("Sampler: started on CPU %d", invalid_cpu.cpu);
+        bmp180_sampler_stop(sampler);
+        success = false;
+    }
+
+    sampler = bmp180_sampler_start(bmp, &sampler_config);
+    if(NULL == sampler)
+    {
+        bmp180_free(bmp);
+        return false;
+    }
+
+    while(total < 10)
+    {
+        size_t count = bmp180_sampler_read(sampler, samples, ARRAY_SIZE(samples), 100000);
+        if(count == 0)
+            break;
+        if(total == 0)
+            first = samples[0].timestamp;
+        last = samples[count - 1].timestamp;
+        total += count;
+    }
+    bmp180_sampler_get_stats(sampler, &stats);
+    bmp180_sampler_stop(sampler);
+
+    /* Absolute deadlines: samples start on the period grid (give or take the start delay of
+       the first and last samples), even if a loaded machine makes the worker skip a period */
+    uint64_t offset = (last - first + 5000) % 15000;
+    if(total < 10 || last - first + 5000 < (total - 1) * 15000 || offset > 10000)
+    {
+        SDBG("Sampler: %zu samples over %" PRIu64 " us", total, last - first);
+        success = false;
+    }
+    else
+    {
+        SDBG("Sampler test success: jitter p50 %" PRIu32 " us, p99 %" PRIu32 " us, start delay p99 %" PRIu32 " us",
+           stats.jitter.p50, stats.jitter.p99, stats.start_delay.p99);
+    }
+
+    bmp180_free(bmp);
+    return success;
+}
+
+static bool test_discover(void)
+{
+    const char *devices[] = { BMP180_SIM_PREFIX "4", BMP180_SIM_PREFIX "5", BMP180_SIM_PREFIX "6",
+                              BMP180_SIM_PREFIX "7", BMP180_SIM_PREFIX "99" };
+    const uint8_t addresses[] = { 0x76, BMP180_DEVICE_ADDRESS };
+    const bmp180_discover_config_t config =
+       { devices, ARRAY_SIZE(devices), addresses, ARRAY_SIZE(addresses), BMP180_MODE_STANDARD };
+    const bmp180_sim_faults_t stall = { .stall = 5000 };
+    bmp180_discovered_t found[8];
+    bmp180_sim_counters_t counters;
+    uint64_t elapsed, last_start = 0, first_end = UINT64_MAX;
+    bool success = true;
+    size_t count;
+
+    /* Three 5 ms transactions per adapter (one probe at 0x76, ID and calibration at 0x77) */
+    for(size_t i = 0; i < 4; ++i)
+    {
+        bmp180_sim_set_faults(devices[i], &stall);
+        bmp180_sim_get_counters(devices[i], NULL, true);
+    }
+    count = bmp180_discover(&config, found, ARRAY_SIZE(found), &elapsed);
+    for(size_t i = 0; i < 4; ++i)
+    {
+        bmp180_sim_set_faults(devices[i], NULL);
+        bmp180_sim_get_counters(devices[i], &counters, false);
+        if(counters.first_start > last_start)
+            last_start = counters.first_start;
+        if(counters.last_end < first_end)
+            first_end = counters.last_end;
+    }
+
+    /* The adapters are probed concurrently: every one of them started before any finished */
+    if(count != 4 || last_start >= first_end)
+    {
+        SDBG("Discover: %zu devices, probes overlap %" PRId64 " us", count, (int64_t)(first_end - last_start));
+        success = false;
+    }
+    for(size_t i = 0; i < count; ++i)
+    {
+        bmp180_sample_t sample;
+        if(strcmp(found[i].device, devices[i]) != 0 || found[i].address != BMP180_DEVICE_ADDRESS
+        || !bmp180_sample(found[i].bmp, &sample) || sample.pressure < 69960 || sample.pressure > 69970)
+        {
+            SDBG("Discover: unexpected device %zu (%s:0x%02x)", i, found[i].device, found[i].address);
+            success = false;
+        }
+        bmp180_free(found[i].bmp);
+    }
+    if(success)
+    {
+        SDBG("Discover test success: %zu devices in %" PRIu64 " us", count, elapsed);
+    }
+    return success;
+}
+
+static bool test_init_ex(void)
+{
+    const char *device = BMP180_SIM_PREFIX "3";
+    i2c_lowlevel_config config = { .device = device };
+    bmp180_calibration_t cache = { 0 }, supplied, cal;
+    bmp180_options_t options = { BMP180_OPTIONS_VERSION, BMP180_MODE_ULTRA_LOW_POWER };
+    bmp180_sim_counters_t counters;
+    uint32_t latency[BMP180_MODE_COUNT], fixed[BMP180_MODE_COUNT];
+    bmp180_sample_t sample;
+    bmp180_t bmp;
+    bool success = true;
+
+    bmp180_sim_get_counters(device, &counters, true);
+
+    /* Defaults: ID and calibration reads, and the datasheet conversion times plus 500 us */
+    bmp = bmp180_init_ex(&config, 0, &options);
+    if(NULL == bmp || !bmp180_get_latency(bmp, fixed)
+    || !bmp180_sim_get_counters(device, &counters, true) || counters.transactions != 2)
+        return false;
+    /* 17 bytes of 9 clocks at 400 kHz */
+    if(fixed[0] != 4500 + 500 + 4500 + 500 + 383 || fixed[3] != 4500 + 500 + 25500 + 500 + 383)
+    {
+        SDBG("Init options: default latency %" PRIu32 "/%" PRIu32 " us", fixed[0], fixed[3]);
+        success = false;
+    }
+    bmp180_free(bmp);
+
+    /* A cache is filled on first use, then spares the EEPROM read */
+    options.calibration_source = BMP180_CALIBRATION_CACHE;
+    options.calibration = &cache;
+    for(int i = 0; i < 2; ++i)
+    {
+        bmp = bmp180_init_ex(&config, 0, &options);
+        bmp180_sim_get_counters(device, &counters, true);
+        if(NULL == bmp || counters.transactions != (uint32_t)(2 - i) || cache.AC1 != 408 || cache.MD != 2868)
+        {
+            SDBG("Init options: cache pass %d, %" PRIu32 " transactions", i, counters.transactions);
+            success = false;
+        }
+        bmp180_free(bmp);
+    }
+
+    /* Supplied coefficients are used as given */
+    supplied = cache;
+    supplied.AC1 = 409;
+    options.calibration_source = BMP180_CALIBRATION_SUPPLIED;
+    options.calibration = &supplied;
+    bmp = bmp180_init_ex(&config, 0, &options);
+    bmp180_sim_get_counters(device, &counters, true);
+    if(NULL == bmp || counters.transactions != 1 || !bmp180_get_calibration(bmp, &cal) || cal.AC1 != 409)
+        success = false;
+    bmp180_free(bmp);
+
+    /* Polling reads the control register after each conversion; the simulated device is
+       always done, so one poll each. The latency is the worst case: polls every 250 us from
+       1 ms before the conversion time to 500 us after it, at 100 kHz. */
+    options.calibration_source = BMP180_CALIBRATION_EEPROM;
+    options.margin_policy = BMP180_MARGIN_POLL;
+    options.margin = 1000;
+    options.speed = 100000;
+    bmp = bmp180_init_ex(&config, 0, &options);
+    bmp180_sim_get_counters(device, &counters, true);
+    if(NULL == bmp || !bmp180_sample(bmp, &sample) || sample.pressure != 69964
+    || !bmp180_sim_get_counters(device, &counters, true) || counters.transactions != 6
+    || !bmp180_get_latency(bmp, latency) || latency[0] != 4500 + 500 + 4500 + 500 + (17 + 2 * 7 * 4) * 90)
+    {
+        SDBG("Init options: polling failed (%" PRIu32 " transactions)", counters.transactions);
+        success = false;
+    }
+    bmp180_free(bmp);
+
+    options.margin_policy = BMP180_MARGIN_PROPORTIONAL;
+    options.margin = 0;
+    options.speed = 0;
+    bmp = bmp180_init_ex(&config, 0, &options);
+    if(NULL == bmp || !bmp180_get_latency(bmp, latency) || latency[0] != 4500 + 4500 + 383)
+        success = false;
+    bmp180_free(bmp);
+
+    options.version = BMP180_OPTIONS_VERSION + 1;
+    if(NULL != bmp180_init_ex(&config, 0, &options))
+        success = false;
+
+    if(success)
+    {
+        SDBG("Init options test success");
+    }
+    return success;
+}
+
+static bool test_budget(void)
+{
+    i2c_lowlevel_config config = { .device = BMP180_SIM_PREFIX "3" };
+    /* 3000 nC per ULP sample at 30 uA (above standby) is 100 ms per sample */
+    const bmp180_budget_t budget = { BMP180_STANDBY_CURRENT + 30000, 0, 0 };
+    const bmp180_budget_t invalid[] = { { BMP180_STANDBY_CURRENT, 0, 0 }, { 0, 1001, 0 } };
+    bmp180_sample_t sample;
+    bmp180_stats_t st;
+    uint64_t start, elapsed;
+    bmp180_t bmp;
+    bool success = true;
+
+    bmp = bmp180_init(&config, 0, BMP180_MODE_ULTRA_LOW_POWER);
+    if(NULL == bmp)
+        return false;
+
+    /* One sample: a temperature and a pressure start (3 bytes each) and result read (5 and
+       6 bytes), with the datasheet's 3 uA at one sample per second */
+    bmp180_reset_stats(bmp);
+    if(!bmp180_sample(bmp, &sample) || !bmp180_get_stats(bmp, &st))
+        success = false;
+    else if(st.bus_bytes != 17 || st.bus_clocks != 17 * 9 || st.bus_time != 382
+         || st.conversion_time[0] != 4500 + 4500 || st.charge != 3000)
+    {
+        SDBG("Budget: %" PRIu64 " bytes, %" PRIu64 " us bus, %" PRIu64 " us converting, %" PRIu64 " nC",
+             st.bus_bytes, st.bus_time, st.conversion_time[0], st.charge);
+        success = false;
+    }
+
+    for(size_t i = 0; i < ARRAY_SIZE(invalid); ++i)
+    {
+        if(bmp180_set_budget(bmp, &invalid[i]))
+        {
+            SDBG("Budget: invalid budget %zu accepted", i);
+            success = false;
+        }
+    }
+
+    /* Three samples are spaced by the budget */
+    bmp180_set_budget(bmp, &budget);
+    bmp180_reset_stats(bmp);
+    start = bmp180_now();
+    for(int i = 0; i < 3; ++i)
+    {
+        if(!bmp180_sample(bmp, &sample))
+            success = false;
+    }
+    elapsed = bmp180_now() - start;
+    bmp180_get_stats(bmp, &st);
+    if(elapsed < 200000 || st.throttled != 2)
+    {
+        SDBG("Budget: 3 samples in %" PRIu64 " us, %" PRIu32 " throttled", elapsed, st.throttled);
+        success = false;
+    }
+
+    /* A deadline before the budget allows the next sample is refused without waiting */
+    start = bmp180_now();
+    if(bmp180_sample_until(bmp, &sample, start + 10000) || bmp180_now() - start > 10000
+    || !bmp180_get_stats(bmp, &st) || st.refused != 1 || st.timeouts != 0)
+    {
+        SDBG("Budget: sample within the deadline");
+        success = false;
+    }
+
+    /* Without a budget, samples run back to back */
+    bmp180_set_budget(bmp, NULL);
+    if(!bmp180_sample(bmp, &sample) || !bmp180_get_stats(bmp, &st) || st.throttled != 2)
+    {
+        SDBG("Budget: throttled without a budget");
+        success = false;
+    }
+
+    bmp180_free(bmp);
+    if(success)
+    {
+        SDBG("Budget test success");
+    }
+    return success;
+}
+
+static bool test_group(void)
+{
+    const char *devices[] = { BMP180_SIM_PREFIX "5", BMP180_SIM_PREFIX "6", BMP180_SIM_PREFIX "7" };
+    const bmp180_sim_faults_t stall = { .stall = 300 };
+    bmp180_t members[ARRAY_SIZE(devices)] = { NULL };
+    bmp180_group_sample_t samples[ARRAY_SIZE(devices)];
+    bmp180_group_stats_t stats;
+    bmp180_stats_t member_stats;
+    bmp180_sample_t single[2];
+    bmp180_group_t group = NULL;
+    uint32_t histogram = 0, aligned = 0;
+    bool success = true;
+
+    for(size_t i = 0; i < ARRAY_SIZE(devices) && success; ++i)
+    {
+        i2c_lowlevel_config config = { .device = devices[i] };
+        bmp180_sim_set_values(devices[i], 27898, 23843, 0);
+        members[i] = bmp180_init(&config, 0, BMP180_MODE_ULTRA_LOW_POWER);
+        success = (NULL != members[i]);
+    }
+    if(success)
+        group = bmp180_group_init(members, ARRAY_SIZE(members));
+    if(NULL == group)
+        success = false;
+
+    /* Every transaction takes 300 us: conversion starts are one transaction apart, where
+       back-to-back bmp180_sample() calls are a whole sample apart. Most samples, rather than
+       all, must be aligned, since scheduling delays can inflate any one of them. */
+    for(size_t i = 0; i < ARRAY_SIZE(devices); ++i)
+        bmp180_sim_set_faults(devices[i], &stall);
+    for(int n = 0; n < 10 && success; ++n)
+    {
+        if(!bmp180_group_sample(group, samples))
+        {
+            SDBG("Group: sample %d failed", n);
+            success = false;
+            break;
+        }
+        for(size_t i = 0; i < ARRAY_SIZE(devices); ++i)
+        {
+            if(samples[i].sample.pressure != 69964 || samples[i].sample.temperature != 150
+            || samples[i].pressure_start - samples[0].pressure_start != samples[i].offset
+            || samples[i].sample.timestamp >= samples[i].pressure_start)
+                success = false;
+        }
+    }
+    if(success && (!bmp180_sample(members[0], &single[0]) || !bmp180_sample(members[1], &single[1])))
+        success = false;
+
+    /* A failing member fails the group sample */
+    bmp180_sim_set_faults(devices[1], &(bmp180_sim_faults_t){ .fail_next = 1 });
+    if(success && bmp180_group_sample(group, samples))
+        success = false;
+    for(size_t i = 0; i < ARRAY_SIZE(devices); ++i)
+        bmp180_sim_set_faults(devices[i], NULL);
+
+    if(success)
+    {
+        bmp180_group_get_stats(group, &stats);
+        bmp180_get_stats(members[2], &member_stats);
+        for(int b = 0; b < BMP180_GROUP_SKEW_BUCKETS; ++b)
+        {
+            histogram += stats.skew_histogram[b];
+            if(b <= 11) /* under 2048 us */
+                aligned += stats.skew_histogram[b];
+        }
+        if(stats.samples != 10 || stats.failures != 1 || histogram != 10 || member_stats.samples[0] != 10
+        || stats.skew_min < 2 * 300 || aligned < 8 || stats.skew_last != samples[2].offset
+        || stats.skew_mean < stats.skew_min || stats.skew_mean > stats.skew_max
+        || single[1].timestamp - single[0].timestamp < 9000)
+        {
+            SDBG("Group: skew %" PRIu32 "-%" PRIu32 " us (mean %" PRIu32 "), %" PRIu32 " samples, %" PRIu32 " failures",
+               stats.skew_min, stats.skew_max, stats.skew_mean, stats.samples, stats.failures);
+            success = false;
+        }
+    }
+
+    /* With a recovery policy, the failing member is retried and the group sample succeeds */
+    if(success)
+    {
+        const bmp180_recovery_config_t recovery = { 1, 100, 0, false, false };
+        bmp180_set_recovery(members[1], &recovery);
+        bmp180_sim_set_faults(devices[1], &(bmp180_sim_faults_t){ .fail_next = 1 });
+        if(!bmp180_group_sample(group, samples) || !bmp180_group_get_stats(group, &stats)
+        || !bmp180_get_stats(members[1], &member_stats) || stats.samples != 11 || stats.failures != 1
+        || member_stats.retries != 1 || member_stats.recoveries != 1 || samples[1].sample.pressure != 69964)
+        {
+            SDBG("Group: member recovery failed");
+            success = false;
+        }
+        bmp180_sim_set_faults(devices[1], NULL);
+    }
+
+    if(success)
+    {
+        SDBG("Group test success: skew %" PRIu32 "-%" PRIu32 " us, %" PRIu64 " us between separate samples",
+           stats.skew_min, stats.skew_max, single[1].timestamp - single[0].timestamp);
+    }
+    bmp180_group_free(group);
+    for(size_t i = 0; i < ARRAY_SIZE(devices); ++i)
+        bmp180_free(members[i]);
+    return success;
+}
+
+static bool test_batch(void)
+{
+    int32_t ut[64], up[64], temperature[64], pressure[64];
+    bool success = true;
+
+    for(size_t i = 0; i < ARRAY_SIZE(test_vectors); ++i)
+    {
+        t_test_vector *v = &test_vectors[i];
+        bmp180_calibration_t cal;
+
+        memcpy(&cal, v->cal.raw, sizeof(cal));
+        for(size_t n = 0; n < ARRAY_SIZE(ut); ++n)
+        {
+            ut[n] = v->uncompensatedTemperature + (int32_t)(n / 4) * 7 - 200; /* runs share a stage */
+            up[n] = v->uncompensatedPressure + (int32_t) n * 131 - 4000;
+        }
+        if(!bmp180_compensate_batch(&cal, v->oss, ut, up, ARRAY_SIZE(ut), temperature, pressure))
+            return false;
+        for(size_t n = 0; n < ARRAY_SIZE(ut); ++n)
+        {
+            int32_t t, p;
+            bmp180_Compensate(&v->cal, v->oss, ut[n], up[n], &t, &p);
+            if(t != temperature[n] || p != pressure[n])
+            {
+                SDBG("Batch: vector %zu entry %zu mismatch", i + 1, n);
+                success = false;
+                break;
+            }
+        }
+    }
+    if(success)
+    {
+        SDBG("Batch compensation test success");
+    }
+    return success;
+}
+
+static bool test_two_stage(void)
+{
+    bool success = true;
+
+    for(size_t i = 0; i < ARRAY_SIZE(test_vectors); ++i)
+    {
+        t_test_vector *v = &test_vectors[i];
+        bmp180_calibration_t cal;
+        bmp180_temperature_stage_t stage;
+        int32_t p;
+
+        memcpy(&cal, v->cal.raw, sizeof(cal));
+        if(!bmp180_compensate_temperature(&cal, v->oss, v->uncompensatedTemperature, &stage)
+        || !bmp180_compensate_pressure(&stage, v->uncompensatedPressure, &p)
+        || stage.temperature != v->resultTemperature || p != v->resultPressure)
+        {
+            SDBG("Two-stage: vector %zu mismatch", i + 1);
+            success = false;
+            continue;
+        }
+
+        /* One temperature stage serves any number of pressures */
+        for(int32_t n = 0; n < 256; ++n)
+        {
+            int32_t up = v->uncompensatedPressure + n * 97 - 12000, t, expected;
+            bmp180_Compensate(&v->cal, v->oss, v->uncompensatedTemperature, up, &t, &expected);
+            if(!bmp180_compensate_pressure(&stage, up, &p) || p != expected)
+            {
+                SDBG("Two-stage: vector %zu UP %" PRIi32 " mismatch", i + 1, up);
+                success = false;
+                break;
+            }
+        }
+
+        if(bmp180_compensate_temperature(&cal, BMP180_MODE_ULTRA_HIGH_RESOLUTION + 1,
+                                         v->uncompensatedTemperature, &stage)
+        || bmp180_compensate_temperature(NULL, v->oss, v->uncompensatedTemperature, &stage)
+        || bmp180_compensate_pressure(NULL, v->uncompensatedPressure, &p))
+        {
+            SDBG("Two-stage: invalid arguments accepted");
+            success = false;
+        }
+    }
+    if(success)
+    {
+        SDBG("Two-stage compensation test success");
+    }
+    return success;
+}
+
+/* Calibrations and readings that would divide by zero fail instead */
+static bool test_invalid(void)
+{
+    bool success = true;
+
+    for(size_t i = 0; i < ARRAY_SIZE(invalid_vectors); ++i)
+    {
+        t_test_vector *v = &invalid_vectors[i];
+        bmp180_calibration_t cal;
+        bmp180_temperature_stage_t stage;
+        int32_t t, p;
+        bool staged;
+
+        memcpy(&cal, v->cal.raw, sizeof(cal));
+        staged = bmp180_compensate_temperature(&cal, v->oss, v->uncompensatedTemperature, &stage);
+        if(bmp180_Compensate(&v->cal, v->oss, v->uncompensatedTemperature, v->uncompensatedPressure, &t, &p) == 0
+        || bmp180_compensate_batch(&cal, v->oss, &v->uncompensatedTemperature, &v->uncompensatedPressure, 1, &t, &p)
+        || (staged && (stage.temperature != v->resultTemperature
+                       || bmp180_compensate_pressure(&stage, v->uncompensatedPressure, &p))))
+        {
+            SDBG("Invalid: vector %zu compensated", i + 1);
+            success = false;
+        }
+    }
+    if(success)
+    {
+        SDBG("Invalid compensation test success");
+    }
+    return success;
+}
+
+static bool test_snapshot(void)
+{
+    i2c_lowlevel_config config = { .device = BMP180_SIM_PREFIX "3" };
+    enum { RECORDS = 700 };  /* several decoder chunks */
+    static uint8_t records[RECORDS * BMP180_SNAPSHOT_RECORD_SIZE];
+    static bmp180_decoded_t decoded[RECORDS];
+    uint8_t image[BMP180_SNAPSHOT_CALIBRATION_SIZE];
+    uint32_t ids[ARRAY_SIZE(test_vectors)];
+    bmp180_calibration_t cal, imported;
+    bmp180_decoder_stats_t st;
+    bmp180_sample_t sample, unpacked;
+    bmp180_decoder_t dec;
+    size_t valid, expected_valid = 0;
+    bmp180_t bmp;
+    bool success = true;
+
+    /* A raw sample of the simulated device is the datasheet example */
+    bmp = bmp180_init(&config, 0, BMP180_MODE_ULTRA_LOW_POWER);
+    if(NULL == bmp)
+        return false;
+    if(!bmp180_sample_raw(bmp, &sample, 0) || !bmp180_get_calibration(bmp, &cal)
+    || sample.ut != 27898 || sample.up != 23843 || sample.oss != 0 || sample.pressure != 0)
+    {
+        SDBG("Snapshot: raw sample mismatch");
+        success = false;
+    }
+    bmp180_free(bmp);
+
+    /* Calibration export round trip, in EEPROM order */
+    if(bmp180_snapshot_export_calibration(&cal, image) != bmp180_snapshot_import_calibration(image, &imported)
+    || memcmp(&cal, &imported, sizeof(cal)) != 0 || image[0] != (408 >> 8) || image[1] != (408 & 0xff))
+    {
+        SDBG("Snapshot: calibration round trip mismatch");
+        success = false;
+    }
+
+    sample.timestamp = 0x123456789abcULL;
+    bmp180_snapshot_pack(&sample, 0xdeadbeef, records);
+    if(bmp180_snapshot_unpack(records, &unpacked) != 0xdeadbeef || unpacked.timestamp != sample.timestamp
+    || unpacked.ut != sample.ut || unpacked.up != sample.up || unpacked.oss != sample.oss)
+    {
+        SDBG("Snapshot: record round trip mismatch");
+        success = false;
+    }
+
+    dec = bmp180_decoder_init();
+    if(NULL == dec)
+        return false;
+    for(size_t i = 0; i < ARRAY_SIZE(test_vectors); ++i)
+    {
+        memcpy(&cal, test_vectors[i].cal.raw, sizeof(cal));
+        ids[i] = bmp180_snapshot_export_calibration(&cal, image);
+        if(!bmp180_decoder_add_calibration(dec, image))
+            success = false;
+    }
+
+    /* Runs from each vector's device and oss, with some unknown devices and a bad oss */
+    for(size_t i = 0; i < RECORDS; ++i)
+    {
+        const t_test_vector *v = &test_vectors[(i / 37) % ARRAY_SIZE(test_vectors)];
+        uint32_t id = ids[(i / 37) % ARRAY_SIZE(test_vectors)];
+
+        sample.timestamp = i * 1000;
+        sample.oss = v->oss;
+        sample.ut = v->uncompensatedTemperature + (int32_t)(i % 5);
+        sample.up = v->uncompensatedPressure + (int32_t)(i * 13) - 4000;
+        if(i % 101 == 100)
+            id ^= 1;
+        else if(i % 211 == 210)
+            sample.oss = BMP180_MODE_ULTRA_HIGH_RESOLUTION + 1;
+        else
+            ++expected_valid;
+        bmp180_snapshot_pack(&sample, id, records + i * BMP180_SNAPSHOT_RECORD_SIZE);
+    }
+
+    valid = bmp180_decoder_decode(dec, records, RECORDS, decoded);
+    if(valid != expected_valid)
+    {
+        SDBG("Snapshot: %zu of %zu records valid, expected %zu", valid, (size_t) RECORDS, expected_valid);
+        success = false;
+    }
+    for(size_t i = 0; i < RECORDS && success; ++i)
+    {
+        t_test_vector *v = &test_vectors[(i / 37) % ARRAY_SIZE(test_vectors)];
+        int32_t t, p;
+
+        if(!decoded[i].valid)
+            continue;
+        bmp180_Compensate(&v->cal, v->oss, decoded[i].sample.ut, decoded[i].sample.up, &t, &p);
+        if(decoded[i].sample.timestamp != i * 1000 || decoded[i].calibration_id != ids[(i / 37) % ARRAY_SIZE(test_vectors)]
+        || decoded[i].sample.temperature != t || decoded[i].sample.pressure != p)
+        {
+            SDBG("Snapshot: record %zu mismatch", i);
+            success = false;
+        }
+    }
+
+    /* The first and last vectors share a device; registering it again changes nothing */
+    if(!bmp180_decoder_add_calibration(dec, image) || !bmp180_decoder_get_stats(dec, &st)
+    || st.records != RECORDS || st.calibrations != 2 || st.unknown_calibration + st.invalid != RECORDS - expected_valid)
+    {
+        SDBG("Snapshot: decoder statistics mismatch");
+        success = false;
+    }
+
+    bmp180_decoder_free(dec);
+    if(success)
+    {
+        SDBG("Snapshot test success");
+    }
+    return success;
+}
+
+/* Fake sysfs tree and buffer FIFO for the IIO backend */
+#define IIO_SCANS 10
+
+static bool write_file(const char *dir, const char *name, const char *content)
+{
+    char path[256];
+    FILE *f;
+
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    f = fopen(path, "w");
+    if(NULL == f)
+        return false;
+    fputs(content, f);
+    fclose(f);
+    return true;
+}
+
+static bool file_is(const char *dir, const char *name, const char *expected)
+{
+    char path[256], content[64] = { 0 };
+    FILE *f;
+
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    f = fopen(path, "r");
+    if(NULL == f)
+        return false;
+    if(NULL == fgets(content, sizeof(content), f))
+        content[0] = '\0';
+    fclose(f);
+    content[strcspn(content, "\n")] = '\0';
+    if(strcmp(content, expected) != 0)
+    {
+        SDBG("IIO: %s is '%s', expected '%s'", name, content, expected);
+        return false;
+    }
+    return true;
+}
+
+
+/* Scans as the bmp280 driver lays them out: pressure (u32, index 0), temperature
+   (s32, index 1), timestamp (s64, index 2) */
+static void *iio_writer(void *arg)
+{
+    const char *fifo = (const char *) arg;
+    uint8_t scans[IIO_SCANS][16];
+    const size_t chunks[] = { 3 * 16, 5 * 16 + 8, 8 + 16 };
+    size_t offset = 0;
+    int fd;
+
+    for(int i = 0; i < IIO_SCANS; ++i)
+    {
+        uint32_t pressure = 69964 + i;  /* Pa, with a scale of 0.001 kPa */
+        int32_t temperature = 150;      /* 0.1 C, with a scale of 100 mC */
+        int64_t timestamp = (1000000 + (int64_t) i * 10000) * 1000;
+        memcpy(&scans[i][0], &pressure, 4);
+        memcpy(&scans[i][4], &temperature, 4);
+        memcpy(&scans[i][8], &timestamp, 8);
+    }
+
+    fd = open(fifo, O_WRONLY);
+    if(fd < 0)
+        return NULL;
+    for(size_t i = 0; i < ARRAY_SIZE(chunks); ++i)
+    {
+        if(write(fd, (uint8_t *) scans + offset, chunks[i]) != (ssize_t) chunks[i])
+            break;
+        offset += chunks[i];
+        usleep(20000);
+    }
+    close(fd);
+    return NULL;
+}
+
+static bool test_iio(void)
+{
+    char root[] = "/tmp/bmp180-iio-XXXXXX";
+    char dev[64], fifo[64], trig[64], path[96];
+    const char *dirs[] = { "", "/iio:device0", "/iio:device0/buffer", "/iio:device0/trigger",
+                           "/iio:device0/scan_elements", "/trigger0" };
+    const char *files[][2] = {
+        { "name", "bmp180" }, { "in_temp_scale", "100" }, { "in_pressure_scale", "0.001" },
+        { "in_pressure_oversampling_ratio", "1" }, { "current_timestamp_clock", "realtime" },
+        { "buffer/enable", "0" }, { "buffer/length", "2" }, { "trigger/current_trigger", "" },
+        { "scan_elements/in_pressure_en", "0" }, { "scan_elements/in_pressure_index", "0" },
+        { "scan_elements/in_pressure_type", "le:u32/32>>0" },
+        { "scan_elements/in_temp_en", "0" }, { "scan_elements/in_temp_index", "1" },
+        { "scan_elements/in_temp_type", "le:s32/32>>0" },
+        { "scan_elements/in_timestamp_en", "0" }, { "scan_elements/in_timestamp_index", "2" },
+        { "scan_elements/in_timestamp_type", "le:s64/64>>0" },
+        { "scan_elements/in_humidityrelative_en", "1" },
+    };
+    bmp180_iio_config_t config = { NULL, NULL, "hrtimer-test", 100, 16, 4, BMP180_MODE_ULTRA_HIGH_RESOLUTION };
+    bmp180_sample_t samples[IIO_SCANS];
+    bmp180_stats_t stats;
+    bmp180_ring_t ring;
+    bool success = true;
+    pthread_t writer;
+    size_t total;
+    bmp180_t bmp;
+
+    if(NULL == mkdtemp(root))
+        return false;
+    snprintf(dev, sizeof(dev), "%s/iio:device0", root);
+    snprintf(fifo, sizeof(fifo), "%s/dev", root);
+    snprintf(trig, sizeof(trig), "%s/trigger0", root);
+    for(size_t i = 1; i < ARRAY_SIZE(dirs); ++i)
+    {
+        snprintf(path, sizeof(path), "%s%s", root, dirs[i]);
+        mkdir(path, 0700);
+    }
+    for(size_t i = 0; i < ARRAY_SIZE(files); ++i)
+        write_file(dev, files[i][0], files[i][1]);
+    write_file(trig, "name", "hrtimer-test\n");
+    write_file(trig, "sampling_frequency", "0");
+    mkfifo(fifo, 0600);
+    config.device = dev;
+    config.chardev = fifo;
+
+    pthread_create(&writer, NULL, iio_writer, fifo);
+    bmp = bmp180_iio_init(&config);
+    if(NULL == bmp)
+    {
+        SDBG("IIO: initialization failed");
+        /* Unblock the writer, and hold the FIFO open until it's done */
+        int fd = open(fifo, O_RDONLY | O_NONBLOCK);
+        pthread_join(writer, NULL);
+        close(fd);
+        success = false;
+    }
+    else
+    {
+        success = file_is(dev, "buffer/enable", "1") && file_is(dev, "buffer/length", "16")
+               && file_is(dev, "trigger/current_trigger", "hrtimer-test") && file_is(trig, "sampling_frequency", "100")
+               && file_is(dev, "scan_elements/in_humidityrelative_en", "0") && file_is(dev, "scan_elements/in_temp_en", "1")
+               && file_is(dev, "current_timestamp_clock", "monotonic") && file_is(dev, "in_pressure_oversampling_ratio", "8");
+
+        /* One sample, then bulk reads (across a scan split between writes), then the ring */
+        total = bmp180_sample(bmp, &samples[0]) ? 1 : 0;
+        while(total < 8)
+        {
+            size_t count = bmp180_iio_read(bmp, &samples[total], 8 - total, 500000);
+            if(count == 0)
+                break;
+            total += count;
+        }
+        ring = bmp180_ring_init(4);
+        while(total < IIO_SCANS && bmp180_iio_capture(bmp, ring, 500000) > 0)
+            total += bmp180_ring_pop(ring, &samples[total], IIO_SCANS - total);
+        bmp180_ring_free(ring);
+
+        if(total != IIO_SCANS)
+        {
+            SDBG("IIO: %zu samples", total);
+            success = false;
+        }
+        for(size_t i = 0; i < total && success; ++i)
+        {
+            if(samples[i].pressure != 69964 + (int32_t) i || samples[i].temperature != 150
+            || samples[i].timestamp != 1000000 + i * 10000 || samples[i].oss != BMP180_MODE_ULTRA_HIGH_RESOLUTION)
+            {
+                SDBG("IIO: sample %zu: %" PRIi32 " Pa, %" PRIi32 " (0.1 C) at %" PRIu64, i,
+                   samples[i].pressure, samples[i].temperature, samples[i].timestamp);
+                success = false;
+            }
+        }
+        bmp180_get_stats(bmp, &stats);
+        if(stats.samples[BMP180_MODE_ULTRA_HIGH_RESOLUTION] != IIO_SCANS)
+            success = false;
+
+        pthread_join(writer, NULL);
+        bmp180_free(bmp);
+        if(!file_is(dev, "buffer/enable", "0"))
+            success = false;
+    }
+
+    for(size_t i = 0; i < ARRAY_SIZE(files); ++i)
+    {
+        snprintf(path, sizeof(path), "%s/%s", dev, files[i][0]);
+        remove(path);
+    }
+    snprintf(path, sizeof(path), "%s/name", trig);
+    remove(path);
+    snprintf(path, sizeof(path), "%s/sampling_frequency", trig);
+    remove(path);
+    remove(fifo);
+    for(size_t i = ARRAY_SIZE(dirs); i-- > 0; )
+    {
+        snprintf(path, sizeof(path), "%s%s", root, dirs[i]);
+        remove(path);
+    }
+
+    if(success)
+    {
+        SDBG("IIO test success");
+    }
+    return success;
+}
+
 int main(int argc, char *argv[])
 {
     size_t vector_count = ARRAY_SIZE(test_vectors);
@@ -79,5 +1472,40 @@ int main(int argc, char *argv[])
             SDBG("Test case %zu success: temperature %.2f C, pressure %u pascal, %.2f mmHg. %.2f inHg", i+1, c, pressure, mmHg, inHg); 
         }
     }
-    return 0;
+    if(!test_init_ex())
+        success = false;
+    if(!test_batch())
+        success = false;
+    if(!test_two_stage())
+        success = false;
+    if(!test_invalid())
+        success = false;
+    if(!test_snapshot())
+        success = false;
+    if(!test_filters())
+        success = false;
+    if(!test_aggregate())
+        success = false;
+    if(!test_estimator())
+        success = false;
+    if(!test_notify())
+        success = false;
+    if(!test_adaptive())
+        success = false;
+    if(!test_recovery())
+        success = false;
+    if(!test_deadline())
+        success = false;
+    if(!test_sampler())
+        success = false;
+    if(!test_discover())
+        success = false;
+    if(!test_iio())
+        success = false;
+    if(!test_group())
+        success = false;
+    if(!test_budget())
+        success = false;
+
+    return success ? 0 : 1;
 }
@@ -0,0 +1,481 @@
+/* Copyright 2024 Zorxx Software. All rights reserved. */
+/* Differential test of bmp180_Compensate() against a wide-integer reference model
+ *
+ * The reference evaluates the datasheet algorithm (including its B7 branch) in 128-bit
+ * integers, with the same shift and division semantics, so any difference from the
+ * production function comes from the width of its intermediates. The reference also checks
+ * each production intermediate against its type and records the first one that doesn't fit,
+ * which is where a divergence starts.
+ *
+ * Every UT (with --ut-step 1) and every --up-step'th UP, for each oss and each calibration
+ * in the corpus, is compared. A divergence where the reference result is within the
+ * sensor's operating range (-40 to 85 C, 300 to 1100 hPa) fails the test; divergences
+ * outside it are reported only.
+ *
+ * Production results come from the two-stage path (bmp180_Compensate() is the same two
+ * stages back to back), with the temperature stage computed once per UT. Its pressure stage
+ * divides by B4 with a precomputed reciprocal; that is also checked against a plain 32-bit
+ * division of the same stage, and any difference fails the test wherever it occurs.
+ */
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include "bmp180_private.h"
+#include "divided.h"
+
+#ifndef __SIZEOF_INT128__
+   #error "The reference model needs 128-bit integers"
+#endif
+typedef __int128 wide_t;
+
+#define UT_MAX          0xFFFF
+#define UT_CHUNK        64      /* UT values per work item */
+#define T_MIN           -400    /* operating range, 0.1 C */
+#define T_MAX           850
+#define P_MIN           30000   /* operating range, Pa */
+#define P_MAX           110000
+
+typedef struct
+{
+    const char *name;
+    t_bmp180_calibration_data cal;
+} calibration_t;
+
+/* Built-in corpus: the datasheet example, the device from test/main.c, and synthetic sets at
+   the edges of the coefficient ranges seen in practice */
+static const calibration_t builtin[] =
+{
+    { "datasheet", { { 408, -72, -14383, 32741, 32757, 23153, 6190, 4, -32768, -8711, 2868 } } },
+    { "device",    { { 8962, -1194, -14683, 34018, 25305, 17872, 6515, 48, -32768, -11786, 2634 } } },
+    { "synthetic-low",  { { -8000, -1400, -15000, 31000, 23000, 16000, 5000, 1, -32768, -12500, 2300 } } },
+    { "synthetic-high", { { 10000, -60, -13800, 36000, 33500, 26000, 7000, 60, -32768, -8000, 3000 } } },
+};
+
+/* Production intermediates checked against their types, in evaluation order */
+#define TERMS(X) \
+    X(UT_AC5,    "(UT - AC6) * AC5") \
+    X(MC,        "MC << 11") \
+    X(B5,        "B5") \
+    X(B6,        "B6") \
+    X(B6_SQ,     "B6 * B6") \
+    X(B2,        "B2 * (B6 * B6 >> 12)") \
+    X(AC2,       "AC2 * B6") \
+    X(X3,        "X3") \
+    X(B3,        "(AC1 * 4 + X3) << oss") \
+    X(AC3,       "AC3 * B6") \
+    X(B1,        "B1 * (B6 * B6 >> 12)") \
+    X(X3_OFFSET, "X3 + 32768") \
+    X(B4,        "AC4 * (X3 + 32768)") \
+    X(UP_B3,     "UP - B3") \
+    X(B7,        "(UP - B3) * (50000 >> oss)") \
+    X(P,         "P") \
+    X(P_SQ,      "(P >> 8) * (P >> 8)") \
+    X(X1_3038,   "X1 * 3038") \
+    X(P_7357,    "-7357 * P") \
+    X(SUM,       "X1 + X2 + 3791")
+
+#define TERM_ENUM(id, name) TERM_##id,
+#define TERM_NAME(id, name) name,
+enum { TERMS(TERM_ENUM) TERM_COUNT };
+static const char *const term_names[TERM_COUNT] = { TERMS(TERM_NAME) };
+
+/* Result of one evaluation */
+typedef struct
+{
+    bool valid;            /* false if the algorithm divides by zero */
+    int64_t T, P;
+    int overflow;          /* first production intermediate outside its type, or -1 */
+} result_t;
+
+/* First divergence, in (UT, UP) order */
+typedef struct
+{
+    bool found;
+    int32_t ut, up;
+    result_t ref, prod;
+} divergence_t;
+
+typedef struct
+{
+    uint64_t samples;
+    uint64_t in_range;           /* samples whose reference result is in the operating range */
+    uint64_t diverged;           /* all divergences */
+    uint64_t diverged_in_range;
+    divergence_t first;          /* anywhere */
+    divergence_t first_in_range;
+    uint64_t overflows[TERM_COUNT];      /* samples where each term is the first to overflow */
+    divergence_t first_overflow[TERM_COUNT];
+    uint64_t mismatched;         /* reciprocal division differs from plain division */
+    divergence_t first_mismatch; /* 'ref' is the plain division result */
+} stats_t;
+
+typedef struct
+{
+    const calibration_t *corpus;
+    size_t corpus_size;
+    uint32_t ut_step;
+    uint32_t up_step;
+    atomic_uint_fast64_t next;   /* next work item */
+    uint64_t items;              /* corpus_size * 4 oss * UT chunks */
+    uint64_t chunks;
+    pthread_mutex_t mutex;
+    stats_t *stats;              /* [corpus_size * 4] */
+} sweep_t;
+
+/* ----------------------------------------------------------------------------------------------
+ * Reference model
+ */
+
+/* Arithmetic shift, as the production code's >> on the compilers it targets */
+static inline wide_t asr(wide_t x, int n)
+{
+    return (x >= 0) ? x / ((wide_t) 1 << n) : -((-x + ((wide_t) 1 << n) - 1) / ((wide_t) 1 << n));
+}
+
+/* Record 'term' as the overflow point if 'v' doesn't fit the production type */
+static inline wide_t check32(result_t *r, int term, wide_t v)
+{
+    if(r->overflow < 0 && (v < INT32_MIN || v > INT32_MAX))
+        r->overflow = term;
+    return v;
+}
+
+static inline wide_t checku32(result_t *r, int term, wide_t v)
+{
+    if(r->overflow < 0 && (v < 0 || v > UINT32_MAX))
+        r->overflow = term;
+    return v;
+}
+
+static void reference(const t_bmp180_calibration_data *c, uint8_t oss, int32_t ut, int32_t up, result_t *r)
+{
+    wide_t X1, X2, X3, B3, B4, B5, B6, B7, B6sq, P;
+
+    memset(r, 0, sizeof(*r));
+    r->overflow = -1;
+    X1 = asr(check32(r, TERM_UT_AC5, (wide_t)(ut - c->AC6) * c->AC5), 15);
+    if(X1 + c->MD == 0)
+        return;
+    X2 = check32(r, TERM_MC, (wide_t) c->MC * 2048) / (X1 + c->MD);
+    B5 = check32(r, TERM_B5, X1 + X2);
+    r->T = (int64_t) asr(B5 + 8, 4);
+
+    B6 = check32(r, TERM_B6, B5 - 4000);
+    B6sq = asr(check32(r, TERM_B6_SQ, B6 * B6), 12);
+    X1 = asr(check32(r, TERM_B2, c->B2 * B6sq), 11);
+    X2 = asr(check32(r, TERM_AC2, c->AC2 * B6), 11);
+    X3 = check32(r, TERM_X3, X1 + X2);
+    B3 = asr(check32(r, TERM_B3, (c->AC1 * 4 + X3) * ((wide_t) 1 << oss)) + 2, 2);
+    X1 = asr(check32(r, TERM_AC3, c->AC3 * B6), 13);
+    X2 = asr(check32(r, TERM_B1, c->B1 * B6sq), 16);
+    X3 = asr(X1 + X2 + 2, 2);
+    B4 = asr(checku32(r, TERM_B4, c->AC4 * checku32(r, TERM_X3_OFFSET, X3 + 32768)), 15);
+    B7 = checku32(r, TERM_B7,
+                  checku32(r, TERM_UP_B3, up - B3) * (50000 >> oss));
+    if(B4 == 0)
+        return;
+
+    /* The datasheet's branch, which keeps B7 * 2 within 32 bits */
+    if(B7 < 0x80000000)
+        P = (B7 * 2) / B4;
+    else
+        P = (B7 / B4) * 2;
+    check32(r, TERM_P, P);
+
+    X1 = check32(r, TERM_P_SQ, asr(P, 8) * asr(P, 8));
+    X1 = asr(check32(r, TERM_X1_3038, X1 * 3038), 16);
+    X2 = asr(check32(r, TERM_P_7357, -7357 * P), 16);
+    P += asr(check32(r, TERM_SUM, X1 + X2 + 3791), 4);
+    check32(r, TERM_P, P);
+    r->P = (int64_t) P;
+    r->valid = true;
+}
+
+/* ----------------------------------------------------------------------------------------------
+ * Sweep
+ */
+
+static bool in_range(const result_t *r)
+{
+    return r->valid && r->T >= T_MIN && r->T <= T_MAX && r->P >= P_MIN && r->P <= P_MAX;
+}
+
+static bool before(const divergence_t *d, int32_t ut, int32_t up)
+{
+    return !d->found || ut < d->ut || (ut == d->ut && up < d->up);
+}
+
+static void record(divergence_t *d, int32_t ut, int32_t up, const result_t *ref, const result_t *prod)
+{
+    if(before(d, ut, up))
+    {
+        d->found = true;
+        d->ut = ut;
+        d->up = up;
+        d->ref = *ref;
+        d->prod = *prod;
+    }
+}
+
+static void merge_divergence(divergence_t *to, const divergence_t *from)
+{
+    if(from->found)
+        record(to, from->ut, from->up, &from->ref, &from->prod);
+}
+
+static void sweep_chunk(sweep_t *s, const calibration_t *c, uint8_t oss, uint32_t ut_start, stats_t *st)
+{
+    t_bmp180_calibration_data cal = c->cal;
+    const int32_t up_max = (1 << (16 + oss)) - 1;
+
+    for(uint32_t ut = ut_start; ut < ut_start + UT_CHUNK * s->ut_step && ut <= UT_MAX; ut += s->ut_step)
+    {
+        bmp180_temperature_stage_t stage;
+        bool staged = (bmp180_compensate_stage(&cal, oss, (int32_t) ut, &stage) == 0);
+
+        /* Every up_step'th value, and always the last */
+        for(int32_t up = 0; ; up = (up_max - up > (int32_t) s->up_step) ? up + (int32_t) s->up_step : up_max)
+        {
+            result_t ref, prod = { false, 0, 0, -1 };
+            int32_t P = 0, D = 0;
+            bool inside;
+
+            reference(&c->cal, oss, (int32_t) ut, up, &ref);
+            if(staged)
+            {
+                bool plain = bmp180_divided_pressure(&stage, up, &D);
+                prod.valid = (bmp180_compensate_stage_pressure(&stage, up, &P) == 0);
+                prod.T = stage.temperature;
+                prod.P = P;
+                if(plain != prod.valid || D != P)
+                {
+                    result_t expected = { plain, prod.T, D, -1 };
+                    ++st->mismatched;
+                    record(&st->first_mismatch, (int32_t) ut, up, &expected, &prod);
+                }
+            }
+            inside = in_range(&ref);
+
+            ++st->samples;
+            if(inside)
+                ++st->in_range;
+            if(ref.overflow >= 0)
+            {
+                ++st->overflows[ref.overflow];
+                record(&st->first_overflow[ref.overflow], (int32_t) ut, up, &ref, &prod);
+            }
+            if(ref.valid != prod.valid || (ref.valid && (ref.T != prod.T || ref.P != prod.P)))
+            {
+                ++st->diverged;
+                record(&st->first, (int32_t) ut, up, &ref, &prod);
+                if(inside)
+                {
+                    ++st->diverged_in_range;
+                    record(&st->first_in_range, (int32_t) ut, up, &ref, &prod);
+                }
+            }
+            if(up == up_max)
+                break;
+        }
+    }
+}
+
+static void *sweep_thread(void *arg)
+{
+    sweep_t *s = (sweep_t *) arg;
+    uint64_t item;
+
+    while((item = atomic_fetch_add(&s->next, 1)) < s->items)
+    {
+        size_t index = (size_t)(item / s->chunks);   /* calibration * 4 + oss */
+        uint32_t chunk = (uint32_t)(item % s->chunks);
+        stats_t st, *total = &s->stats[index];
+
+        memset(&st, 0, sizeof(st));
+        sweep_chunk(s, &s->corpus[index / 4], (uint8_t)(index % 4), chunk * UT_CHUNK * s->ut_step, &st);
+
+        pthread_mutex_lock(&s->mutex);
+        total->samples += st.samples;
+        total->in_range += st.in_range;
+        total->diverged += st.diverged;
+        total->diverged_in_range += st.diverged_in_range;
+        merge_divergence(&total->first, &st.first);
+        merge_divergence(&total->first_in_range, &st.first_in_range);
+        total->mismatched += st.mismatched;
+        merge_divergence(&total->first_mismatch, &st.first_mismatch);
+        for(int t = 0; t < TERM_COUNT; ++t)
+        {
+            total->overflows[t] += st.overflows[t];
+            merge_divergence(&total->first_overflow[t], &st.first_overflow[t]);
+        }
+        pthread_mutex_unlock(&s->mutex);
+    }
+    return NULL;
+}
+
+static void print_divergence(const char *what, const divergence_t *d)
+{
+    if(!d->found)
+        return;
+    printf("    %s: first at UT %" PRIi32 ", UP %" PRIi32 ": reference T %" PRIi64 " P %" PRIi64
+           "%s, production T %" PRIi64 " P %" PRIi64 "%s (first overflow: %s)\n",
+           what, d->ut, d->up, d->ref.T, d->ref.P, d->ref.valid ? "" : " (invalid)",
+           d->prod.T, d->prod.P, d->prod.valid ? "" : " (invalid)",
+           (d->ref.overflow >= 0) ? term_names[d->ref.overflow] : "none");
+}
+
+/* ----------------------------------------------------------------------------------------------
+ * Corpus file: one calibration per line, AC1 AC2 AC3 AC4 AC5 AC6 B1 B2 MB MC MD, '#' comments
+ */
+
+static calibration_t *load_corpus(const char *path, size_t *count)
+{
+    calibration_t *corpus = NULL;
+    char line[256];
+    FILE *f = fopen(path, "r");
+
+    *count = 0;
+    if(NULL == f)
+    {
+        fprintf(stderr, "Failed to open %s\n", path);
+        return NULL;
+    }
+    while(fgets(line, sizeof(line), f))
+    {
+        int v[11];
+        calibration_t *c;
+        if(line[0] == '#' || sscanf(line, "%d %d %d %d %d %d %d %d %d %d %d", &v[0], &v[1], &v[2],
+               &v[3], &v[4], &v[5], &v[6], &v[7], &v[8], &v[9], &v[10]) != 11)
+            continue;
+        c = (calibration_t *) realloc(corpus, (*count + 1) * sizeof(*corpus));
+        if(NULL == c)
+            break;
+        corpus = c;
+        c = &corpus[(*count)++];
+        c->name = path;
+        for(int i = 0; i < 11; ++i)
+            c->cal.raw[i] = (uint16_t) v[i];
+    }
+    fclose(f);
+    return corpus;
+}
+
+/* ----------------------------------------------------------------------------------------------
+ * Main
+ */
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [--quick] [--ut-step N] [--up-step N] [--threads N] [--corpus FILE]\n"
+                    "  --quick        reduced sweep (UT step 127, UP step 509)\n"
+                    "  --ut-step N    UT stride (default 1, every value)\n"
+                    "  --up-step N    UP stride (default 16; 1 for every value)\n"
+                    "  --threads N    worker threads (default: online CPUs)\n"
+                    "  --corpus FILE  calibrations to use instead of the built-in corpus\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+    sweep_t s;
+    pthread_t *threads;
+    calibration_t *loaded = NULL;
+    long thread_count = sysconf(_SC_NPROCESSORS_ONLN);
+    uint64_t start, samples = 0, failures = 0;
+    int result = 0;
+
+    memset(&s, 0, sizeof(s));
+    s.corpus = builtin;
+    s.corpus_size = ARRAY_SIZE(builtin);
+    s.ut_step = 1;
+    s.up_step = 16;
+    for(int i = 1; i < argc; ++i)
+    {
+        if(strcmp(argv[i], "--quick") == 0)
+        {
+            s.ut_step = 127;
+            s.up_step = 509;
+        }
+        else if(strcmp(argv[i], "--ut-step") == 0 && i + 1 < argc)
+            s.ut_step = (uint32_t) strtoul(argv[++i], NULL, 0);
+        else if(strcmp(argv[i], "--up-step") == 0 && i + 1 < argc)
+            s.up_step = (uint32_t) strtoul(argv[++i], NULL, 0);
+        else if(strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            thread_count = strtol(argv[++i], NULL, 0);
+        else if(strcmp(argv[i], "--corpus") == 0 && i + 1 < argc)
+        {
+            loaded = load_corpus(argv[++i], &s.corpus_size);
+            if(NULL == loaded)
+                return 1;
+            s.corpus = loaded;
+        }
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if(s.ut_step == 0 || s.up_step == 0 || thread_count < 1)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    s.chunks = (UT_MAX / s.ut_step + UT_CHUNK) / UT_CHUNK;
+    s.items = s.corpus_size * 4 * s.chunks;
+    s.stats = (stats_t *) calloc(s.corpus_size * 4, sizeof(stats_t));
+    threads = (pthread_t *) calloc((size_t) thread_count, sizeof(pthread_t));
+    if(NULL == s.stats || NULL == threads)
+        return 1;
+    atomic_init(&s.next, 0);
+    pthread_mutex_init(&s.mutex, NULL);
+
+    start = bmp180_now();
+    for(long i = 0; i < thread_count; ++i)
+    {
+        if(pthread_create(&threads[i], NULL, sweep_thread, &s) != 0)
+        {
+            thread_count = i;
+            break;
+        }
+    }
+    if(thread_count == 0)
+        sweep_thread(&s);
+    for(long i = 0; i < thread_count; ++i)
+        pthread_join(threads[i], NULL);
+
+    for(size_t i = 0; i < s.corpus_size * 4; ++i)
+    {
+        const stats_t *st = &s.stats[i];
+        printf("%s oss %zu: %" PRIu64 " samples (%" PRIu64 " in range), %" PRIu64 " divergences, %" PRIu64
+               " in range, %" PRIu64 " division mismatches\n", s.corpus[i / 4].name, i % 4, st->samples,
+               st->in_range, st->diverged, st->diverged_in_range, st->mismatched);
+        for(int t = 0; t < TERM_COUNT; ++t)
+        {
+            char what[64];
+            if(st->overflows[t] == 0)
+                continue;
+            snprintf(what, sizeof(what), "%s overflows in %" PRIu64, term_names[t], st->overflows[t]);
+            print_divergence(what, &st->first_overflow[t]);
+        }
+        print_divergence("divergence", &st->first);
+        print_divergence("DIVERGENCE IN RANGE", &st->first_in_range);
+        print_divergence("DIVISION MISMATCH (reference is plain division)", &st->first_mismatch);
+        samples += st->samples;
+        failures += st->diverged_in_range + st->mismatched;
+    }
+    printf("%" PRIu64 " samples in %.1f s on %ld threads: %s\n", samples, (bmp180_now() - start) / 1e6,
+           (thread_count > 0) ? thread_count : 1L, (failures == 0) ? "PASS" : "FAIL");
+    if(failures > 0)
+        result = 1;
+
+    pthread_mutex_destroy(&s.mutex);
+    free(threads);
+    free(s.stats);
+    free(loaded);
+    return result;
+}
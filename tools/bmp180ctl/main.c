@@ -0,0 +1,890 @@
+/*! \copyright 2024 Zorxx Software. All rights reserved.
+ *  \license This file is released under the MIT License. See the LICENSE file for details.
+ *  \brief bmp180ctl: capture samples to CSV, binary or snapshot records, with live statistics
+ *
+ *  The library's sampler worker takes the measurements; a writer thread drains its ring
+ *  buffer, formats and writes the samples, so slow output never delays sampling. The main
+ *  thread only reports statistics. Snapshot captures are compensated on the host with the
+ *  decode command.
+ */
+#define _GNU_SOURCE
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <math.h>
+#include "bmp180/bmp180.h"
+#include "bmp180/sampler.h"
+#include "bmp180/estimator.h"
+#include "bmp180/sim.h"
+#include "bmp180/snapshot.h"
+#include "divided.h"
+
+#define ERR(...) fprintf(stderr, __VA_ARGS__)
+#define MSG(...) fprintf(stderr, __VA_ARGS__)
+
+#define DEFAULT_DEVICE  "/dev/i2c-0"
+#define BENCH_DEVICE    BMP180_SIM_PREFIX "0"
+#define READ_BATCH      256         /* samples per sampler read */
+#define WRITE_BUFFER    (64 * 1024) /* bytes formatted before each write */
+#define CSV_MAX_LINE    80
+
+/* Binary stream: a header followed by fixed-size little-endian records */
+#define BIN_MAGIC       "BMP180\x00\x01"
+#define BIN_HEADER_SIZE (8 + 2 + 22)  /* magic, record size, calibration (AC1..MD) */
+#define BIN_RECORD_SIZE 20            /* timestamp u64, temperature i16, pressure i32,
+                                         ut u16, up u24, oss u8 */
+
+/* Snapshot stream: a header followed by raw records, see bmp180/snapshot.h */
+#define SNAP_MAGIC       "BMP180\x00\x02"
+#define SNAP_HEADER_SIZE (8 + 2 + BMP180_SNAPSHOT_CALIBRATION_SIZE)  /* magic, record size, calibration */
+
+typedef enum { FORMAT_CSV, FORMAT_BINARY, FORMAT_SNAPSHOT } format_t;
+
+typedef struct
+{
+   const char *device;
+   uint8_t address;
+   bmp180_mode_t mode;
+   double rate;          /* Hz */
+   double duration;      /* seconds, 0 to run until interrupted */
+   format_t format;
+   const char *output;   /* NULL for stdout */
+   double interval;      /* seconds between live statistics, 0 to disable */
+   int cpu;
+   int priority;
+   uint32_t capacity;
+   bool bench;
+   bmp180_sim_faults_t faults;
+   uint32_t noise;
+   bmp180_budget_t budget;
+} options_t;
+
+typedef struct
+{
+   bmp180_sampler_t sampler;
+   FILE *out;
+   format_t format;
+   uint32_t calibration_id;  /* for FORMAT_SNAPSHOT records */
+   atomic_bool done;
+   pthread_t thread;
+
+   pthread_mutex_t mutex;  /* protects everything below */
+   uint64_t written;
+   uint64_t bytes;
+   uint64_t latency_sum;   /* conversion start to formatting, microseconds */
+   uint64_t latency_count;
+   uint64_t latency_max;
+   int error;              /* errno of the first failed write */
+} writer_t;
+
+static volatile sig_atomic_t interrupted;
+
+/* ----------------------------------------------------------------------------------------------
+ * Formatting
+ */
+
+static void put_le(uint8_t *p, uint64_t value, int bytes)
+{
+   for(int i = 0; i < bytes; ++i)
+      p[i] = (uint8_t)(value >> (8 * i));
+}
+
+static size_t format_binary_header(uint8_t *p, const bmp180_calibration_t *cal)
+{
+   const int16_t *c = (const int16_t *) cal;
+   memcpy(p, BIN_MAGIC, 8);
+   put_le(p + 8, BIN_RECORD_SIZE, 2);
+   for(int i = 0; i < 11; ++i)
+      put_le(p + 10 + 2 * i, (uint16_t) c[i], 2);
+   return BIN_HEADER_SIZE;
+}
+
+static size_t format_binary(char *buf, const bmp180_sample_t *s)
+{
+   uint8_t *p = (uint8_t *) buf;
+   put_le(p, s->timestamp, 8);
+   put_le(p + 8, (uint16_t)(int16_t) s->temperature, 2);
+   put_le(p + 10, (uint32_t) s->pressure, 4);
+   put_le(p + 14, (uint16_t) s->ut, 2);
+   put_le(p + 16, (uint32_t) s->up, 3);
+   p[19] = s->oss;
+   return BIN_RECORD_SIZE;
+}
+
+static size_t format_snapshot_header(uint8_t *p, const bmp180_calibration_t *cal, uint32_t *id)
+{
+   memcpy(p, SNAP_MAGIC, 8);
+   put_le(p + 8, BMP180_SNAPSHOT_RECORD_SIZE, 2);
+   *id = bmp180_snapshot_export_calibration(cal, p + 10);
+   return SNAP_HEADER_SIZE;
+}
+
+static size_t format_snapshot(char *buf, const bmp180_sample_t *s, uint32_t id)
+{
+   bmp180_snapshot_pack(s, id, (uint8_t *) buf);
+   return BMP180_SNAPSHOT_RECORD_SIZE;
+}
+
+static size_t format_csv(char *buf, const bmp180_sample_t *s)
+{
+   int32_t t = (s->temperature < 0) ? -s->temperature : s->temperature;
+   return (size_t) snprintf(buf, CSV_MAX_LINE, "%" PRIu64 ",%" PRIi32 ",%" PRIi32 ",%u,%s%" PRIi32 ".%" PRIi32 ",%" PRIi32 "\n",
+      s->timestamp, s->ut, s->up, s->oss, (s->temperature < 0) ? "-" : "", t / 10, t % 10, s->pressure);
+}
+
+static size_t format_sample(format_t format, char *buf, const bmp180_sample_t *s, uint32_t id)
+{
+   switch(format)
+   {
+      case FORMAT_BINARY: return format_binary(buf, s);
+      case FORMAT_SNAPSHOT: return format_snapshot(buf, s, id);
+      default: return format_csv(buf, s);
+   }
+}
+
+/* ----------------------------------------------------------------------------------------------
+ * Writer thread
+ */
+
+static bool writer_flush(writer_t *w, char *buf, size_t *used)
+{
+   if(*used > 0 && fwrite(buf, 1, *used, w->out) != *used)
+      return false;
+   *used = 0;
+   return fflush(w->out) == 0;
+}
+
+static void *writer_thread(void *arg)
+{
+   writer_t *w = (writer_t *) arg;
+   bmp180_sample_t samples[READ_BATCH];
+   char *buf = malloc(WRITE_BUFFER);
+   size_t used = 0;
+   bool ok = (NULL != buf);
+
+   while(ok)
+   {
+      bool done = atomic_load(&w->done);
+      size_t count = bmp180_sampler_read(w->sampler, samples, READ_BATCH, done ? 0 : 100000);
+      size_t n;
+      uint64_t now = bmp180_now();
+      uint64_t latency_sum = 0, latency_max = 0, bytes = 0;
+
+      for(size_t i = 0; i < count && ok; ++i)
+      {
+         uint64_t latency = now - samples[i].timestamp;
+         latency_sum += latency;
+         if(latency > latency_max)
+            latency_max = latency;
+         if(WRITE_BUFFER - used < CSV_MAX_LINE)
+            ok = writer_flush(w, buf, &used);
+         n = format_sample(w->format, buf + used, &samples[i], w->calibration_id);
+         used += n;
+         bytes += n;
+      }
+
+      pthread_mutex_lock(&w->mutex);
+      w->written += count;
+      w->bytes += bytes;
+      w->latency_sum += latency_sum;
+      w->latency_count += count;
+      if(latency_max > w->latency_max)
+         w->latency_max = latency_max;
+      pthread_mutex_unlock(&w->mutex);
+
+      /* Write out whenever the ring runs dry, so a reader on a pipe sees data promptly */
+      if(ok && count < READ_BATCH)
+         ok = writer_flush(w, buf, &used);
+      if(done && 0 == count)
+         break;
+   }
+
+   if(!ok)
+   {
+      pthread_mutex_lock(&w->mutex);
+      w->error = (NULL == buf) ? ENOMEM : errno;
+      pthread_mutex_unlock(&w->mutex);
+   }
+   free(buf);
+   return NULL;
+}
+
+/* ----------------------------------------------------------------------------------------------
+ * Statistics
+ */
+
+static void print_live(writer_t *w, double elapsed, uint64_t *last_written)
+{
+   bmp180_sampler_stats_t s;
+   uint64_t written, bytes, latency_avg, latency_max;
+   static double last_elapsed;
+
+   bmp180_sampler_get_stats(w->sampler, &s);
+   pthread_mutex_lock(&w->mutex);
+   written = w->written;
+   bytes = w->bytes;
+   latency_avg = (w->latency_count > 0) ? w->latency_sum / w->latency_count : 0;
+   latency_max = w->latency_max;
+   w->latency_sum = w->latency_count = w->latency_max = 0;
+   pthread_mutex_unlock(&w->mutex);
+
+   MSG("[%7.1fs] %8.1f samples/s, %" PRIu64 " written (%" PRIu64 " KiB), latency avg %" PRIu64
+       " max %" PRIu64 " us, jitter p99 %" PRIu32 " us, errors %" PRIu64 ", missed %" PRIu64
+       ", dropped %" PRIu64 "\n",
+       elapsed, (elapsed > last_elapsed) ? (written - *last_written) / (elapsed - last_elapsed) : 0.0,
+       written, bytes / 1024, latency_avg, latency_max, s.jitter.p99, s.errors, s.missed, s.dropped);
+   *last_written = written;
+   last_elapsed = elapsed;
+}
+
+static void print_percentiles(const char *name, const bmp180_percentiles_t *p)
+{
+   MSG("%-12s p50 %" PRIu32 ", p90 %" PRIu32 ", p99 %" PRIu32 ", p99.9 %" PRIu32 ", max %" PRIu32 " us\n",
+       name, p->p50, p->p90, p->p99, p->p999, p->max);
+}
+
+static void print_summary(writer_t *w, bmp180_t bmp, double elapsed)
+{
+   bmp180_sampler_stats_t s;
+   bmp180_stats_t d;
+
+   bmp180_sampler_get_stats(w->sampler, &s);
+   bmp180_get_stats(bmp, &d);
+   MSG("%" PRIu64 " samples in %.2f s (%.1f samples/s), %" PRIu64 " bytes written\n",
+       w->written, elapsed, (elapsed > 0) ? w->written / elapsed : 0.0, w->bytes);
+   MSG("errors %" PRIu64 ", missed periods %" PRIu64 ", dropped %" PRIu64 ", refused by budget %" PRIu64 "\n",
+       s.errors, s.missed, s.dropped, s.refused);
+   MSG("device: failures %" PRIu32 ", retries %" PRIu32 ", soft resets %" PRIu32 ", reopens %" PRIu32
+       ", recoveries %" PRIu32 "\n", d.failures, d.retries, d.soft_resets, d.reopens, d.recoveries);
+   MSG("cost: %" PRIu64 " bus bytes, %.1f ms bus time (%.3f%%), %.1f uC (%.2f uA average with standby)",
+       d.bus_bytes, d.bus_time / 1e3, (elapsed > 0) ? d.bus_time / (elapsed * 1e4) : 0.0, d.charge / 1e3,
+       (elapsed > 0) ? d.charge / (elapsed * 1e3) + BMP180_STANDBY_CURRENT / 1e3 : 0.0);
+   if(d.throttled > 0)
+      MSG(", throttled %" PRIu32 " times for %.1f ms", d.throttled, d.throttle_time / 1e3);
+   MSG("\n");
+   print_percentiles("jitter", &s.jitter);
+   print_percentiles("start delay", &s.start_delay);
+}
+
+/* ----------------------------------------------------------------------------------------------
+ * Commands
+ */
+
+static void on_signal(int sig)
+{
+   (void) sig;
+   interrupted = 1;
+}
+
+static void sleep_us(uint64_t us)
+{
+   struct timespec ts = { (time_t)(us / 1000000), (long)(us % 1000000) * 1000 };
+   nanosleep(&ts, NULL);
+}
+
+/* Formatting cost, so the bench shows how far the writer is from being the bottleneck */
+static void bench_format(format_t format)
+{
+   const size_t count = 1000000;
+   bmp180_sample_t s = { 1000000, 27898, 23843, 0, 150, 69964 };
+   char buf[CSV_MAX_LINE];
+   size_t bytes = 0;
+   uint64_t start = bmp180_now(), elapsed;
+
+   for(size_t i = 0; i < count; ++i)
+   {
+      s.timestamp += 10000;
+      s.pressure = 69964 + (int32_t)(i & 63);
+      bytes += format_sample(format, buf, &s, 0);
+   }
+   elapsed = bmp180_now() - start;
+   MSG("formatting: %.1f ns/sample (%.1f MB/s)\n", elapsed * 1000.0 / count,
+       (elapsed > 0) ? (double) bytes / elapsed : 0.0);
+}
+
+/* Time-stamp counter, where there is one; only used to report cycles alongside time */
+static inline uint64_t cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+   return __builtin_ia32_rdtsc();
+#else
+   return 0;
+#endif
+}
+
+static void report_update(const char *name, size_t count, uint64_t elapsed, uint64_t tsc)
+{
+   if(tsc > 0)
+      MSG("%s: %.1f ns/update (%.0f TSC cycles)\n", name, elapsed * 1000.0 / count, (double) tsc / count);
+   else
+      MSG("%s: %.1f ns/update\n", name, elapsed * 1000.0 / count);
+}
+
+/* Fixed-point estimator against the equivalent float code: powf() altitude and an
+   alpha-beta filter with the same gains */
+static void bench_estimator(void)
+{
+   const size_t count = 1000000;
+   const bmp180_estimator_config_t config = { 20000, 0, 300, 500 };
+   const float T = config.period / 1e6f;
+   const float lambda = config.acceleration_noise * T * T / config.altitude_noise;
+   const float r = (4.0f + lambda - sqrtf(8.0f * lambda + lambda * lambda)) / 4.0f;
+   const float alpha = 1.0f - r * r, beta = 2.0f * (1.0f - r) * (1.0f - r);
+   bmp180_estimator_t est = bmp180_estimator_init(&config);
+   bmp180_sample_t s = { 1000000, 27898, 23843, 0, 150, 100000 };
+   bmp180_estimate_t e;
+   volatile int32_t sink = 0;
+   float h = 0.0f, v = 0.0f;
+   uint64_t start, tsc;
+
+   if(NULL == est)
+      return;
+   start = bmp180_now();
+   tsc = cycles();
+   for(size_t i = 0; i < count; ++i)
+   {
+      s.timestamp += config.period;
+      s.pressure = 100000 - (int32_t)(i & 63);
+      bmp180_estimator_push(est, &s, &e);
+      sink += e.altitude;
+   }
+   report_update("estimator (fixed)", count, bmp180_now() - start, cycles() - tsc);
+   bmp180_estimator_free(est);
+
+   start = bmp180_now();
+   tsc = cycles();
+   for(size_t i = 0; i < count; ++i)
+   {
+      float z = 44330000.0f * (1.0f - powf((100000 - (int32_t)(i & 63)) / 101325.0f, 1.0f / 5.255f));
+      float residual = z - (h + v * T);
+      h = (i == 0) ? z : h + v * T + alpha * residual;
+      v = (i == 0) ? 0.0f : v + beta / T * residual;
+      sink += (int32_t) h;
+   }
+   report_update("estimator (float reference)", count, bmp180_now() - start, cycles() - tsc);
+   (void) sink;
+}
+
+/* The reference pressure stage, kept out of line so it's called the same way as the library's */
+static __attribute__((noinline)) bool divided_pressure(const bmp180_temperature_stage_t *stage,
+                                                       int32_t up, int32_t *pressure)
+{
+   return bmp180_divided_pressure(stage, up, pressure);
+}
+
+/* Compensation paths, per sample: both stages, the pressure stage alone with a reused
+   temperature stage (and with a plain division by B4, for reference), and batches with a
+   new UT every sample and every 64 samples */
+static void bench_compensation(const bmp180_calibration_t *cal)
+{
+   enum { BATCH = 1024, ROUNDS = 1000 };
+   static int32_t ut[BATCH], up[BATCH], temperature[BATCH], pressure[BATCH];
+   const size_t count = (size_t) BATCH * ROUNDS;
+   bmp180_temperature_stage_t stage;
+   volatile int32_t sink = 0;
+   uint64_t start, tsc;
+   int32_t P;
+
+   start = bmp180_now();
+   tsc = cycles();
+   for(size_t i = 0; i < count; ++i)
+   {
+      bmp180_compensate_temperature(cal, 0, 27898 + (int32_t)(i & 63), &stage);
+      bmp180_compensate_pressure(&stage, 23843 + (int32_t)(i & 1023), &P);
+      sink += P;
+   }
+   report_update("compensation (both stages)", count, bmp180_now() - start, cycles() - tsc);
+
+   bmp180_compensate_temperature(cal, 0, 27898, &stage);
+   start = bmp180_now();
+   tsc = cycles();
+   for(size_t i = 0; i < count; ++i)
+   {
+      bmp180_compensate_pressure(&stage, 23843 + (int32_t)(i & 1023), &P);
+      sink += P;
+   }
+   report_update("compensation (pressure stage)", count, bmp180_now() - start, cycles() - tsc);
+
+   start = bmp180_now();
+   tsc = cycles();
+   for(size_t i = 0; i < count; ++i)
+   {
+      divided_pressure(&stage, 23843 + (int32_t)(i & 1023), &P);
+      sink += P;
+   }
+   report_update("compensation (pressure stage, division reference)", count, bmp180_now() - start,
+                 cycles() - tsc);
+
+   for(int run = 0; run < 2; ++run)
+   {
+      const size_t run_length = (run == 0) ? 1 : 64;
+      for(size_t i = 0; i < BATCH; ++i)
+      {
+         ut[i] = 27898 + (int32_t)((i / run_length) & 63);
+         up[i] = 23843 + (int32_t) i;
+      }
+      start = bmp180_now();
+      tsc = cycles();
+      for(size_t r = 0; r < ROUNDS; ++r)
+      {
+         bmp180_compensate_batch(cal, 0, ut, up, BATCH, temperature, pressure);
+         sink += pressure[r & (BATCH - 1)];
+      }
+      report_update((run == 0) ? "batch (new UT every sample)" : "batch (new UT every 64 samples)",
+                    count, bmp180_now() - start, cycles() - tsc);
+   }
+   (void) sink;
+}
+
+/* Host-side decoding of snapshot records from a capture, so the bench shows the record rate
+   one host core sustains */
+static void bench_decoder(const bmp180_calibration_t *cal)
+{
+   enum { BATCH = 1024, ROUNDS = 1000 };
+   static uint8_t records[BATCH * BMP180_SNAPSHOT_RECORD_SIZE];
+   static bmp180_decoded_t decoded[BATCH];
+   const size_t count = (size_t) BATCH * ROUNDS;
+   uint8_t image[BMP180_SNAPSHOT_CALIBRATION_SIZE];
+   bmp180_decoder_t dec = bmp180_decoder_init();
+   bmp180_sample_t s = { 0 };
+   volatile int32_t sink = 0;
+   uint64_t start, tsc, elapsed;
+   uint32_t id;
+
+   if(NULL == dec)
+      return;
+   id = bmp180_snapshot_export_calibration(cal, image);
+   bmp180_decoder_add_calibration(dec, image);
+   for(size_t i = 0; i < BATCH; ++i)
+   {
+      s.timestamp = 1000000 + i * 10000;
+      s.ut = 27898 + (int32_t)(i & 3);
+      s.up = 23843 + (int32_t)(i & 63);
+      bmp180_snapshot_pack(&s, id, records + i * BMP180_SNAPSHOT_RECORD_SIZE);
+   }
+
+   start = bmp180_now();
+   tsc = cycles();
+   for(size_t r = 0; r < ROUNDS; ++r)
+   {
+      bmp180_decoder_decode(dec, records, BATCH, decoded);
+      sink += decoded[r & (BATCH - 1)].sample.pressure;
+   }
+   elapsed = bmp180_now() - start;
+   tsc = cycles() - tsc;
+   if(tsc > 0)
+      MSG("decoder: %.1f ns/record (%.0f TSC cycles), %.1f M records/s\n", elapsed * 1000.0 / count,
+          (double) tsc / count, (elapsed > 0) ? (double) count / elapsed : 0.0);
+   else
+      MSG("decoder: %.1f ns/record, %.1f M records/s\n", elapsed * 1000.0 / count,
+          (elapsed > 0) ? (double) count / elapsed : 0.0);
+   bmp180_decoder_free(dec);
+   (void) sink;
+}
+
+/* Compensate snapshot captures to CSV; records from every file's device can be mixed */
+static int decode(const options_t *o, char *const *files, int count)
+{
+   static uint8_t records[READ_BATCH * BMP180_SNAPSHOT_RECORD_SIZE];
+   static bmp180_decoded_t decoded[READ_BATCH];
+   char *buf = malloc(WRITE_BUFFER);
+   bmp180_decoder_t dec = bmp180_decoder_init();
+   bmp180_decoder_stats_t st;
+   FILE *out = stdout;
+   uint64_t start = bmp180_now(), decode_time = 0, valid = 0;
+   bool ok = (NULL != buf && NULL != dec);
+   size_t used = 0;
+   double elapsed;
+
+   if(ok && NULL != o->output && NULL == (out = fopen(o->output, "wb")))
+   {
+      ERR("Failed to open %s: %s\n", o->output, strerror(errno));
+      out = stdout;
+      ok = false;
+   }
+   if(ok)
+      fputs("timestamp_us,ut,up,oss,temperature_c,pressure_pa\n", out);
+
+   for(int f = 0; f < count && ok; ++f)
+   {
+      uint8_t header[SNAP_HEADER_SIZE];
+      FILE *in = (strcmp(files[f], "-") == 0) ? stdin : fopen(files[f], "rb");
+      size_t n;
+
+      if(NULL == in)
+      {
+         ERR("Failed to open %s: %s\n", files[f], strerror(errno));
+         ok = false;
+         break;
+      }
+      if(fread(header, 1, sizeof(header), in) != sizeof(header) || memcmp(header, SNAP_MAGIC, 8) != 0
+      || header[8] != BMP180_SNAPSHOT_RECORD_SIZE || header[9] != 0)
+      {
+         ERR("%s is not a snapshot capture\n", files[f]);
+         ok = false;
+      }
+      else if(!bmp180_decoder_add_calibration(dec, header + 10))
+      {
+         ERR("%s: conflicting calibration\n", files[f]);
+         ok = false;
+      }
+
+      while(ok && (n = fread(records, BMP180_SNAPSHOT_RECORD_SIZE, READ_BATCH, in)) > 0)
+      {
+         uint64_t t = bmp180_now();
+         bmp180_decoder_decode(dec, records, n, decoded);
+         decode_time += bmp180_now() - t;
+         for(size_t i = 0; i < n && ok; ++i)
+         {
+            if(!decoded[i].valid)
+               continue;
+            if(WRITE_BUFFER - used < CSV_MAX_LINE)
+            {
+               ok = (fwrite(buf, 1, used, out) == used);
+               used = 0;
+            }
+            used += format_csv(buf + used, &decoded[i].sample);
+            ++valid;
+         }
+      }
+      if(ok && ferror(in))
+      {
+         ERR("Failed to read %s\n", files[f]);
+         ok = false;
+      }
+      if(in != stdin)
+         fclose(in);
+   }
+   if(ok && used > 0 && fwrite(buf, 1, used, out) != used)
+      ok = false;
+   if(fflush(out) != 0)
+      ok = false;
+
+   elapsed = (bmp180_now() - start) / 1e6;
+   if(NULL != dec && bmp180_decoder_get_stats(dec, &st))
+   {
+      MSG("%" PRIu64 " records, %" PRIu32 " calibrations, %.2f s, %" PRIu64 " unknown calibration, %"
+          PRIu64 " invalid\n", st.records, st.calibrations, elapsed, st.unknown_calibration, st.invalid);
+      MSG("decoding: %.1f ns/record (%.1f M records/s)\n",
+          (st.records > 0) ? decode_time * 1000.0 / st.records : 0.0,
+          (decode_time > 0) ? (double) st.records / decode_time : 0.0);
+   }
+
+   if(out != stdout)
+      fclose(out);
+   bmp180_decoder_free(dec);
+   free(buf);
+   return (ok && valid > 0) ? 0 : 1;
+}
+
+static int run(const options_t *o)
+{
+   i2c_lowlevel_config config = { .device = o->device };
+   bmp180_sampler_config_t sampler_config;
+   bmp180_calibration_t cal;
+   writer_t w;
+   bmp180_t bmp;
+   uint64_t start, next, last_written = 0;
+   int result = 1;
+
+   if(o->bench)
+   {
+      bmp180_sim_set_values(o->device, 27898, 23843, o->noise);
+      bmp180_sim_set_faults(o->device, &o->faults);
+   }
+
+   bmp = bmp180_init(&config, o->address, o->mode);
+   if(NULL == bmp)
+   {
+      ERR("Failed to initialize BMP180 on %s\n", o->device);
+      return 1;
+   }
+   if(o->bench)
+   {
+      const bmp180_recovery_config_t recovery = { 3, 1000, 8000, true, true };
+      bmp180_set_recovery(bmp, &recovery);
+   }
+   if((o->budget.current > 0 || o->budget.bus_utilization > 0) && !bmp180_set_budget(bmp, &o->budget))
+   {
+      ERR("Invalid budget\n");
+      bmp180_free(bmp);
+      return 1;
+   }
+
+   memset(&w, 0, sizeof(w));
+   w.format = o->format;
+   w.out = stdout;
+   if(NULL != o->output && NULL == (w.out = fopen(o->output, "wb")))
+   {
+      ERR("Failed to open %s: %s\n", o->output, strerror(errno));
+      bmp180_free(bmp);
+      return 1;
+   }
+   if(o->format == FORMAT_BINARY)
+   {
+      uint8_t header[BIN_HEADER_SIZE];
+      bmp180_get_calibration(bmp, &cal);
+      fwrite(header, 1, format_binary_header(header, &cal), w.out);
+   }
+   else if(o->format == FORMAT_SNAPSHOT)
+   {
+      uint8_t header[SNAP_HEADER_SIZE];
+      bmp180_get_calibration(bmp, &cal);
+      fwrite(header, 1, format_snapshot_header(header, &cal, &w.calibration_id), w.out);
+   }
+   else
+      fputs("timestamp_us,ut,up,oss,temperature_c,pressure_pa\n", w.out);
+
+   sampler_config.period = (uint32_t)(1000000.0 / o->rate);
+   sampler_config.cpu = o->cpu;
+   sampler_config.priority = o->priority;
+   sampler_config.lock_memory = (o->priority > 0);
+   sampler_config.capacity = o->capacity;
+   w.sampler = bmp180_sampler_start(bmp, &sampler_config);
+   if(NULL == w.sampler)
+   {
+      ERR("Failed to start sampler\n");
+      goto out;
+   }
+   pthread_mutex_init(&w.mutex, NULL);
+   atomic_init(&w.done, false);
+   if(pthread_create(&w.thread, NULL, writer_thread, &w) != 0)
+   {
+      ERR("Failed to start writer\n");
+      bmp180_sampler_stop(w.sampler);
+      pthread_mutex_destroy(&w.mutex);
+      goto out;
+   }
+
+   start = bmp180_now();
+   next = start;
+   while(!interrupted)
+   {
+      uint64_t now = bmp180_now();
+      uint64_t end = (o->duration > 0) ? start + (uint64_t)(o->duration * 1e6) : UINT64_MAX;
+      uint64_t wake = end;
+      int error;
+
+      pthread_mutex_lock(&w.mutex);
+      error = w.error;
+      pthread_mutex_unlock(&w.mutex);
+      if(0 != error || now >= end)
+         break;
+      if(o->interval > 0)
+      {
+         if(now >= next)
+         {
+            if(next != start)
+               print_live(&w, (now - start) / 1e6, &last_written);
+            next += (uint64_t)(o->interval * 1e6);
+         }
+         if(next < wake)
+            wake = next;
+      }
+      /* Wake at least every 100 ms to notice signals and writer errors */
+      sleep_us((wake - now < 100000) ? wake - now : 100000);
+   }
+
+   atomic_store(&w.done, true);
+   pthread_join(w.thread, NULL);
+   print_summary(&w, bmp, (bmp180_now() - start) / 1e6);
+   /* Nothing drains the ring any more, and the benchmarks must run without the sampler */
+   bmp180_sampler_stop(w.sampler);
+   pthread_mutex_destroy(&w.mutex);
+   if(o->bench)
+   {
+      bmp180_sim_counters_t counters;
+      bmp180_sim_get_counters(o->device, &counters, false);
+      MSG("bus: %" PRIu32 " transactions, %" PRIu32 " failed, %" PRIu32 " conversions\n",
+          counters.transactions, counters.failures, counters.conversions);
+      bench_format(o->format);
+      if(bmp180_get_calibration(bmp, &cal))
+      {
+         bench_compensation(&cal);
+         bench_decoder(&cal);
+      }
+      bench_estimator();
+   }
+
+   if(0 != w.error)
+      ERR("Write failed: %s\n", strerror(w.error));
+   else
+      result = (w.written > 0) ? 0 : 1;
+
+out:
+   if(w.out != stdout)
+      fclose(w.out);
+   else
+      fflush(stdout);
+   bmp180_free(bmp);
+   return result;
+}
+
+/* ----------------------------------------------------------------------------------------------
+ * Command line
+ */
+
+static void usage(const char *name)
+{
+   ERR("Usage: %s [capture|bench] [options]\n"
+       "       %s decode [-o FILE] SNAPSHOT...\n"
+       "  capture              sample a device and stream the samples (default)\n"
+       "  bench                capture from a simulated device, then report formatting, compensation, decoder and estimator cost\n"
+       "  decode               compensate snapshot captures to CSV\n"
+       "Options:\n"
+       "  -d, --device PATH    i2c device (default " DEFAULT_DEVICE ", bench " BENCH_DEVICE ")\n"
+       "  -a, --address ADDR   device address (default: autodetect)\n"
+       "  -m, --mode N         oversampling mode 0-3 (default 2, bench 0)\n"
+       "  -r, --rate HZ        samples per second (default 10, bench 50)\n"
+       "  -t, --duration SEC   stop after SEC seconds (default: until interrupted, bench 5)\n"
+       "  -f, --format FMT     csv, binary or snapshot (default csv)\n"
+       "  -o, --output FILE    output file (default stdout, bench /dev/null)\n"
+       "  -i, --interval SEC   live statistics interval, 0 to disable (default 1)\n"
+       "  -c, --cpu N          pin the sampling thread to CPU N\n"
+       "  -p, --priority N     SCHED_FIFO priority of the sampling thread (locks memory)\n"
+       "  -b, --buffer N       ring buffer capacity, in samples (default 4096)\n"
+       "      --budget-current NA  limit the rate to an average sensor current (nA)\n"
+       "      --budget-bus PERMILLE  limit the rate to a share of bus time\n"
+       "bench only:\n"
+       "      --fail-every N   fail every Nth bus transaction\n"
+       "      --stall US       add US microseconds to every bus transaction\n"
+       "      --noise PA       pressure noise amplitude\n", name, name);
+}
+
+static bool parse_number(const char *s, double min, double max, double *value)
+{
+   char *end;
+   errno = 0;
+   *value = strtod(s, &end);
+   return (end != s && *end == '\0' && errno == 0 && *value >= min && *value <= max);
+}
+
+int main(int argc, char *argv[])
+{
+   enum { OPT_FAIL_EVERY = 256, OPT_STALL, OPT_NOISE, OPT_BUDGET_CURRENT, OPT_BUDGET_BUS };
+   static const struct option long_options[] = {
+      { "device", required_argument, NULL, 'd' },
+      { "address", required_argument, NULL, 'a' },
+      { "mode", required_argument, NULL, 'm' },
+      { "rate", required_argument, NULL, 'r' },
+      { "duration", required_argument, NULL, 't' },
+      { "format", required_argument, NULL, 'f' },
+      { "output", required_argument, NULL, 'o' },
+      { "interval", required_argument, NULL, 'i' },
+      { "cpu", required_argument, NULL, 'c' },
+      { "priority", required_argument, NULL, 'p' },
+      { "buffer", required_argument, NULL, 'b' },
+      { "fail-every", required_argument, NULL, OPT_FAIL_EVERY },
+      { "stall", required_argument, NULL, OPT_STALL },
+      { "noise", required_argument, NULL, OPT_NOISE },
+      { "budget-current", required_argument, NULL, OPT_BUDGET_CURRENT },
+      { "budget-bus", required_argument, NULL, OPT_BUDGET_BUS },
+      { "help", no_argument, NULL, 'h' },
+      { NULL, 0, NULL, 0 }
+   };
+   options_t o;
+   struct sigaction sa;
+   bool decoding = false;
+   double v;
+   int opt;
+
+   memset(&o, 0, sizeof(o));
+   o.device = DEFAULT_DEVICE;
+   o.mode = BMP180_MODE_HIGH_RESOLUTION;
+   o.rate = 10;
+   o.interval = 1;
+   o.cpu = -1;
+   o.capacity = 4096;
+   if(argc > 1 && argv[1][0] != '-')
+   {
+      if(strcmp(argv[1], "bench") == 0)
+      {
+         o.bench = true;
+         o.device = BENCH_DEVICE;
+         o.mode = BMP180_MODE_ULTRA_LOW_POWER;
+         o.rate = 50;
+         o.duration = 5;
+         o.output = "/dev/null";
+      }
+      else if(strcmp(argv[1], "decode") == 0)
+         decoding = true;
+      else if(strcmp(argv[1], "capture") != 0)
+      {
+         usage(argv[0]);
+         return 2;
+      }
+      --argc;
+      ++argv;
+   }
+
+   while((opt = getopt_long(argc, argv, "d:a:m:r:t:f:o:i:c:p:b:h", long_options, NULL)) != -1)
+   {
+      bool ok = true;
+      switch(opt)
+      {
+         case 'd': o.device = optarg; break;
+         case 'a': ok = parse_number(optarg, 0, 0x7f, &v); o.address = (uint8_t) v; break;
+         case 'm': ok = parse_number(optarg, 0, 3, &v); o.mode = (bmp180_mode_t) v; break;
+         case 'r': ok = parse_number(optarg, 0.01, 1000000, &v); o.rate = v; break;
+         case 't': ok = parse_number(optarg, 0, 1e9, &v); o.duration = v; break;
+         case 'i': ok = parse_number(optarg, 0, 1e9, &v); o.interval = v; break;
+         case 'c': ok = parse_number(optarg, 0, 1023, &v); o.cpu = (int) v; break;
+         case 'p': ok = parse_number(optarg, 0, 99, &v); o.priority = (int) v; break;
+         case 'b': ok = parse_number(optarg, 1, 1 << 24, &v); o.capacity = (uint32_t) v; break;
+         case 'o': o.output = (strcmp(optarg, "-") == 0) ? NULL : optarg; break;
+         case 'f':
+            if(strcmp(optarg, "csv") == 0)
+               o.format = FORMAT_CSV;
+            else if(strcmp(optarg, "binary") == 0)
+               o.format = FORMAT_BINARY;
+            else if(strcmp(optarg, "snapshot") == 0)
+               o.format = FORMAT_SNAPSHOT;
+            else
+               ok = false;
+            break;
+         case OPT_FAIL_EVERY: ok = parse_number(optarg, 0, UINT32_MAX, &v); o.faults.fail_every = (uint32_t) v; break;
+         case OPT_STALL: ok = parse_number(optarg, 0, 1000000, &v); o.faults.stall = (uint32_t) v; break;
+         case OPT_NOISE: ok = parse_number(optarg, 0, 100000, &v); o.noise = (uint32_t) v; break;
+         case OPT_BUDGET_CURRENT: ok = parse_number(optarg, 0, UINT32_MAX, &v); o.budget.current = (uint32_t) v; break;
+         case OPT_BUDGET_BUS: ok = parse_number(optarg, 0, 1000, &v); o.budget.bus_utilization = (uint16_t) v; break;
+         case 'h': usage(argv[0]); return 0;
+         default: ok = false; break;
+      }
+      if(!ok)
+      {
+         if(NULL != optarg)
+            ERR("Invalid argument: %s\n", optarg);
+         usage(argv[0]);
+         return 2;
+      }
+   }
+   if(decoding)
+   {
+      if(optind == argc)
+      {
+         usage(argv[0]);
+         return 2;
+      }
+      return decode(&o, argv + optind, argc - optind);
+   }
+   if(optind != argc)
+   {
+      usage(argv[0]);
+      return 2;
+   }
+
+   memset(&sa, 0, sizeof(sa));
+   sa.sa_handler = on_signal;
+   sigaction(SIGINT, &sa, NULL);
+   sigaction(SIGTERM, &sa, NULL);
+   signal(SIGPIPE, SIG_IGN);
+
+   return run(&o);
+}